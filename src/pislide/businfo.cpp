@@ -1,38 +1,77 @@
 
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
 #include "businfo.h"
 #include "util.h"
 #include "constants.h"
 #include "webservices.h"
+#include "metrics.h"
 
-BusInfo::BusInfo()
-    : mExecutor(1, []<typename T0>(T0 && PH1) { return fetchBusDataInThread(std::forward<T0>(PH1)); }),
-        mMostRecentFetch(0) {}
+BusInfo::BusInfo(ThreadPool &threadPool)
+    : mExecutor("BusInfo", threadPool, TaskClass::NETWORK, []<typename T0>(T0 && PH1) { return fetchBusDataInThread(std::forward<T0>(PH1)); }) {
 
-std::vector<time_t> BusInfo::getTimes(Config const &config) {
-    // See how long it's been since we fetched the info.
-    time_t now = nowEpoch();
-    time_t elapsed = now - mMostRecentFetch;
-
-    // If too long, fetch it.
-    if (elapsed > BUS_INFO_FETCH_S) {
-        mMostRecentFetch = now;
-        mExecutor.ask(Request {
-            .config = config,
-        });
+    // Only the most recent request matters.
+    mExecutor.setRequestCapacity(1, OverflowPolicy::DROP_OLDEST);
+}
+
+void BusInfo::update(Config const &config, bool wanted) {
+    receive();
+
+    // Coalesce: never more than one fetch at a time.
+    if (wanted && !mFetching && nowEpoch() >= mNextFetchTime) {
+        refresh(config);
     }
+}
 
+void BusInfo::refresh(Config const &config) {
+    if (mFetching) {
+        return;
+    }
+
+    mFetching = true;
+    mExecutor.ask(Request {
+        .config = config,
+    });
+}
+
+bool BusInfo::receive() {
     // Drain the reply queue.
     std::optional<Response> response = mExecutor.getMostRecent();
-    if (response) {
-        mMostRecentResponse = *response;
+    if (!response) {
+        return false;
     }
 
-    // Reply with the latest estimates.
-    return mMostRecentResponse.times;
+    mFetching = false;
+    time_t now = nowEpoch();
+    if (response->times.has_value()) {
+        mTimes.times = std::move(*response->times);
+        mTimes.fetchTime = now;
+        mFailureCount = 0;
+        mNextFetchTime = now + BUS_INFO_FETCH_S;
+    } else {
+        // Keep the old times, and wait longer after each failure.
+        mFailureCount++;
+        int delay = BUS_INFO_BACKOFF_MIN_S << std::min(mFailureCount - 1, 16);
+        delay = std::min(delay, BUS_INFO_BACKOFF_MAX_S);
+        mNextFetchTime = now + delay;
+        spdlog::warn("BusInfo: Fetch failed {} times, retrying in {} s", mFailureCount, delay);
+    }
+
+    return true;
 }
 
 BusInfo::Response BusInfo::fetchBusDataInThread(Request const &request) {
-    return Response {
-        .times = nextBuses(request.config),
-    };
+    HistogramTimer timer(metrics().busFetchTime);
+    try {
+        return Response {
+            .times = nextBuses(request.config),
+        };
+    } catch (std::exception const &e) {
+        // Always respond, so the render thread knows the fetch is over.
+        spdlog::warn("BusInfo: Fetch failed ({})", e.what());
+        metrics().busFetchFailures.add();
+        return Response {};
+    }
 }
@@ -2,13 +2,26 @@
 #pragma once
 
 #include <ctime>
+#include <optional>
 #include <vector>
 
 #include "executor.h"
 #include "config.h"
 
 /**
- * Asynchronously fetches bus information.
+ * The bus arrival times we most recently got.
+ */
+struct BusTimes final {
+    // Sorted epoch times that the bus is expected to show up.
+    std::vector<time_t> times;
+    // When these were fetched, or 0 if we never got any.
+    time_t fetchTime = 0;
+};
+
+/**
+ * Asynchronously fetches bus information. Keeps serving the last good times
+ * while fetching new ones, fetches at most one at a time, and backs off
+ * exponentially while fetches fail. Only used on the render thread.
  */
 class BusInfo final {
     // Request sent to the executor's thread.
@@ -18,32 +31,66 @@ class BusInfo final {
 
     // Response from the executor's thread.
     struct Response {
-        std::vector<time_t> times;
+        // No value if the fetch failed.
+        std::optional<std::vector<time_t>> times;
     };
 
     // Executor to fetch the bus data in another thread.
-    Executor<Request,Response> mExecutor;
+    Executor<Request,Response,SpscQueue> mExecutor;
+
+    // Whether a request has been sent and its response not yet received.
+    bool mFetching = false;
 
-    // When we most recently fetched data.
-    time_t mMostRecentFetch;
+    // Don't start a fetch before this time, after a success or a failure.
+    time_t mNextFetchTime = 0;
 
-    // The most recent response.
-    Response mMostRecentResponse;
+    // Number of failures since the most recent success.
+    int mFailureCount = 0;
+
+    // The most recent good response.
+    BusTimes mTimes;
 
     // Fetch the bus data. Runs in a different thread.
     static Response fetchBusDataInThread(Request const &request);
 
 public:
-    BusInfo();
+    BusInfo(ThreadPool &threadPool);
 
     // Can't copy.
     BusInfo(const BusInfo &) = delete;
     BusInfo &operator=(const BusInfo &) = delete;
 
     /**
-     * Return a sorted vector of epoch times that the bus is expected to
-     * show up. If no bus information has been configured, or if anything
-     * goes wrong fetching the information, an empty vector is returned.
+     * Call every frame. Takes the response of a finished fetch, if any, and
+     * if the times are wanted (being shown or about to be), starts a new
+     * fetch when they're out of date.
+     */
+    void update(Config const &config, bool wanted);
+
+    /**
+     * Start a fetch now, however recently we fetched, unless one is
+     * already in progress.
+     */
+    void refresh(Config const &config);
+
+    /**
+     * Take the response of a finished fetch, if any. Returns whether there
+     * was one. Called by update().
+     */
+    bool receive();
+
+    /**
+     * The most recent good times. If no bus information has been configured,
+     * or nothing has been fetched yet, the times are empty.
+     */
+    BusTimes const &times() const {
+        return mTimes;
+    }
+
+    /**
+     * Number of fetches that have failed since the last one that worked.
      */
-    std::vector<time_t> getTimes(Config const &config);
+    int failureCount() const {
+        return mFailureCount;
+    }
 };
@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include <deque>
+#include <optional>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/std.h>
@@ -22,12 +23,30 @@ namespace {
 
         return path;
     }
+
+    /**
+     * Parse "block", "drop_oldest", or "reject".
+     */
+    std::optional<OverflowPolicy> parseOverflowPolicy(std::string const &s) {
+        if (s == "block") {
+            return OverflowPolicy::BLOCK;
+        } else if (s == "drop_oldest") {
+            return OverflowPolicy::DROP_OLDEST;
+        } else if (s == "reject") {
+            return OverflowPolicy::REJECT;
+        } else {
+            return std::nullopt;
+        }
+    }
 }
 
 Config::Config() :
     slideDisplayTime(12), slideTransitionTime(2), maxPauseTime(60*60), maxBusTime(60*60),
     minRating(3), minDays(0), maxDays(0), windowWidth(0), windowHeight(0),
-    webSubdir("web"), webHostname("0.0.0.0"), webPort(8080) {}
+    bus511orgBaseUrl("https://api.511.org"), twilioBaseUrl("https://api.twilio.com"),
+    twilioStateFile("twilio-state.json"), webSubdir("web"), webHostname("0.0.0.0"), webPort(8080),
+    webMaxQueuedUploads(20), webUploadQueuePolicy(OverflowPolicy::REJECT),
+    webThumbnailDir("thumbnails") {}
 
 bool Config::readConfigFile(std::filesystem::path const &pathname) {
     try {
@@ -81,6 +100,10 @@ bool Config::readConfigFile(std::filesystem::path const &pathname) {
             this->bus511orgStopCode = *value;
         }
 
+        if (auto value = config.at_path("511org.base_url").value<std::string>()) {
+            this->bus511orgBaseUrl = *value;
+        }
+
         if (auto unwantedDirs = config["unwanted_dirs"].as_array()) {
             for (auto const &dir : *unwantedDirs) {
                 if (auto s = dir.value<std::string>()) {
@@ -125,6 +148,14 @@ bool Config::readConfigFile(std::filesystem::path const &pathname) {
             this->twilioSubdir = *value;
         }
 
+        if (auto value = config.at_path("twilio.base_url").value<std::string>()) {
+            this->twilioBaseUrl = *value;
+        }
+
+        if (auto value = config.at_path("twilio.state_file").value<std::string>()) {
+            this->twilioStateFile = *value;
+        }
+
         if (auto value = config.at_path("web.subdir").value<std::string>()) {
             this->webSubdir = *value;
         }
@@ -140,6 +171,28 @@ bool Config::readConfigFile(std::filesystem::path const &pathname) {
         if (auto value = config.at_path("web.port").value<int>()) {
             this->webPort = *value;
         }
+
+        if (auto value = config.at_path("web.max_queued_uploads").value<int>()) {
+            this->webMaxQueuedUploads = *value;
+        }
+
+        if (auto value = config.at_path("web.upload_queue_policy").value<std::string>()) {
+            auto policy = parseOverflowPolicy(*value);
+            if (!policy) {
+                spdlog::error("Invalid web.upload_queue_policy \"{}\" in config file {}",
+                        *value, pathname);
+                return false;
+            }
+            this->webUploadQueuePolicy = *policy;
+        }
+
+        if (auto value = config.at_path("web.thumbnail_dir").value<std::string>()) {
+            this->webThumbnailDir = *value;
+        }
+
+        if (auto value = config.at_path("debug.trace_file").value<std::string>()) {
+            this->traceFile = *value;
+        }
     } catch (toml::parse_error const &err) {
         spdlog::error("Problem with config file {}: {} at line {}",
                 pathname, err.description(), err.source().begin.line);
@@ -5,6 +5,8 @@
 #include <filesystem>
 #include <set>
 
+#include "tsqueue.h"
+
 /**
  * Holds all configurations. This includes:
  *
@@ -81,6 +83,12 @@ struct Config final {
      */
     std::string bus511orgStopCode;
 
+    /**
+     * Scheme and host of the 511.org API. Defaults to "https://api.511.org".
+     * Point it at a local server to test without 511.org.
+     */
+    std::string bus511orgBaseUrl;
+
     /**
      * Directories to skip.
      */
@@ -125,6 +133,19 @@ struct Config final {
      */
     std::filesystem::path twilioSubdir;
 
+    /**
+     * Scheme and host of the Twilio API. Defaults to "https://api.twilio.com".
+     * Point it at a local server to test without Twilio.
+     */
+    std::string twilioBaseUrl;
+
+    /**
+     * File that remembers which Twilio messages we've already fetched, so
+     * that polls only list new ones. Defaults to "twilio-state.json" in
+     * the current directory. Leave empty to keep it in memory only.
+     */
+    std::filesystem::path twilioStateFile;
+
     /**
      * Directory below rootDir to store web-uploaded photos. Defaults to "web".
      * Leave empty to disable to web server.
@@ -147,6 +168,31 @@ struct Config final {
      */
     int webPort;
 
+    /**
+     * Maximum number of web uploads waiting to be added to the slideshow.
+     * Defaults to 20. Zero means no limit.
+     */
+    int webMaxQueuedUploads;
+
+    /**
+     * What to do with an upload when webMaxQueuedUploads are already waiting.
+     * Defaults to REJECT, which tells the user to try again (HTTP 503).
+     */
+    OverflowPolicy webUploadQueuePolicy;
+
+    /**
+     * Directory to keep thumbnails for the web gallery in. Defaults to
+     * "thumbnails" in the current directory. Should not be under rootDir,
+     * or the thumbnails will be added to the slideshow.
+     */
+    std::filesystem::path webThumbnailDir;
+
+    /**
+     * Pathname to write a Chrome JSON trace file to on exit, or empty
+     * to not record trace events.
+     */
+    std::filesystem::path traceFile;
+
     /**
      * Set default values.
      */
@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <array>
+
 // Pixels around the edge where we don't draw text.
 constexpr float DISPLAY_MARGIN = 50;
 
@@ -17,6 +19,18 @@ constexpr int SLIDE_CACHE_SIZE = 4;
 // Seconds between fetches of bus info.
 constexpr int BUS_INFO_FETCH_S = 60;
 
+// Seconds to wait for 511.org to connect, and to answer, before giving up.
+constexpr int BUS_INFO_CONNECT_TIMEOUT_S = 5;
+constexpr int BUS_INFO_TIMEOUT_S = 10;
+
+// Seconds to wait before retrying a failed bus info fetch. Doubles with
+// each consecutive failure, up to the maximum.
+constexpr int BUS_INFO_BACKOFF_MIN_S = 5;
+constexpr int BUS_INFO_BACKOFF_MAX_S = 10*60;
+
+// Seconds after which bus times are shown with their age.
+constexpr int BUS_INFO_STALE_S = 3*60;
+
 // Maximum width or height of an image. Those bigger than this get downsized.
 // On the Raspberry Pi 5 the max texture size is 4096 according to
 // `glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);`, and in any case we don't
@@ -29,3 +43,119 @@ constexpr double MIN_TWILIO_FETCH_INTERVAL_S = 1;
 
 // Number of displayed log entries in debug mode.
 constexpr int DEBUG_LOG_COUNT = 12;
+
+// Maximum number of log messages waiting to be written. Beyond this the
+// oldest are dropped.
+constexpr size_t LOG_QUEUE_SIZE = 8192;
+
+// Seconds between flushes of the log file. Warnings and errors are
+// flushed right away.
+constexpr int LOG_FLUSH_INTERVAL_S = 5;
+
+// Raylib log messages waiting to be passed to spdlog, beyond which they're
+// dropped. Must be a power of two.
+constexpr size_t RAYLIB_LOG_QUEUE_CAPACITY = 256;
+
+// Maximum length of a raylib log message, including the terminating nul.
+// Longer ones are truncated.
+constexpr size_t RAYLIB_LOG_LINE_SIZE = 256;
+
+// Milliseconds between passes of raylib log messages to spdlog.
+constexpr int RAYLIB_LOG_DRAIN_INTERVAL_MS = 100;
+
+// Seconds that a rendered text texture can go unused before it's unloaded.
+constexpr double TEXT_CACHE_MAX_UNUSED_S = 10;
+
+// Maximum number of rendered text textures to keep, in case something
+// writes a different string every frame.
+constexpr int TEXT_CACHE_MAX_SIZE = 200;
+
+// Frames per second to render while something is animating.
+constexpr int TARGET_FPS = 40;
+
+// Seconds to sleep between input polls while nothing on screen is changing.
+constexpr double IDLE_POLL_S = 0.05;
+
+// While idle, seconds between redraws of slowly-changing information
+// (bus times, debug overlay).
+constexpr double IDLE_REFRESH_S = 1;
+
+// Seconds between rebuilds of the debug overlay's text. Each line that
+// changed is rasterized into a new texture, so don't do it every frame.
+constexpr double DEBUG_OVERLAY_REFRESH_S = 0.5;
+
+// Seconds over which the render duty cycle is computed.
+constexpr double DUTY_CYCLE_WINDOW_S = 5;
+
+// Maximum number of images being loaded at once. Each decoded image can
+// take 16 MB, so this bounds the memory used by loads in flight.
+constexpr size_t MAX_IMAGE_LOADS_IN_FLIGHT = 2*SLIDE_CACHE_SIZE;
+
+// Maximum number of web uploads being added and decoded at once. The rest
+// wait in the upload queue.
+constexpr int MAX_INGESTS_IN_FLIGHT = 2;
+
+// Number of bytes at the end of a photo file that are hashed to identify
+// the photo even if its metadata (at the front) changes.
+constexpr size_t HASH_BACK_SIZE = 1024;
+
+// Bytes read at a time when hashing a file.
+constexpr size_t HASH_READ_CHUNK_SIZE = 256*1024;
+
+// Seconds that web clients are told to wait when the upload queue is full.
+constexpr int UPLOAD_RETRY_AFTER_S = 5;
+
+// Minimum number of threads in the shared thread pool, so that a slow
+// network call can't block image decoding on a single-core machine.
+constexpr int MIN_WORKER_THREADS = 2;
+
+// Number of recent samples kept per profiled phase.
+constexpr int PROFILER_WINDOW_SIZE = 1000;
+
+// Seconds between dumps of the profiler summary to the log.
+constexpr double PROFILER_LOG_INTERVAL_S = 5*60;
+
+// Maximum number of trace events to record before tracing stops. Each is
+// about 40 bytes.
+constexpr size_t TRACE_MAX_EVENTS = 1000000;
+
+// Thumbnail sizes made for the web gallery, in pixels, smallest first.
+// Requests for other sizes are rounded up to one of these.
+constexpr std::array<int,3> THUMBNAIL_SIZES = { 160, 320, 640 };
+
+// Seconds a web request waits for a thumbnail to be made.
+constexpr int THUMBNAIL_TIMEOUT_S = 10;
+
+// Photos returned by one page of the web gallery API, by default and at most.
+constexpr int GALLERY_DEFAULT_PAGE_SIZE = 50;
+constexpr int GALLERY_MAX_PAGE_SIZE = 200;
+
+// Remote-control commands waiting for the render thread. More than this
+// in one frame means someone is hammering the buttons.
+constexpr size_t REMOTE_COMMAND_QUEUE_CAPACITY = 64;
+
+// Maximum number of simultaneous remote-control event streams. Each ties
+// up a web server thread.
+constexpr int MAX_EVENT_STREAMS = 4;
+
+// Seconds between keep-alive comments on an idle event stream.
+constexpr int EVENT_STREAM_KEEPALIVE_S = 15;
+
+// Maximum number of requests to Twilio in flight at once, and so of
+// connections kept open to it.
+constexpr size_t TWILIO_MAX_PARALLEL_REQUESTS = 4;
+
+// Number of messages to ask Twilio for per page of the message list.
+constexpr int TWILIO_MESSAGE_PAGE_SIZE = 100;
+
+// Maximum number of pages of new messages to list in one poll. Beyond
+// this the older messages are listed later, as a backlog.
+constexpr int TWILIO_MAX_MESSAGE_PAGES = 10;
+
+// Pages of the backlog to list in each poll, so that working through
+// it doesn't slow down new messages.
+constexpr int TWILIO_BACKLOG_PAGES_PER_POLL = 1;
+
+// Number of polls that can fail to get a message's images before we
+// give up on it.
+constexpr int TWILIO_MAX_MESSAGE_ATTEMPTS = 5;
@@ -2,8 +2,11 @@
 #include <iostream> // TODO remove
 #include <stdexcept>
 #include <sstream>
+#include <mutex>
 
 #include "database.h"
+#include "trace.h"
+#include "metrics.h"
 
 using namespace std::string_literals;
 
@@ -28,13 +31,15 @@ bool PreparedStatement::step() const {
 
 // --------------------------------------------------------------------------------
 
-Database::Database() {
+Database::Database() : Database(DATABASE_PATHNAME) {}
+
+Database::Database(std::string const &pathname) {
     mDb = nullptr;
 
-    int rc = sqlite3_open(DATABASE_PATHNAME.c_str(), &mDb);
+    int rc = sqlite3_open(pathname.c_str(), &mDb);
     if (rc != SQLITE_OK) {
         std::stringstream ss;
-        ss << "can't open database \"" << DATABASE_PATHNAME << "\": " << sqlite3_errmsg(mDb);
+        ss << "can't open database \"" << pathname << "\": " << sqlite3_errmsg(mDb);
         sqlite3_close(mDb);
         throw std::invalid_argument(ss.str());
     }
@@ -59,6 +64,10 @@ std::unique_ptr<PreparedStatement> Database::prepare(std::string const &sql) con
 }
 
 void Database::printPersons() const {
+    TraceSpan span("Database::printPersons");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::PRINT_PERSONS));
+
     auto stmt = prepare("SELECT id, email_address FROM person");
 
     while (stmt->step()) {
@@ -71,6 +80,10 @@ void Database::printPersons() const {
 }
 
 std::vector<Photo> Database::getAllPhotos() const {
+    TraceSpan span("Database::getAllPhotos");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::GET_ALL_PHOTOS));
+
     auto stmt = prepare("SELECT "s + PHOTO_FIELDS + " FROM photo");
     std::vector<Photo> photos;
 
@@ -89,6 +102,10 @@ std::vector<Photo> Database::getAllPhotos() const {
 }
 
 std::optional<Photo> Database::getPhotoByHashBack(std::string const &hashBack) const {
+    TraceSpan span("Database::getPhotoByHashBack");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::GET_PHOTO_BY_HASH_BACK));
+
     auto stmt = prepare("SELECT "s + PHOTO_FIELDS + " FROM photo WHERE hash_back = ?");
     stmt->bindString(1, hashBack);
 
@@ -107,6 +124,10 @@ std::optional<Photo> Database::getPhotoByHashBack(std::string const &hashBack) c
 }
 
 std::optional<Photo> Database::getPhotoById(int32_t id) const {
+    TraceSpan span("Database::getPhotoById");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::GET_PHOTO_BY_ID));
+
     auto stmt = prepare("SELECT "s + PHOTO_FIELDS + " FROM photo WHERE id = ?");
     stmt->bindInt(1, id);
 
@@ -125,6 +146,10 @@ std::optional<Photo> Database::getPhotoById(int32_t id) const {
 }
 
 std::vector<PhotoFile> Database::getAllPhotoFiles() const {
+    TraceSpan span("Database::getAllPhotoFiles");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::GET_ALL_PHOTO_FILES));
+
     auto stmt = prepare("SELECT "s + PHOTO_FILE_FIELDS + " FROM photo_file");
     std::vector<PhotoFile> photoFiles;
 
@@ -139,6 +164,10 @@ std::vector<PhotoFile> Database::getAllPhotoFiles() const {
 }
 
 void Database::savePhoto(Photo const &photo) const {
+    TraceSpan span("Database::savePhoto");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::SAVE_PHOTO));
+
     auto stmt = prepare("INSERT OR REPLACE INTO photo ("s +
             PHOTO_FIELDS + ") VALUES (?, ?, ?, ?, ?, ?, ?)");
 
@@ -156,7 +185,27 @@ void Database::savePhoto(Photo const &photo) const {
     }
 }
 
+void Database::savePhotoLabel(int32_t id, std::string const &label) const {
+    TraceSpan span("Database::savePhotoLabel");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::SAVE_PHOTO_LABEL));
+
+    auto stmt = prepare("UPDATE photo SET label = ? WHERE id = ?");
+
+    stmt->bindString(1, label);
+    stmt->bindInt(2, id);
+
+    auto error = stmt->step();
+    if (error) {
+        throw std::invalid_argument("can't execute statement");
+    }
+}
+
 int32_t Database::insertPhoto(Photo const &photo) const {
+    TraceSpan span("Database::insertPhoto");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::INSERT_PHOTO));
+
     auto stmt = prepare("INSERT INTO photo ("s +
             PHOTO_FIELDS + ") VALUES (NULL, ?, ?, ?, ?, ?, ?)");
 
@@ -176,6 +225,10 @@ int32_t Database::insertPhoto(Photo const &photo) const {
 }
 
 void Database::savePhotoFile(PhotoFile const &photoFile) const {
+    TraceSpan span("Database::savePhotoFile");
+    std::lock_guard lock(mMutex);
+    HistogramTimer timer(metrics().dbStatementTime(DbStatement::SAVE_PHOTO_FILE));
+
     auto stmt = prepare("INSERT OR REPLACE INTO photo_file ("s +
             PHOTO_FILE_FIELDS + ") VALUES (?, ?, ?)");
 
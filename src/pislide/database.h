@@ -5,6 +5,7 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <mutex>
 #include <sqlite3.h>
 
 #include "model.h"
@@ -80,11 +81,16 @@ public:
 };
 
 /**
- * Connection to the database.
+ * Connection to the database. Safe to use from several threads; each call
+ * is atomic, but a sequence of calls isn't.
  */
 class Database final {
     sqlite3 *mDb;
 
+    // Serializes use of the connection, since insertPhoto() relies on the
+    // connection's last inserted row ID.
+    mutable std::mutex mMutex;
+
     /**
      * Returns a prepared statement of the SQL query. Throws on error.
      */
@@ -92,6 +98,12 @@ class Database final {
 
 public:
     Database();
+
+    /**
+     * Open the database at this pathname instead of the default one.
+     * The schema must already exist.
+     */
+    explicit Database(std::string const &pathname);
     ~Database();
 
     // Can't copy, might prematurely close the connection.
@@ -107,6 +119,7 @@ public:
 
     // Updates.
     void savePhoto(Photo const &photo) const;
+    void savePhotoLabel(int32_t id, std::string const &label) const;
     int32_t insertPhoto(Photo const &photo) const; // Returns ID.
     void savePhotoFile(PhotoFile const &photoFile) const;
 };
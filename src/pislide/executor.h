@@ -2,69 +2,112 @@
 #pragma once
 
 #include <iostream>
-#include <thread>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <optional>
 
 #include "tsqueue.h"
+#include "ringbuffer.h"
+#include "trace.h"
+#include "threadpool.h"
 
 /**
- * Passes tasks to a set of threads and makes the results available.
+ * Runs requests one at a time on the shared thread pool and makes the
+ * results available. Requests and responses are moved through the queues,
+ * never copied.
+ *
+ * RESPONSE_QUEUE is the type of queue that carries responses back to the
+ * caller: the mutex-based ThreadSafeQueue, or the lock-free SpscQueue or
+ * MpscQueue, so that polling with get() doesn't take a lock. Requests are
+ * never run concurrently, so SpscQueue is fine.
  */
-template <typename REQUEST, typename RESPONSE>
+template <typename REQUEST, typename RESPONSE,
+         template <typename> typename RESPONSE_QUEUE = ThreadSafeQueue>
 class Executor final {
-    // The function to call for each request.
-    std::function<RESPONSE(REQUEST const &)> mRun;
-    // Threads in the pool.
-    std::vector<std::unique_ptr<std::thread>> mThreads;
-    // Requests, or (if optional has no data), threads should terminate.
-    ThreadSafeQueue<std::optional<REQUEST>> mRequestQueue;
-    // Responses.
-    ThreadSafeQueue<RESPONSE> mResponseQueue;
+    /**
+     * Everything that tasks on the pool need. Shared so that a task that's
+     * still queued or running when the executor is destroyed doesn't
+     * reference freed memory.
+     */
+    struct State final {
+        // Name for traces. Must be a string literal.
+        char const *name;
+        TaskClass taskClass;
+        // The function to call for each request.
+        std::function<RESPONSE(REQUEST const &)> run;
+        ThreadSafeQueue<REQUEST> requestQueue;
+        RESPONSE_QUEUE<RESPONSE> responseQueue;
+
+        // Protects the flags.
+        std::mutex mutex;
+        // Whether a task to process the request queue is on the pool.
+        bool scheduled = false;
+        // Whether the executor has been destroyed.
+        bool stopped = false;
+    };
+
+    ThreadPool &mPool;
+    std::shared_ptr<State> mState;
 
     /**
-     * Top-level thread function.
+     * Put a task on the pool to run the next request. The state's mutex must
+     * be held.
      */
-    void loop() {
-        while (true) {
-            std::optional<REQUEST> request = mRequestQueue.dequeue();
-            if (!request.has_value()) {
-                // Terminate thread.
-                return;
-            }
+    static void schedule(ThreadPool &pool, std::shared_ptr<State> const &state) {
+        state->scheduled = true;
+        pool.submit(state->taskClass, [&pool, state]() {
+            runOne(pool, state);
+        });
+    }
+
+    /**
+     * Run one request, then reschedule if there are more. Running only one
+     * per task lets higher-priority work in between requests.
+     */
+    static void runOne(ThreadPool &pool, std::shared_ptr<State> const &state) {
+        std::optional<REQUEST> request = state->requestQueue.try_dequeue();
+        if (request.has_value()) {
             try {
-                RESPONSE response = mRun(*request);
-                mResponseQueue.enqueue(response);
+                TraceSpan span(state->name);
+                state->responseQueue.emplace(state->run(*request));
             } catch (std::exception const &e) {
                 std::cerr << "Executor run function threw exception: " << e.what() << '\n';
             } catch (...) {
                 std::cerr << "Executor run function threw exception" << '\n';
             }
         }
+
+        std::lock_guard lock(state->mutex);
+        if (!state->stopped && !state->requestQueue.empty()) {
+            schedule(pool, state);
+        } else {
+            state->scheduled = false;
+        }
     }
 
 public:
-    Executor(int threadCount, std::function<RESPONSE(REQUEST const &)> run): mRun(std::move(run)) {
-        for (int i = 0; i < threadCount; i++) {
-            mThreads.emplace_back(std::make_unique<std::thread>(&Executor::loop, this));
-        }
+    Executor(char const *name, ThreadPool &pool, TaskClass taskClass,
+            std::function<RESPONSE(REQUEST const &)> run)
+        : mPool(pool), mState(std::make_shared<State>()) {
+
+        mState->name = name;
+        mState->taskClass = taskClass;
+        mState->run = std::move(run);
     }
 
     ~Executor() {
         // This "clear" assumes that the task has no permanent value (e.g., modifying
         // database, saving a file, sending an email). Might want to have a flag for
-        // whether to do this.
-        mRequestQueue.clear();
-
-        // Enqueue requests to terminate the thread.
-        for (unsigned int i = 0; i < mThreads.size(); i++) {
-            mRequestQueue.enqueue(std::optional<REQUEST>());
-        }
-
-        // Wait for all of them to finish.
-        for (auto &t : mThreads) {
-            t->join();
-        }
+        // whether to do this. A request that's already running finishes, but
+        // its response is dropped. Nobody will drain the response queue now,
+        // so close it, otherwise a task waiting for room in it would keep
+        // its worker (and the pool's destructor) waiting forever.
+        mState->responseQueue.close();
+        std::lock_guard lock(mState->mutex);
+        mState->stopped = true;
+        mState->requestQueue.clear();
     }
 
     // Can't copy.
@@ -72,10 +115,34 @@ public:
     Executor &operator=(const Executor &) = delete;
 
     /**
-     * Submit the request for processing.
+     * Bound the number of requests waiting to run. See ThreadSafeQueue.
+     */
+    void setRequestCapacity(size_t capacity, OverflowPolicy policy) {
+        mState->requestQueue.setCapacity(capacity, policy);
+    }
+
+    /**
+     * Submit the request for processing. Returns whether it was queued,
+     * which is always true unless the request queue is full and its policy
+     * is REJECT.
      */
-    void ask(REQUEST const &request) {
-        mRequestQueue.enqueue(std::make_optional(request));
+    bool ask(REQUEST &&request) {
+        if (!mState->requestQueue.emplace(std::move(request))) {
+            return false;
+        }
+
+        std::lock_guard lock(mState->mutex);
+        if (!mState->scheduled) {
+            schedule(mPool, mState);
+        }
+        return true;
+    }
+
+    /**
+     * Occupancy of the request queue.
+     */
+    QueueStats requestQueueStats() {
+        return mState->requestQueue.stats();
     }
 
     /**
@@ -83,16 +150,23 @@ public:
      * one queued request at a time.
      */
     void clearRequestQueue() {
-        mRequestQueue.clear();
+        mState->requestQueue.clear();
     }
 
     /**
      * Get a response, if any.
      */
     std::optional<RESPONSE> get() {
-        return mResponseQueue.try_dequeue();
+        return mState->responseQueue.try_dequeue();
     }
 
+    /**
+     * Get all available responses, appending them to "out". Returns the
+     * number of responses added.
+     */
+    size_t drain(std::vector<RESPONSE> &out) {
+        return mState->responseQueue.drain(out);
+    }
     /**
      * Drain the response queue and return the most recent response, if any.
      */
@@ -102,7 +176,7 @@ public:
         while (true) {
             std::optional<RESPONSE> tryResponse = get();
             if (tryResponse.has_value()) {
-                response = tryResponse;
+                response = std::move(tryResponse);
             } else {
                 break;
             }
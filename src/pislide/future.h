@@ -0,0 +1,308 @@
+
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "threadpool.h"
+
+template <typename T>
+class Future;
+
+namespace future_detail {
+    /**
+     * Log the exception of a failed task.
+     */
+    inline void logError(std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (std::exception const &e) {
+            spdlog::error("Task failed: {}", e.what());
+        } catch (...) {
+            spdlog::error("Task failed");
+        }
+    }
+
+    /**
+     * The result of a task, shared by the task and the Future that will
+     * eventually receive it.
+     */
+    template <typename T>
+    struct State final : std::enable_shared_from_this<State<T>> {
+        std::mutex mutex;
+        bool done = false;
+        std::optional<T> value;
+        std::exception_ptr error;
+        // Called once the value or error is set. Must not keep a shared_ptr
+        // to this state, that would be a cycle if the value never comes.
+        std::function<void()> continuation;
+        // Whether something downstream took responsibility for the error.
+        bool errorHandled = false;
+
+        ~State() {
+            if (error && !errorHandled) {
+                logError(error);
+            }
+        }
+
+        /**
+         * Call the function once the value or error is set, right away if
+         * it already is.
+         */
+        void onDone(std::function<void()> fn) {
+            {
+                std::lock_guard lock(mutex);
+                if (continuation) {
+                    throw std::logic_error("future already has a continuation");
+                }
+                if (!done) {
+                    continuation = std::move(fn);
+                    return;
+                }
+            }
+            fn();
+        }
+
+        void finish(std::optional<T> &&newValue, std::exception_ptr newError) {
+            std::function<void()> fn;
+            {
+                std::lock_guard lock(mutex);
+                value = std::move(newValue);
+                error = newError;
+                done = true;
+                fn = std::move(continuation);
+            }
+            if (fn) {
+                fn();
+            }
+        }
+
+        void setValue(T &&newValue) {
+            finish(std::optional<T>(std::move(newValue)), nullptr);
+        }
+
+        void setError(std::exception_ptr newError) {
+            finish(std::nullopt, newError);
+        }
+    };
+
+    /**
+     * Call fn(args...) and store its result or exception in the state.
+     */
+    template <typename T, typename F, typename... ARGS>
+    void runInto(State<T> &state, F &fn, ARGS &&...args) {
+        try {
+            state.setValue(fn(std::forward<ARGS>(args)...));
+        } catch (...) {
+            state.setError(std::current_exception());
+        }
+    }
+
+    /**
+     * Where a continuation runs: a worker thread of the given class, or the
+     * render thread if there's no class.
+     */
+    inline void post(ThreadPool &pool, std::optional<TaskClass> taskClass, ThreadPool::Task task) {
+        if (taskClass.has_value()) {
+            pool.submit(*taskClass, std::move(task));
+        } else {
+            pool.submitToMainThread(std::move(task));
+        }
+    }
+}
+
+/**
+ * The eventual result of a task on the thread pool. Add a continuation with
+ * then() (on a worker thread) or thenOnMainThread() (on the render thread,
+ * during ThreadPool::runMainThreadTasks()) to get a Future for the next
+ * stage, so a multi-stage job can be written as one chain:
+ *
+ *     runAsync(pool, TaskClass::NETWORK, download)
+ *         .then(TaskClass::MAINTENANCE, hashAndStore)
+ *         .onMainThread(show);
+ *
+ * onMainThread() ends a chain. Its function doesn't return anything, and it
+ * can be given a second function to call if a stage failed.
+ *
+ * If a stage throws, later stages are skipped and the exception is logged.
+ * Each future can have only one continuation, which receives the value by
+ * rvalue reference. T can't be void.
+ */
+template <typename T>
+class Future final {
+    ThreadPool *mPool;
+    std::shared_ptr<future_detail::State<T>> mState;
+
+    template <typename F>
+    auto thenOn(std::optional<TaskClass> taskClass, F &&fn) {
+        using U = std::invoke_result_t<F,T&&>;
+        static_assert(!std::is_void_v<U>, "continuation must return a value");
+
+        auto next = std::make_shared<future_detail::State<U>>();
+        mState->onDone([pool = mPool, taskClass, rawState = mState.get(), next,
+                fn = std::forward<F>(fn)]() mutable {
+
+            if (rawState->error) {
+                // Pass the error down the chain, to be logged at the end.
+                rawState->errorHandled = true;
+                next->setError(rawState->error);
+            } else {
+                future_detail::post(*pool, taskClass, [state = rawState->shared_from_this(), next,
+                        fn = std::move(fn)]() mutable {
+
+                    future_detail::runInto(*next, fn, std::move(*state->value));
+                });
+            }
+        });
+
+        return Future<U>(*mPool, next);
+    }
+
+    template <typename U>
+    friend Future<std::vector<U>> whenAll(ThreadPool &pool, std::vector<Future<U>> futures);
+
+public:
+    Future(ThreadPool &pool, std::shared_ptr<future_detail::State<T>> state)
+        : mPool(&pool), mState(std::move(state)) {}
+
+    /**
+     * Run fn(T&&) on a worker thread of the given class once this future
+     * has its value. Returns a future for fn's result.
+     */
+    template <typename F>
+    auto then(TaskClass taskClass, F &&fn) {
+        return thenOn(taskClass, std::forward<F>(fn));
+    }
+
+    /**
+     * Run fn(T&&) on the render thread once this future has its value.
+     * Returns a future for fn's result.
+     */
+    template <typename F>
+    auto thenOnMainThread(F &&fn) {
+        return thenOn(std::nullopt, std::forward<F>(fn));
+    }
+
+    /**
+     * Run fn(T&&) on the render thread once this future has its value, or
+     * onError(std::exception_ptr) there if this or an earlier stage threw.
+     * Ends the chain. An exception thrown by fn is logged.
+     */
+    template <typename F, typename E>
+    void onMainThread(F &&fn, E &&onError) {
+        mState->onDone([pool = mPool, rawState = mState.get(),
+                fn = std::forward<F>(fn), onError = std::forward<E>(onError)]() mutable {
+
+            future_detail::post(*pool, std::nullopt, [state = rawState->shared_from_this(),
+                    fn = std::move(fn), onError = std::move(onError)]() mutable {
+
+                if (state->error) {
+                    // Still logged when the state goes away.
+                    onError(state->error);
+                    return;
+                }
+                try {
+                    fn(std::move(*state->value));
+                } catch (...) {
+                    future_detail::logError(std::current_exception());
+                }
+            });
+        });
+    }
+
+    /**
+     * Run fn(T&&) on the render thread once this future has its value.
+     * Ends the chain.
+     */
+    template <typename F>
+    void onMainThread(F &&fn) {
+        onMainThread(std::forward<F>(fn), [](std::exception_ptr) {});
+    }
+};
+
+/**
+ * Run fn() on a worker thread of the given class and return a future for
+ * its result.
+ */
+template <typename F>
+auto runAsync(ThreadPool &pool, TaskClass taskClass, F &&fn) {
+    using T = std::invoke_result_t<F>;
+    static_assert(!std::is_void_v<T>, "task must return a value");
+
+    auto state = std::make_shared<future_detail::State<T>>();
+    pool.submit(taskClass, [state, fn = std::forward<F>(fn)]() mutable {
+        future_detail::runInto(*state, fn);
+    });
+
+    return Future<T>(pool, state);
+}
+
+/**
+ * Future for all the values of the futures, in order. If any of them fails,
+ * the result fails with the first error.
+ */
+template <typename T>
+Future<std::vector<T>> whenAll(ThreadPool &pool, std::vector<Future<T>> futures) {
+    // Collects the values as they come in.
+    struct Gather final {
+        std::mutex mutex;
+        std::vector<std::optional<T>> values;
+        std::exception_ptr error;
+        size_t remaining;
+    };
+
+    auto result = std::make_shared<future_detail::State<std::vector<T>>>();
+    if (futures.empty()) {
+        result->setValue(std::vector<T>());
+        return Future<std::vector<T>>(pool, result);
+    }
+
+    auto gather = std::make_shared<Gather>();
+    gather->values.resize(futures.size());
+    gather->remaining = futures.size();
+
+    for (size_t i = 0; i < futures.size(); i++) {
+        // Collecting is cheap, so do it on whichever thread finishes.
+        auto *rawState = futures[i].mState.get();
+        rawState->onDone([i, rawState, gather, result]() {
+            bool last;
+            {
+                std::lock_guard lock(gather->mutex);
+                if (rawState->error) {
+                    rawState->errorHandled = true;
+                    if (!gather->error) {
+                        gather->error = rawState->error;
+                    }
+                } else {
+                    gather->values[i] = std::move(rawState->value);
+                }
+                gather->remaining -= 1;
+                last = gather->remaining == 0;
+            }
+
+            if (last) {
+                if (gather->error) {
+                    result->setError(gather->error);
+                } else {
+                    std::vector<T> values;
+                    values.reserve(gather->values.size());
+                    for (auto &value : gather->values) {
+                        values.push_back(std::move(*value));
+                    }
+                    result->setValue(std::move(values));
+                }
+            }
+        });
+    }
+
+    return Future<std::vector<T>>(pool, result);
+}
@@ -0,0 +1,31 @@
+
+#include "gallery.h"
+#include "trace.h"
+
+Photo const *Gallery::Snapshot::findById(int32_t id) const {
+    auto itr = indexById.find(id);
+    return itr == indexById.end() ? nullptr : &photos[itr->second];
+}
+
+Gallery::Gallery() : mSnapshot(std::make_shared<Snapshot>()) {}
+
+void Gallery::setPhotos(std::vector<Photo> const &photos) {
+    TraceSpan span("Gallery::setPhotos");
+
+    // Build the new snapshot outside the lock so readers aren't held up.
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->photos = photos;
+    snapshot->indexById.reserve(photos.size());
+    for (size_t i = 0; i < photos.size(); i++) {
+        snapshot->indexById[photos[i].id] = i;
+    }
+
+    std::lock_guard lock(mMutex);
+    snapshot->version = mSnapshot->version + 1;
+    mSnapshot = std::move(snapshot);
+}
+
+std::shared_ptr<Gallery::Snapshot const> Gallery::snapshot() const {
+    std::lock_guard lock(mMutex);
+    return mSnapshot;
+}
@@ -0,0 +1,58 @@
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "model.h"
+
+/**
+ * Copy of the slideshow's photo list that the web server can read from its
+ * own threads. The render thread publishes a new copy whenever the list
+ * changes; readers get an immutable snapshot they can keep as long as they
+ * like.
+ */
+class Gallery final {
+public:
+    /**
+     * The photo list at one point in time.
+     */
+    struct Snapshot final {
+        // Goes up by one each time the list is published. Usable as an ETag.
+        uint64_t version = 0;
+        // In slideshow order.
+        std::vector<Photo> photos;
+        // From photo ID to index in photos.
+        std::unordered_map<int32_t,size_t> indexById;
+
+        /**
+         * The photo with this ID, or null if it's not in the list.
+         */
+        Photo const *findById(int32_t id) const;
+    };
+
+private:
+    mutable std::mutex mMutex;
+    std::shared_ptr<Snapshot const> mSnapshot;
+
+public:
+    Gallery();
+
+    // Can't copy.
+    Gallery(const Gallery &) = delete;
+    Gallery &operator=(const Gallery &) = delete;
+
+    /**
+     * Replace the photo list. Called from the render thread.
+     */
+    void setPhotos(std::vector<Photo> const &photos);
+
+    /**
+     * The most recently published photo list. Can be called from any thread.
+     */
+    std::shared_ptr<Snapshot const> snapshot() const;
+};
@@ -6,99 +6,100 @@
 
 #include "imageloader.h"
 #include "constants.h"
+#include "trace.h"
+#include "metrics.h"
 
-namespace {
-    /**
-     * If the image is bigger than maxSize in width or height, it is
-     * resized to fit, keeping its aspect ratio.
-     */
-    void resizeImageToFit(Image *image, int maxSize) {
-        int width = image->width;
-        int height = image->height;
-
-        if (width >= height && width > maxSize) {
-            int newHeight = (height*maxSize + width/2)/width;
-            ImageResize(image, maxSize, newHeight);
-        } else if (height >= width && height > maxSize) {
-            int newWidth = (width*maxSize + height/2)/height;
-            ImageResize(image, newWidth, maxSize);
-        }
-    }
+ImageLoader::ImageLoader(ThreadPool &threadPool)
+    : mThreadPool(threadPool),
+    mResponseQueue(std::make_shared<MpscQueue<Response>>()) {}
 
-    /**
-     * Replace the "size" pixels at the border of the image
-     * with transparent pixels.
-     */
-    void drawTransparentBorder(Image *image, int size) {
-        int width = image->width;
-        int height = image->height;
-
-        // Top.
-        for (int y = 0; y < size; y++) {
-            for (int x = 0; x < width; x++) {
-                ImageDrawPixel(image, x, y, BLANK);
-            }
-        }
+ImageLoader::~ImageLoader() {
+    // Loads that finish from now on have nobody to drain them. Don't let
+    // them wait for room in a full queue and hold up the pool's shutdown.
+    mResponseQueue->close();
+}
 
-        // Bottom.
-        for (int y = height - size; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                ImageDrawPixel(image, x, y, BLANK);
-            }
+bool ImageLoader::requestImage(Photo const &photo, TaskClass taskClass) {
+    auto itr = mPending.find(photo.id);
+    if (itr != mPending.end()) {
+        // Classes are listed from highest priority, so lower is more urgent.
+        // If it's already loading, another task wouldn't get it here sooner.
+        Pending &pending = itr->second;
+        if (taskClass < pending.taskClass && !pending.started->test()) {
+            pending.taskClass = taskClass;
+            submit(photo, taskClass, pending.started);
+            metrics().imageLoadsPromoted.add();
         }
+        return true;
+    }
+    if (mPending.size() >= MAX_IMAGE_LOADS_IN_FLIGHT) {
+        return false;
+    }
 
-        for (int y = 0; y < height; y++) {
-            // Left.
-            for (int x = 0; x < size; x++) {
-                ImageDrawPixel(image, x, y, BLANK);
-            }
+    auto started = std::make_shared<std::atomic_flag>();
+    mPending.emplace(photo.id, Pending { taskClass, started });
+    metrics().imageLoadsInFlight.set(mPending.size());
+    submit(photo, taskClass, std::move(started));
 
-            // Right.
-            for (int x = width - size; x < width; x++) {
-                ImageDrawPixel(image, x, y, BLANK);
-            }
-        }
-    }
+    return true;
 }
 
-ImageLoader::ImageLoader()
-    : mExecutor(1, []<typename T0>(T0 && PH1) { return loadPhotoInThread(std::forward<T0>(PH1)); }) {}
+void ImageLoader::submit(Photo const &photo, TaskClass taskClass,
+        std::shared_ptr<std::atomic_flag> started) {
 
-void ImageLoader::requestImage(Photo const &photo) {
-    if (!mAlreadyRequestedIds.contains(photo.id)) {
-        mAlreadyRequestedIds.emplace(photo.id);
-        mExecutor.ask(Request { photo });
-    }
+    mThreadPool.submit(taskClass, [request = Request { photo }, started = std::move(started),
+            responseQueue = mResponseQueue]() {
+
+        // Another task for this photo got here first.
+        if (started->test_and_set()) {
+            return;
+        }
+        TraceSpan span("ImageLoader");
+        responseQueue->emplace(loadPhotoInThread(request));
+    });
 }
 
 std::vector<LoadedImage> ImageLoader::getLoadedImages() {
     std::vector<LoadedImage> loadedImages;
 
-    while (true) {
-        std::optional<Response> response = mExecutor.get();
-        if (!response.has_value()) {
-            break;
-        }
-
+    mResponses.clear();
+    mResponseQueue->drain(mResponses);
+    for (auto &response : mResponses) {
+        mPending.erase(response.photo.id);
         loadedImages.emplace_back(LoadedImage {
-            .photo = response->photo,
-            .image = response->image,
-            .loadTime = response->loadTime,
+            .photo = std::move(response.photo),
+            .image = std::move(response.image),
+            .loadTime = response.loadTime,
         });
-        mAlreadyRequestedIds.erase(response->photo.id);
     }
+    mResponses.clear();
+    metrics().imageLoadsInFlight.set(mPending.size());
 
     return loadedImages;
 }
 
+LoadedImage ImageLoader::loadImage(Photo const &photo) {
+    Response response = loadPhotoInThread(Request { photo });
+    return LoadedImage {
+        .photo = std::move(response.photo),
+        .image = std::move(response.image),
+        .loadTime = response.loadTime,
+    };
+}
+
 ImageLoader::Response ImageLoader::loadPhotoInThread(Request const &request) {
+    TraceSpan loadSpan("LoadImage");
     auto beginTime = std::chrono::high_resolution_clock::now();
     Image image = LoadImage(request.photo.absolutePathname.c_str());
     auto endTime = std::chrono::high_resolution_clock::now();
+    loadSpan.end();
+    metrics().decodeTime.observe(std::chrono::duration<double>(endTime - beginTime).count());
 
 
     std::shared_ptr<Image> imagePtr;
     if (IsImageValid(image)) {
+        TraceSpan prepSpan("prepareImage");
+
         // Save memory and make sure we don't exceed GPU texture size limits.
         resizeImageToFit(&image, MAX_TEXTURE_SIZE);
 
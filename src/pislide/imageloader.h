@@ -4,12 +4,14 @@
 #include <cstdint>
 #include <vector>
 #include <memory>
-#include <set>
+#include <map>
+#include <atomic>
 
 #include "raylib.h"
 
 #include "model.h"
-#include "executor.h"
+#include "ringbuffer.h"
+#include "threadpool.h"
 #include "util.h"
 
 /**
@@ -23,43 +25,79 @@ struct LoadedImage final {
 };
 
 /**
- * Asynchronously loads photos, creating Image objects.
+ * Asynchronously loads photos on the thread pool, creating Image objects.
+ * Several photos can be loading at once.
  */
 class ImageLoader final {
-    // Request sent to the executor's thread.
+    // Request sent to the worker thread.
     struct Request {
         Photo photo;
     };
 
-    // Response from the executor's thread.
+    // Response from the worker thread.
     struct Response {
         Photo photo;
         std::shared_ptr<Image> image;
         Timing loadTime;
     };
 
-    // Set of photo IDs that are either in the request queue or
-    // currently being loaded.
-    std::set<int32_t> mAlreadyRequestedIds;
+    // A photo that's either in the request queue or currently being loaded.
+    struct Pending {
+        // Class of the most urgent request for it.
+        TaskClass taskClass;
+        // Set by the first of its tasks to run. If the photo was requested
+        // again at a higher class, the other task then does nothing.
+        std::shared_ptr<std::atomic_flag> started;
+    };
+
+    // Photos requested and not yet returned, by ID.
+    std::map<int32_t,Pending> mPending;
+
+    // Pool to load the photos on.
+    ThreadPool &mThreadPool;
+
+    // Loaded photos. Shared with the tasks so that a load that finishes
+    // after we're destroyed has somewhere to go.
+    std::shared_ptr<MpscQueue<Response>> mResponseQueue;
+
+    // Reused buffer for draining the response queue.
+    std::vector<Response> mResponses;
 
-    // Executor to load the photos in another thread.
-    Executor<Request,Response> mExecutor;
+    // Queue a task to load the photo.
+    void submit(Photo const &photo, TaskClass taskClass,
+            std::shared_ptr<std::atomic_flag> started);
 
-    // Load the photo. Runs in a different thread.
+    // Load the photo. Runs on a worker thread.
     static Response loadPhotoInThread(Request const &request);
 
 public:
-    ImageLoader();
+    ImageLoader(ThreadPool &threadPool);
+    ~ImageLoader();
+
+    // Can't copy.
+    ImageLoader(const ImageLoader &) = delete;
+    ImageLoader &operator=(const ImageLoader &) = delete;
 
     /**
      * Request an asynchronous load of the photo. It's safe to call this
      * multiple times with the same photo before or while the photo is loading.
+     * The task class should be INTERACTIVE_DECODE if the photo is needed on
+     * screen now, or PREFETCH if it'll be needed soon. A photo that's already
+     * been requested at a lower class and hasn't started loading is requested
+     * again at the new class. Returns false if too many loads are in flight,
+     * in which case the caller should ask again later.
      */
-    void requestImage(Photo const &photo);
+    bool requestImage(Photo const &photo, TaskClass taskClass);
 
     /**
      * Fetch the images that have been loaded. The shared pointer is
      * empty if the image failed to load.
      */
     std::vector<LoadedImage> getLoadedImages();
+
+    /**
+     * Load and prepare the photo synchronously, for callers that are already
+     * on a worker thread.
+     */
+    static LoadedImage loadImage(Photo const &photo);
 };
@@ -0,0 +1,171 @@
+
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+
+#include <TinyEXIF.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/std.h>
+
+#include "ingest.h"
+#include "label.h"
+#include "trace.h"
+
+namespace {
+    /**
+     * Get the modified time of a file. The first in the pair is a string like "January 4, 2009".
+     * The second is the number of seconds since the epoch.
+     */
+    std::pair<std::string,int64_t> getFileDate(std::filesystem::path const &pathname) {
+        // Unreal.
+        std::filesystem::file_time_type time1 = std::filesystem::last_write_time(pathname);
+        auto time2 = time1 - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now();
+        auto time3 = std::chrono::time_point_cast<std::chrono::system_clock::duration>(time2);
+        std::time_t time4 = std::chrono::system_clock::to_time_t(time3);
+        std::tm time5 = *std::localtime(&time4);
+
+        std::ostringstream oss;
+        oss << std::put_time(&time5, "%B %d, %Y");
+        auto time6 = oss.str();
+
+        // Remove leading 0 from day:
+        auto space = time6.find(' ');
+        if (space != std::string::npos && time6[space + 1] == '0') {
+            time6.erase(space + 1, 1);
+        }
+
+        // Now for the epoch time.
+        auto time7 = std::chrono::file_clock::to_sys(time1);
+        auto time8 = time7.time_since_epoch();
+        auto time9 = std::chrono::duration_cast<std::chrono::seconds>(time8).count();
+
+        return std::make_pair(time6, time9);
+    }
+
+    /**
+     * Return the file's rotation in degrees, or 0 if it cannot be determined.
+     * The rotation specifies how much to rotate the loaded image counter-clockwise
+     * in order to display it.
+     */
+    int getFileRotation(std::filesystem::path const &pathname) {
+        int rotation;
+
+        // Open a stream to read just the necessary parts of the image file.
+	std::ifstream istream(pathname, std::ifstream::binary);
+
+	// Parse image EXIF.
+	TinyEXIF::EXIFInfo exif(istream);
+        switch (exif.Fields ? exif.Orientation : 0) {
+                                            // start of data is:
+            case 0: rotation = 0; break;    //   unspecified in EXIF data
+            case 1: rotation = 0; break;    //   upper left of image
+            case 3: rotation = 180; break;  //   lower right of image
+            case 6: rotation = -90; break;  //   upper right of image
+            case 8: rotation = 90; break;   //   lower left of image
+            case 9: rotation = 0; break;    //   undefined
+            default: rotation = 0; break;
+        }
+
+        return rotation;
+    }
+}
+
+int32_t handleNewAndRenamedFile(Database const &database,
+        Config const &config,
+        std::filesystem::path const &pathname,
+        FileHashes const &hashes) {
+
+    TraceSpan span("handleNewAndRenamedFile");
+
+    std::string label = pathnameToLabel(config, pathname);
+    std::filesystem::path absolutePathname = config.rootDir / pathname;
+    std::string const &hashAll = hashes.hashAll;
+    std::string const &hashBack = hashes.hashBack;
+
+    // Create a new photo file.
+    PhotoFile photoFile { pathname, hashAll, hashBack };
+    database.savePhotoFile(photoFile);
+
+    // Now see if this was a renaming of another file.
+    std::optional<Photo> photo = database.getPhotoByHashBack(hashBack);
+    int32_t photoId;
+    if (photo) {
+        // Renamed or moved photo.
+        spdlog::info("        Renamed or moved photo");
+        // Leave the timestamp the same, but update the label. Only write the
+        // label, since the user may have changed the rating or rotation since
+        // we read the photo.
+        database.savePhotoLabel(photo->id, label);
+        photoId = photo->id;
+    } else {
+        // New photo.
+        spdlog::info("        New photo");
+        int rotation = getFileRotation(absolutePathname);
+        std::pair<std::string,int64_t> fileDate = getFileDate(absolutePathname);
+        spdlog::info("            Rotation {}", rotation);
+        spdlog::info("            Date {}", fileDate.first);
+        Photo newPhoto {
+            .hashBack = hashBack,
+            .rotation = rotation,
+            .rating = 3,
+            .date = fileDate.second,
+            .displayDate = fileDate.first,
+            .label = label,
+        };
+
+        photoId = database.insertPhoto(newPhoto);
+    }
+    spdlog::info("            ID = {}", photoId);
+
+    return photoId;
+}
+
+int32_t handleNewAndRenamedFile(Database const &database,
+        Config const &config,
+        std::filesystem::path const &pathname) {
+
+    spdlog::info("    Computing hash for {}", pathname);
+
+    // We want the hashes of the original files, not the processed ones.
+    TraceSpan hashSpan("sha1");
+    FileHashes hashes = computeFileHashes(config.rootDir / pathname);
+    hashSpan.end();
+
+    return handleNewAndRenamedFile(database, config, pathname, hashes);
+}
+
+Future<std::optional<LoadedImage>> ingestPhoto(ThreadPool &threadPool,
+        Database const &database,
+        Config const &config,
+        std::filesystem::path const &pathname,
+        std::optional<FileHashes> const &hashes) {
+
+    // Maintenance tasks run one at a time, so the database steps of
+    // two uploads don't interleave.
+    return runAsync(threadPool, TaskClass::MAINTENANCE, [&database, &config, pathname, hashes]() {
+        TraceSpan span("ingestPhoto");
+
+        int32_t photoId = hashes.has_value()
+            ? handleNewAndRenamedFile(database, config, pathname, *hashes)
+            : handleNewAndRenamedFile(database, config, pathname);
+
+        // Fetch back from database and fix up pathnames.
+        std::optional<Photo> photo = database.getPhotoById(photoId);
+        if (photo) {
+            photo->pathname = pathname;
+            photo->absolutePathname = config.rootDir / pathname;
+        } else {
+            spdlog::error("Didn't find expected photo {}", photoId);
+        }
+        return photo;
+    }).then(TaskClass::INTERACTIVE_DECODE, [](std::optional<Photo> &&photo) {
+        // It'll be shown next, so decode it now rather than waiting
+        // for the slideshow to ask for it.
+        std::optional<LoadedImage> loadedImage;
+        if (photo) {
+            loadedImage = ImageLoader::loadImage(*photo);
+        }
+        return loadedImage;
+    });
+}
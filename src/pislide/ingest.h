@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "config.h"
+#include "database.h"
+#include "future.h"
+#include "imageloader.h"
+#include "threadpool.h"
+#include "util.h"
+
+/**
+ * Create a new photo file for this pathname, and optionally a new photo,
+ * given the file's hashes. Returns the photo ID (new or old).
+ */
+int32_t handleNewAndRenamedFile(Database const &database,
+        Config const &config,
+        std::filesystem::path const &pathname,
+        FileHashes const &hashes);
+
+/**
+ * Create a new photo file for this pathname, and optionally a new photo.
+ * Returns the photo ID (new or old).
+ */
+int32_t handleNewAndRenamedFile(Database const &database,
+        Config const &config,
+        std::filesystem::path const &pathname);
+
+/**
+ * Add a new file (relative to the root dir) to the database and decode it,
+ * all on worker threads. Computes the hashes if they're not provided. The
+ * future's value is the decoded photo, ready to insert into the slideshow,
+ * or nullopt if it couldn't be added. The database and config must outlive
+ * the future.
+ */
+Future<std::optional<LoadedImage>> ingestPhoto(ThreadPool &threadPool,
+        Database const &database,
+        Config const &config,
+        std::filesystem::path const &pathname,
+        std::optional<FileHashes> const &hashes);
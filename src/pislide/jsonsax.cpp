@@ -0,0 +1,62 @@
+
+#include <algorithm>
+
+#include "jsonsax.h"
+
+void JsonSaxHandler::push() {
+    if (mDepth == mPath.size()) {
+        mPath.emplace_back();
+    } else {
+        mPath[mDepth].clear();
+    }
+    mDepth++;
+}
+
+bool JsonSaxHandler::isAt(std::initializer_list<std::string_view> path) const {
+    return path.size() == mDepth && std::equal(path.begin(), path.end(), mPath.begin());
+}
+
+bool JsonSaxHandler::parse(std::string_view text) {
+    mDepth = 0;
+    mError.clear();
+    return nlohmann::json::sax_parse(text, this);
+}
+
+bool JsonSaxHandler::string(string_t &value) {
+    onString(value);
+    return true;
+}
+
+bool JsonSaxHandler::start_object(std::size_t) {
+    push();
+    return true;
+}
+
+bool JsonSaxHandler::key(string_t &value) {
+    // Reuse the string's capacity from the previous key at this depth.
+    mPath[mDepth - 1].assign(value);
+    return true;
+}
+
+bool JsonSaxHandler::end_object() {
+    mDepth--;
+    onEndObject();
+    return true;
+}
+
+bool JsonSaxHandler::start_array(std::size_t) {
+    push();
+    return true;
+}
+
+bool JsonSaxHandler::end_array() {
+    mDepth--;
+    return true;
+}
+
+bool JsonSaxHandler::parse_error(std::size_t, std::string const &,
+        nlohmann::json::exception const &e) {
+
+    mError = e.what();
+    return false;
+}
@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * Base for SAX handlers that pull a few fields out of a JSON document
+ * without building a DOM for it. Keeps track of the path to the current
+ * value, as the key of each enclosing object member and "" for each
+ * enclosing array element, so that subclasses can pick out the strings
+ * they want by path. Skipped values and subtrees cost nothing beyond
+ * lexing, and a missing field is simply never seen.
+ */
+class JsonSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+    // Key of the current member of each enclosing container, or "" for
+    // arrays. Only the first mDepth entries are used; the rest are kept to
+    // reuse their capacity.
+    std::vector<std::string> mPath;
+    size_t mDepth = 0;
+    // Error message of the parse, if any.
+    std::string mError;
+
+    // Enter an object or array.
+    void push();
+
+protected:
+    /**
+     * Whether the current value (or the object being started or ended) is
+     * at this path, such as {"messages", "", "sid"} for the "sid" member
+     * of each element of the top-level "messages" array.
+     */
+    bool isAt(std::initializer_list<std::string_view> path) const;
+
+    /**
+     * Called for each string value. May move from the value.
+     */
+    virtual void onString(std::string &value) = 0;
+
+    /**
+     * Called when an object ends. The default does nothing.
+     */
+    virtual void onEndObject() {}
+
+public:
+    /**
+     * Parse the JSON text, calling the subclass's callbacks. Returns whether
+     * it parsed without error. Never throws on bad input.
+     */
+    bool parse(std::string_view text);
+
+    /**
+     * Description of the parse error, if parse() returned false.
+     */
+    std::string const &error() const {
+        return mError;
+    }
+
+    // SAX interface. Only the structure and strings matter to us.
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t) override { return true; }
+    bool number_unsigned(number_unsigned_t) override { return true; }
+    bool number_float(number_float_t, string_t const &) override { return true; }
+    bool binary(binary_t &) override { return true; }
+    bool string(string_t &value) override;
+    bool start_object(std::size_t) override;
+    bool key(string_t &value) override;
+    bool end_object() override;
+    bool start_array(std::size_t) override;
+    bool end_array() override;
+    bool parse_error(std::size_t position, std::string const &lastToken,
+            nlohmann::json::exception const &e) override;
+};
@@ -0,0 +1,159 @@
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <raylib.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+
+#include "logging.h"
+#include "constants.h"
+#include "ringbuffer.h"
+#include "trace.h"
+
+namespace {
+    /**
+     * One formatted raylib log message.
+     */
+    struct RaylibLogEntry final {
+        int level;
+        std::array<char,RAYLIB_LOG_LINE_SIZE> text;
+    };
+
+    // Filled by raylib's threads, drained by gRaylibLogThread.
+    MpscRingBuffer<RaylibLogEntry,RAYLIB_LOG_QUEUE_CAPACITY> gRaylibLogQueue;
+    std::atomic<uint64_t> gRaylibLogDropped = 0;
+
+    // Moves raylib messages to spdlog.
+    std::jthread gRaylibLogThread;
+
+    spdlog::level::level_enum raylibToSpdlogLevel(int logLevel) {
+        switch (logLevel) {
+            case LOG_TRACE:
+            case LOG_DEBUG: return spdlog::level::debug;
+            case LOG_INFO: return spdlog::level::info;
+            case LOG_WARNING: return spdlog::level::warn;
+            case LOG_ERROR: return spdlog::level::err;
+            case LOG_FATAL: return spdlog::level::critical;
+            default: return spdlog::level::info;
+        }
+    }
+
+    /**
+     * Pass queued raylib messages to spdlog.
+     */
+    void drainRaylibLog(std::vector<RaylibLogEntry> &entries) {
+        entries.clear();
+        gRaylibLogQueue.drain(entries);
+        for (auto const &entry : entries) {
+            spdlog::log(raylibToSpdlogLevel(entry.level), "raylib: {}", entry.text.data());
+        }
+    }
+
+    /**
+     * Top-level function of gRaylibLogThread.
+     */
+    void raylibLogLoop(std::stop_token stopToken) {
+        traceThreadName("RaylibLog");
+
+        std::vector<RaylibLogEntry> entries;
+        std::mutex mutex;
+        std::condition_variable_any condition;
+        while (!stopToken.stop_requested()) {
+            drainRaylibLog(entries);
+
+            // Sleep until the next drain, or until we're asked to stop.
+            std::unique_lock lock(mutex);
+            condition.wait_for(lock, stopToken,
+                    std::chrono::milliseconds(RAYLIB_LOG_DRAIN_INTERVAL_MS),
+                    []() { return false; });
+        }
+
+        // Whatever came in while we were stopping.
+        drainRaylibLog(entries);
+    }
+
+    /**
+     * Stop passing raylib messages to spdlog, passing on what's queued.
+     */
+    void stopRaylibLog() {
+        // Back to raylib's own printing.
+        SetTraceLogCallback(nullptr);
+        if (gRaylibLogThread.joinable()) {
+            gRaylibLogThread.request_stop();
+            gRaylibLogThread.join();
+        }
+    }
+
+    /**
+     * Called by raylib on whatever thread it's running on. Must not block,
+     * except on fatal errors.
+     */
+    void raylibLogCallback(int logLevel, char const *text, va_list args) {
+        RaylibLogEntry entry;
+        entry.level = logLevel;
+        vsnprintf(entry.text.data(), entry.text.size(), text, args);
+
+        if (logLevel == LOG_FATAL) {
+            // raylib doesn't exit on fatal errors when there's a callback, so
+            // do it here, after getting this and everything before it to disk.
+            stopRaylibLog();
+            spdlog::critical("raylib: {}", entry.text.data());
+            spdlog::shutdown();
+            exit(EXIT_FAILURE);
+        }
+
+        if (!gRaylibLogQueue.try_emplace(entry)) {
+            gRaylibLogDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> startLogging() {
+    // One thread is plenty, and keeps the messages in order.
+    spdlog::init_thread_pool(LOG_QUEUE_SIZE, 1);
+
+    auto consoleSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto fileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+            "logs/pislide", 1024*1024*10, 10);
+    auto ringBufferSink = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(DEBUG_LOG_COUNT);
+    auto logger = std::make_shared<spdlog::async_logger>(
+            "logger", spdlog::sinks_init_list({consoleSink, fileSink, ringBufferSink}),
+            spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest);
+
+    // Flushing is done on the logging thread, but don't do it for every
+    // message, the SD card is slow. Make sure problems get to disk soon.
+    logger->flush_on(spdlog::level::warn);
+    spdlog::flush_every(std::chrono::seconds(LOG_FLUSH_INTERVAL_S));
+
+    logger->set_level(spdlog::level::debug);
+    spdlog::set_default_logger(logger);
+
+    gRaylibLogThread = std::jthread(raylibLogLoop);
+    SetTraceLogCallback(raylibLogCallback);
+
+    return ringBufferSink;
+}
+
+void stopLogging() {
+    stopRaylibLog();
+
+    // Drains the queue and joins the threads.
+    spdlog::shutdown();
+}
+
+uint64_t logMessagesDropped() {
+    auto threadPool = spdlog::thread_pool();
+    uint64_t dropped = threadPool ? threadPool->overrun_counter() : 0;
+    return dropped + gRaylibLogDropped.load(std::memory_order_relaxed);
+}
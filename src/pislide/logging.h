@@ -0,0 +1,34 @@
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <spdlog/sinks/ringbuffer_sink.h>
+
+/**
+ * Make the default spdlog logger asynchronous: callers only format the
+ * message and put it on a bounded queue, and a background thread writes it
+ * to the console, the rotating log file, and a ring buffer for the debug
+ * overlay. If the queue is full the oldest message is dropped, so logging
+ * never blocks the render thread. The file is flushed periodically and on
+ * every warning or error.
+ *
+ * Also sends raylib's log messages to the same place. They're formatted
+ * into a lock-free buffer from inside raylib (often in the middle of a GL
+ * call on the render thread) and passed to spdlog by another thread.
+ *
+ * Returns the ring buffer sink.
+ */
+std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> startLogging();
+
+/**
+ * Write out the queued messages and stop the background thread. Nothing
+ * may log after this.
+ */
+void stopLogging();
+
+/**
+ * Number of messages dropped because a queue was full.
+ */
+uint64_t logMessagesDropped();
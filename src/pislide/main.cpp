@@ -11,13 +11,11 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <thread>
 
 #include <raylib.h>
-#include <TinyEXIF.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/std.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
-#include <spdlog/sinks/rotating_file_sink.h>
 
 #include "database.h"
 #include "slideshow.h"
@@ -29,198 +27,24 @@
 #include "twiliofetcher.h"
 #include "constants.h"
 #include "webserver.h"
+#include "profiler.h"
+#include "trace.h"
+#include "threadpool.h"
+#include "ingest.h"
+#include "gallery.h"
+#include "remotecontrol.h"
+#include "metrics.h"
+#include "logging.h"
+#include "scanner.h"
 
 #define SPECIAL_EVENT 0
 #define SPECIAL_EVENT_NAME "Event-Name"
 #define SPECIAL_EVENT_BAD_DIR "Bad-Dir-Name"
 
 namespace {
-    constexpr int MAX_FILE_WARNING_COUNT = 10;
-
-    /**
-     * Valid image file extensions. Must be lower case.
-     */
-    std::set<std::string> IMAGE_EXTENSIONS = {
-        ".jpeg",
-        ".jpg",
-    };
-
-    /**
-     * Insane that this is so complicated in C++.
-     */
-    std::string toLowerCase(std::string s) {
-        std::transform(s.begin(), s.end(), s.begin(),
-                [](unsigned char c) { return std::tolower(c); });
-        return s;
-    }
-
-    /**
-     * Whether the pathname refers to an image that we want to show.
-     */
-    bool isImagePathname(std::filesystem::path const &pathname) {
-        return IMAGE_EXTENSIONS.contains(toLowerCase(pathname.extension().string()));
-    }
-
-    /*
-     * Gets a set of all pathnames in the image directory. These are relative to the
-     * passed-in root dir.
-     */
-    std::set<std::filesystem::path> traverseDirectoryTree(Config const &config) {
-        auto rootDir = config.rootDir;
-        std::set<std::filesystem::path> pathnames;
-
-        if (rootDir.string().ends_with("/")) {
-            throw std::invalid_argument("rootDir must not end with a slash");
-        }
-
-        try {
-            for (auto itr = std::filesystem::recursive_directory_iterator(rootDir,
-                    std::filesystem::directory_options::follow_directory_symlink);
-                    itr != std::filesystem::recursive_directory_iterator(); ++itr) {
-
-                auto const &entry = *itr;
-                std::filesystem::path path = entry.path();
-                if (entry.is_regular_file()) {
-                    if (isImagePathname(path)) {
-                        // Strip rootDir.
-                        if (path.string().starts_with(rootDir.string())) {
-                            // Create a relative path by removing the rootDir prefix
-                            pathnames.insert(path.lexically_relative(rootDir));
-                        } else {
-                            throw std::invalid_argument(std::string("path does not start with rootDir: ") + path.string());
-                        }
-                    }
-                } else if (entry.is_directory()) {
-                    if (config.unwantedDirs.contains(path.filename())) {
-                        // Don't recurse.
-                        itr.disable_recursion_pending();
-                    }
-                } else {
-                    spdlog::error("Unknown directory entry type: {}", path);
-                    pathnames.clear();
-                    return pathnames;
-                }
-            }
-        } catch (std::filesystem::filesystem_error const &e) {
-            spdlog::error("Filesystem error: {}", e.what());
-        }
-
-        return pathnames;
-    }
-
-    /**
-     * Get the modified time of a file. The first in the pair is a string like "January 4, 2009".
-     * The second is the number of seconds since the epoch.
-     */
-    std::pair<std::string,int64_t> getFileDate(std::filesystem::path const &pathname) {
-        // Unreal.
-        std::filesystem::file_time_type time1 = std::filesystem::last_write_time(pathname);
-        auto time2 = time1 - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now();
-        auto time3 = std::chrono::time_point_cast<std::chrono::system_clock::duration>(time2);
-        std::time_t time4 = std::chrono::system_clock::to_time_t(time3);
-        std::tm time5 = *std::localtime(&time4);
-
-        std::ostringstream oss;
-        oss << std::put_time(&time5, "%B %d, %Y");
-        auto time6 = oss.str();
-
-        // Remove leading 0 from day:
-        auto space = time6.find(' ');
-        if (space != std::string::npos && time6[space + 1] == '0') {
-            time6.erase(space + 1, 1);
-        }
-
-        // Now for the epoch time.
-        auto time7 = std::chrono::file_clock::to_sys(time1);
-        auto time8 = time7.time_since_epoch();
-        auto time9 = std::chrono::duration_cast<std::chrono::seconds>(time8).count();
-
-        return std::make_pair(time6, time9);
-    }
-
-    /**
-     * Return the file's rotation in degrees, or 0 if it cannot be determined.
-     * The rotation specifies how much to rotate the loaded image counter-clockwise
-     * in order to display it.
-     */
-    int getFileRotation(std::filesystem::path const &pathname) {
-        int rotation;
-
-        // Open a stream to read just the necessary parts of the image file.
-	std::ifstream istream(pathname, std::ifstream::binary);
-
-	// Parse image EXIF.
-	TinyEXIF::EXIFInfo exif(istream);
-        switch (exif.Fields ? exif.Orientation : 0) {
-                                            // start of data is:
-            case 0: rotation = 0; break;    //   unspecified in EXIF data
-            case 1: rotation = 0; break;    //   upper left of image
-            case 3: rotation = 180; break;  //   lower right of image
-            case 6: rotation = -90; break;  //   upper right of image
-            case 8: rotation = 90; break;   //   lower left of image
-            case 9: rotation = 0; break;    //   undefined
-            default: rotation = 0; break;
-        }
-
-        return rotation;
-    }
-
-    /**
-     * Create a new photo file for this pathname, and optionally a new photo.
-     * Returns the photo ID (new or old).
-     */
-    int32_t handleNewAndRenamedFile(Database const &database,
-            Config const &config,
-            std::filesystem::path const &pathname) {
-
-        spdlog::info("    Computing hash for {}", pathname);
-        std::string label = pathnameToLabel(config, pathname);
-
-        // We want the hashes of the original files, not the processed ones.
-        std::filesystem::path absolutePathname = config.rootDir / pathname;
-
-        std::vector<std::byte> imageBytes = readFileBytes(absolutePathname);
-
-        std::string hashAll = sha1Hex(imageBytes.data(), imageBytes.size());
-        int start = std::max(0, (int) imageBytes.size() - 1024);
-        std::string hashBack = sha1Hex(imageBytes.data() + start, imageBytes.size() - start);
-
-        // Create a new photo file.
-        PhotoFile photoFile { pathname, hashAll, hashBack };
-        database.savePhotoFile(photoFile);
-
-        // Now see if this was a renaming of another file.
-        std::optional<Photo> photo = database.getPhotoByHashBack(hashBack);
-        int32_t photoId;
-        if (photo) {
-            // Renamed or moved photo.
-            spdlog::info("        Renamed or moved photo");
-            // Leave the timestamp the same, but update the label.
-            photo->label = label;
-            database.savePhoto(*photo);
-            photoId = photo->id;
-        } else {
-            // New photo.
-            spdlog::info("        New photo");
-            int rotation = getFileRotation(absolutePathname);
-            std::pair<std::string,int64_t> fileDate = getFileDate(absolutePathname);
-            spdlog::info("            Rotation {}", rotation);
-            spdlog::info("            Date {}", fileDate.first);
-            Photo newPhoto {
-                .hashBack = hashBack,
-                .rotation = rotation,
-                .rating = 3,
-                .date = fileDate.second,
-                .displayDate = fileDate.first,
-                .label = label,
-            };
-
-            photoId = database.insertPhoto(newPhoto);
-        }
-        spdlog::info("            ID = {}", photoId);
-
-        return photoId;
-    }
+    // Photos in ingestAndShow() that haven't been shown yet. Only used
+    // on the render thread.
+    int gIngestsInFlight = 0;
 
     /**
      * Look for new images or images that might have been moved or renamed in the tree.
@@ -243,84 +67,6 @@ namespace {
         }
     }
 
-    // Keep photos of at least this rating.
-    void filterPhotosByRating(std::vector<Photo> &dbPhotos, Config const &config) {
-        int minRating = config.minRating;
-
-        dbPhotos.erase(std::remove_if(dbPhotos.begin(), dbPhotos.end(),
-                    [minRating](Photo const &photo) {
-                        return photo.rating < minRating;
-                    }), dbPhotos.end());
-    }
-
-    /**
-     * Keep photos in date range.
-     */
-    void filterPhotosByDate(std::vector<Photo> &dbPhotos, Config const &config) {
-        time_t now = nowEpoch();
-        long maxDate = config.minDays == 0 ? 0 : now - config.minDays*24*60*60;
-        long minDate = config.maxDays == 0 ? 0 : now - config.maxDays*24*60*60;
-
-        dbPhotos.erase(std::remove_if(dbPhotos.begin(), dbPhotos.end(),
-                    [minDate, maxDate](Photo const &photo) {
-                        return (minDate != 0 && photo.date < minDate) ||
-                            (maxDate != 0 && photo.date > maxDate);
-                    }), dbPhotos.end());
-    }
-
-    /**
-     * Assign a pathname to each photo, returning a new copy of dbPhotos with
-     * invalid photos (those with no disk files) removed.
-     */
-    std::vector<Photo> assignPhotoPathnames(Database const &database,
-            Config const &config,
-            std::vector<Photo> const &dbPhotos,
-            std::set<std::filesystem::path> const &diskPathnames) {
-
-        // Get all photo files. We did this before but have since modified the database.
-        std::vector<PhotoFile> dbPhotoFiles = database.getAllPhotoFiles();
-
-        // Map from hash to list of photo files.
-        std::multimap<std::string, PhotoFile *> photoFileMap;
-        for (auto &photoFile : dbPhotoFiles) {
-            photoFileMap.insert({photoFile.hashBack, &photoFile});
-        }
-
-        int warningCount = 0;
-
-        // Handle each photo, making a new array of photos.
-        std::vector<Photo> goodPhotos;
-        for (auto &photo : dbPhotos) {
-            // Try every photo file.
-            bool found = false;
-            auto [begin, end] = photoFileMap.equal_range(photo.hashBack);
-            for (auto photoFile = begin; photoFile != end; ++photoFile) {
-                // See if it's on disk.
-                if (diskPathnames.contains(photoFile->second->pathname)) {
-                    Photo newPhoto = photo;
-                    newPhoto.pathname = photoFile->second->pathname;
-                    newPhoto.absolutePathname = config.rootDir / newPhoto.pathname;
-                    goodPhotos.push_back(newPhoto);
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                // Can't find any file on disk for this photo.
-                warningCount += 1;
-                if (warningCount <= MAX_FILE_WARNING_COUNT) {
-                    spdlog::info("No file on disk for {} ({})", photo.hashBack, photo.label);
-                }
-            }
-        }
-
-        if (warningCount != 0) {
-            spdlog::info("Files missing on disk: {}", warningCount);
-        }
-
-        return goodPhotos;
-    }
-
     std::vector<Photo> filterPhotosByPathnameSubstring(std::vector<Photo> const &dbPhotos) {
         std::vector<Photo> goodPhotos;
 
@@ -397,7 +143,31 @@ namespace {
         }
     }
 
+    /**
+     * Add the file to the database and decode it on the thread pool, then
+     * show it next.
+     */
+    void ingestAndShow(ThreadPool &threadPool,
+            Database const &database,
+            Config const &config,
+            Slideshow &slideshow,
+            std::filesystem::path const &pathname,
+            std::optional<FileHashes> const &hashes) {
+
+        gIngestsInFlight += 1;
+        ingestPhoto(threadPool, database, config, pathname, hashes)
+            .onMainThread([&slideshow](std::optional<LoadedImage> &&loadedImage) {
+                gIngestsInFlight -= 1;
+                if (loadedImage) {
+                    slideshow.insertPhoto(loadedImage->photo, *loadedImage);
+                }
+            }, [](std::exception_ptr) {
+                gIngestsInFlight -= 1;
+            });
+    }
+
     void fetchTwilioImages(TwilioFetcher &twilioFetcher,
+            ThreadPool &threadPool,
             Database const &database,
             Config const &config,
             Slideshow &slideshow) {
@@ -413,29 +183,32 @@ namespace {
         // turned off.
         std::vector<std::shared_ptr<TwilioImage>> images = twilioFetcher.get();
         for (auto image : images) {
-            // Compute hash, add to database. This takes a bit of time and
-            // causes a hiccup in the animation. We'd have to split the hash
-            // and the database work to avoid that.
-            int32_t photoId = handleNewAndRenamedFile(database, config, image->pathname);
-
-            // Fetch back from database and fix up pathnames.
-            std::optional<Photo> photo = database.getPhotoById(photoId);
-            if (photo) {
-                photo->pathname = image->pathname;
-                photo->absolutePathname = config.rootDir / photo->pathname;
-                slideshow.insertPhoto(*photo);
-            } else {
-                spdlog::error("Didn't find expected photo {}", photoId);
-            }
+            ingestAndShow(threadPool, database, config, slideshow, image->pathname, std::nullopt);
         }
     }
 
+    /**
+     * Log the occupancy and overflows of a queue.
+     */
+    void logQueueStats(char const *name, QueueStats const &stats) {
+        spdlog::info("{}: {}/{} queued, {} dropped, {} rejected",
+                name, stats.size, stats.capacity, stats.dropped, stats.rejected);
+    }
+
     void fetchWebUploadImages(ThreadSafeQueue<WebUpload> &queue,
+            ThreadPool &threadPool,
             Database const &database,
             Config const &config,
             Slideshow &slideshow) {
 
-        while (true) {
+        if (isTracing()) {
+            traceCounter("webUploadQueue", queue.stats().size);
+        }
+
+        // Leave uploads in the queue while we're busy with others, so that the
+        // decoded images are bounded and the queue's limit pushes back on
+        // the web server.
+        while (gIngestsInFlight < MAX_INGESTS_IN_FLIGHT) {
             // See if any images came in from the web thread. If so, process them
             // and show them next.
             auto upload = queue.try_dequeue();
@@ -443,6 +216,8 @@ namespace {
                 break;
             }
 
+            TraceSpan span("processWebUpload");
+
             // Determine extension.
             std::string extension = guessExtensionForContentType(upload->contentType);
 
@@ -453,32 +228,22 @@ namespace {
             std::filesystem::path pathname = config.webSubdir / filename;
             std::filesystem::path absolutePathname = config.rootDir / pathname;
 
-            // Create the directory if necessary.
-            bool createdDir = std::filesystem::create_directories(absoluteDir);
-            if (createdDir) {
-                spdlog::info("Created web upload directory {}", absoluteDir);
-            }
-
-            // Write the file to disk.
+            // The web server already wrote it to a temporary file in the same
+            // directory, so this is just a rename.
             spdlog::info("Saving web file to {}", pathname);
-            std::ofstream ofs(absolutePathname, std::ios::binary);
-            ofs << upload->content;
-            ofs.close();
-
-            // Compute hash, add to database. This takes a bit of time and
-            // causes a hiccup in the animation. We'd have to split the hash
-            // and the database work to avoid that.
-            int32_t photoId = handleNewAndRenamedFile(database, config, pathname);
-
-            // Fetch back from database and fix up pathnames.
-            std::optional<Photo> photo = database.getPhotoById(photoId);
-            if (photo) {
-                photo->pathname = pathname;
-                photo->absolutePathname = absolutePathname;
-                slideshow.insertPhoto(*photo);
-            } else {
-                spdlog::error("Didn't find expected photo {}", photoId);
+            std::error_code ec;
+            std::filesystem::rename(upload->tempFile.pathname(), absolutePathname, ec);
+            if (ec) {
+                // The temporary file is deleted with the upload.
+                spdlog::error("Can't rename {} to {} ({})",
+                        upload->tempFile.pathname(), absolutePathname, ec.message());
+                continue;
             }
+            upload->tempFile.release();
+
+            // Add to database. The web server computed the hashes while
+            // receiving the file.
+            ingestAndShow(threadPool, database, config, slideshow, pathname, upload->hashes);
         }
     }
 
@@ -491,18 +256,9 @@ namespace {
 
         // Raylib is very verbose at INFO level, just keep the warnings.
         SetTraceLogLevel(LOG_WARNING);
-        // TODO use SetTraceLogCallback() to redirect raylib logs to a log file.
-
-        // Configure logging.
-        auto consoleSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
-        auto fileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
-                "logs/pislide", 1024*1024*10, 10);
-        auto ringBufferSink = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(DEBUG_LOG_COUNT);
-        auto logger = std::make_shared<spdlog::logger>(
-                "logger", spdlog::sinks_init_list({consoleSink, fileSink, ringBufferSink}));
-        logger->flush_on(spdlog::level::trace);
-        logger->set_level(spdlog::level::debug);
-        spdlog::set_default_logger(logger);
+
+        // Configure logging, including raylib's.
+        auto ringBufferSink = startLogging();
 
         spdlog::info("--- PiSlide ---");
 
@@ -517,9 +273,27 @@ namespace {
             return 1;
         }
 
+        // Record trace events if requested. Written out in main().
+        if (!config.traceFile.empty()) {
+            startTracing(config.traceFile);
+            traceThreadName("main");
+        }
+
+        // Shared by everything that works in the background.
+        ThreadPool threadPool(std::max(static_cast<int>(std::thread::hardware_concurrency()),
+                    MIN_WORKER_THREADS));
+        spdlog::info("Worker threads: {}", threadPool.threadCount());
+
         // Start the web server for uploading photos.
         ThreadSafeQueue<WebUpload> webUploadQueue;
-        std::unique_ptr<WebServer> webServer = startWebServer(config, webUploadQueue);
+        webUploadQueue.setCapacity(std::max(config.webMaxQueuedUploads, 0),
+                config.webUploadQueuePolicy);
+        // Photos that web clients can browse. Filled in once we know them.
+        Gallery gallery;
+        // Commands from phones, and slide changes back to them.
+        RemoteControl remoteControl;
+        std::unique_ptr<WebServer> webServer = startWebServer(config, webUploadQueue,
+                threadPool, gallery, remoteControl);
 
         // TODO upgrade the schema.
 
@@ -590,10 +364,10 @@ namespace {
         }
 
         // Match Python version FPS.
-        SetTargetFPS(40);
+        SetTargetFPS(TARGET_FPS);
 
         // Fetch Twilio images in another thread.
-        TwilioFetcher twilioFetcher(config);
+        TwilioFetcher twilioFetcher(config, threadPool);
         // We've seen cases where messages appeared in the list a few
         // seconds before their photos were available. If we catch it in
         // that window, we'll delete the message before we have a chance
@@ -606,18 +380,90 @@ namespace {
         {
             // Nested scope to delete slideshow before we close the window.
             Slideshow slideshow(dbPhotos, screenWidth, screenHeight, config, database,
-                    ringBufferSink);
+                    threadPool, ringBufferSink);
+
+            double previousProfilerLog = nowArbitrary();
+            gallery.setPhotos(dbPhotos);
+            uint64_t galleryPhotosVersion = slideshow.photosVersion();
+            std::vector<RemoteCommand> remoteCommands;
+            std::optional<int32_t> publishedPhotoId;
 
             while (slideshow.loopRunning()) {
-                fetchTwilioImages(twilioFetcher, database, config, slideshow);
-                fetchWebUploadImages(webUploadQueue, database, config, slideshow);
-                slideshow.prefetch();
-                slideshow.move();
-                slideshow.draw(starTexture, qrCode);
-                slideshow.handleKeyboard();
+                TraceSpan frameSpan("frame");
+                HistogramTimer frameTimer(metrics().frameTime);
+
+                {
+                    // Results of background tasks (see future.h) are delivered here.
+                    ScopedTimer timer("mainThreadTasks");
+                    threadPool.runMainThreadTasks();
+                }
+                {
+                    ScopedTimer timer("fetchTwilioImages");
+                    fetchTwilioImages(twilioFetcher, threadPool, database, config, slideshow);
+                }
+                {
+                    ScopedTimer timer("fetchWebUploadImages");
+                    fetchWebUploadImages(webUploadQueue, threadPool, database, config, slideshow);
+                }
+                {
+                    // Before moving and drawing, so they show this frame.
+                    ScopedTimer timer("remoteCommands");
+                    remoteCommands.clear();
+                    remoteControl.drainCommands(remoteCommands);
+                    for (auto const &command : remoteCommands) {
+                        slideshow.handleRemoteCommand(command);
+                    }
+                }
+                {
+                    ScopedTimer timer("prefetch");
+                    slideshow.prefetch();
+                }
+                {
+                    ScopedTimer timer("move");
+                    slideshow.move();
+                }
+                if (Photo const &photo = slideshow.currentPhoto(); photo.id != publishedPhotoId) {
+                    remoteControl.publishSlide(photo.id, photo.label, photo.displayDate);
+                    publishedPhotoId = photo.id;
+                }
+                if (slideshow.needsRedraw()) {
+                    // Times its own "draw" and "present" phases.
+                    slideshow.draw(starTexture, qrCode);
+                    metrics().framesDrawn.add();
+                } else {
+                    slideshow.idle();
+                    metrics().framesSkipped.add();
+                }
+                metrics().framesPerSecond.set(GetFPS());
+                {
+                    ScopedTimer timer("handleKeyboard");
+                    slideshow.handleKeyboard();
+                }
+                if (slideshow.photosVersion() != galleryPhotosVersion) {
+                    // New photos were inserted. Rare enough that copying
+                    // the whole list is fine.
+                    ScopedTimer timer("publishGallery");
+                    gallery.setPhotos(dbPhotos);
+                    galleryPhotosVersion = slideshow.photosVersion();
+                }
+
+                // Periodically dump timings.
+                double now = nowArbitrary();
+                if (now - previousProfilerLog >= PROFILER_LOG_INTERVAL_S) {
+                    previousProfilerLog = now;
+                    profiler().log();
+                    threadPool.log();
+                    logQueueStats("Web upload queue", webUploadQueue.stats());
+                }
             }
         }
 
+        // Release any upload handlers blocked on a full queue, and event
+        // streams waiting for the next slide, so that the web server can
+        // shut down.
+        webUploadQueue.setCapacity(0, OverflowPolicy::BLOCK);
+        remoteControl.stop();
+
         CloseWindow();
 
         return 0;
@@ -625,10 +471,19 @@ namespace {
 }
 
 int main(int argc, char *argv[]) {
+    int status = -1;
+
     try {
-        return mainCanThrow(argc, argv);
+        status = mainCanThrow(argc, argv);
     } catch (const std::exception &e) {
         spdlog::error("Caught exception ({})", e.what());
     }
-    return -1;
+
+    // Write the trace file, if any, even if we threw.
+    stopTracing();
+
+    // Write out the last log messages.
+    stopLogging();
+
+    return status;
 }
@@ -0,0 +1,166 @@
+
+#include <spdlog/spdlog.h>
+
+#include "metrics.h"
+
+namespace {
+    // Frame times, around the 60 FPS (16.7 ms) budget.
+    std::vector<double> const FRAME_BOUNDS = {
+        0.001, 0.002, 0.004, 0.008, 0.0167, 0.033, 0.05, 0.1, 0.25, 1,
+    };
+
+    // Image decodes and network calls.
+    std::vector<double> const SLOW_BOUNDS = {
+        0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30,
+    };
+
+    // Database statements.
+    std::vector<double> const FAST_BOUNDS = {
+        0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5,
+    };
+
+    void formatCounter(std::string &out, char const *name, char const *help, Counter const &counter) {
+        formatMetricHeader(out, name, "counter", help);
+        formatMetricValue(out, name, "", static_cast<double>(counter.value()));
+    }
+
+    void formatGauge(std::string &out, char const *name, char const *help, Gauge const &gauge) {
+        formatMetricHeader(out, name, "gauge", help);
+        formatMetricValue(out, name, "", gauge.value());
+    }
+
+    void formatHistogram(std::string &out, char const *name, char const *help,
+            Histogram const &histogram) {
+
+        formatMetricHeader(out, name, "histogram", help);
+        histogram.format(out, name);
+    }
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : mBounds(std::move(bounds)), mBuckets(mBounds.size() + 1) {}
+
+void Histogram::observe(double seconds) {
+    // Few enough buckets that a linear search is fastest.
+    size_t bucket = 0;
+    while (bucket < mBounds.size() && seconds > mBounds[bucket]) {
+        bucket++;
+    }
+
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(seconds, std::memory_order_relaxed);
+}
+
+void Histogram::format(std::string &out, char const *name, std::string const &labels) const {
+    std::string bucketName = std::string(name) + "_bucket";
+    std::string bucketLabels = labels.empty() ? "" : labels + ",";
+    std::string sampleLabels = labels.empty() ? "" : "{" + labels + "}";
+
+    // Prometheus buckets are cumulative.
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < mBuckets.size(); i++) {
+        cumulative += mBuckets[i].load(std::memory_order_relaxed);
+        std::string le = i < mBounds.size() ? fmt::format("{}", mBounds[i]) : "+Inf";
+        formatMetricValue(out, bucketName.c_str(), "{" + bucketLabels + "le=\"" + le + "\"}",
+                static_cast<double>(cumulative));
+    }
+
+    formatMetricValue(out, (std::string(name) + "_sum").c_str(), sampleLabels,
+            mSum.load(std::memory_order_relaxed));
+    // The count is the +Inf bucket.
+    formatMetricValue(out, (std::string(name) + "_count").c_str(), sampleLabels,
+            static_cast<double>(cumulative));
+}
+
+char const *dbStatementName(DbStatement statement) {
+    switch (statement) {
+        case DbStatement::PRINT_PERSONS: return "printPersons";
+        case DbStatement::GET_ALL_PHOTOS: return "getAllPhotos";
+        case DbStatement::GET_PHOTO_BY_HASH_BACK: return "getPhotoByHashBack";
+        case DbStatement::GET_PHOTO_BY_ID: return "getPhotoById";
+        case DbStatement::GET_ALL_PHOTO_FILES: return "getAllPhotoFiles";
+        case DbStatement::SAVE_PHOTO: return "savePhoto";
+        case DbStatement::SAVE_PHOTO_LABEL: return "savePhotoLabel";
+        case DbStatement::INSERT_PHOTO: return "insertPhoto";
+        case DbStatement::SAVE_PHOTO_FILE: return "savePhotoFile";
+        case DbStatement::COUNT: break;
+    }
+    return "unknown";
+}
+
+Metrics::Metrics() :
+    frameTime(FRAME_BOUNDS),
+    decodeTime(SLOW_BOUNDS),
+    twilioFetchTime(SLOW_BOUNDS),
+    busFetchTime(SLOW_BOUNDS) {
+
+    for (size_t i = 0; i < static_cast<size_t>(DbStatement::COUNT); i++) {
+        dbStatementTimes.emplace_back(FAST_BOUNDS);
+    }
+}
+
+std::string Metrics::format() const {
+    std::string out;
+
+    formatHistogram(out, "pislide_frame_seconds",
+            "Time to run one iteration of the render loop.", frameTime);
+    formatGauge(out, "pislide_frames_per_second",
+            "Frames per second as measured by raylib.", framesPerSecond);
+    formatCounter(out, "pislide_frames_drawn_total",
+            "Frames that were rendered.", framesDrawn);
+    formatCounter(out, "pislide_frames_skipped_total",
+            "Frames skipped because nothing on screen changed.", framesSkipped);
+
+    formatCounter(out, "pislide_slide_cache_hits_total",
+            "Slides that were already loaded when they came on screen.", slideCacheHits);
+    formatCounter(out, "pislide_slide_cache_misses_total",
+            "Slides that weren't loaded yet when they came on screen.", slideCacheMisses);
+    formatCounter(out, "pislide_slide_cache_evictions_total",
+            "Slides removed from the cache to make room.", slideCacheEvictions);
+    formatGauge(out, "pislide_image_loads_in_flight",
+            "Images requested from the loader and not yet received.", imageLoadsInFlight);
+    formatCounter(out, "pislide_image_loads_promoted_total",
+            "Queued image loads requested again at a higher priority.", imageLoadsPromoted);
+    formatHistogram(out, "pislide_image_decode_seconds",
+            "Time to decode an image file.", decodeTime);
+
+    formatMetricHeader(out, "pislide_db_statement_seconds", "histogram",
+            "Time to run a database operation, not including waiting for the connection.");
+    for (size_t i = 0; i < dbStatementTimes.size(); i++) {
+        dbStatementTimes[i].format(out, "pislide_db_statement_seconds",
+                fmt::format("statement=\"{}\"", dbStatementName(static_cast<DbStatement>(i))));
+    }
+
+    formatCounter(out, "pislide_uploads_total",
+            "Photos uploaded through the web server.", uploads);
+    formatCounter(out, "pislide_upload_bytes_total",
+            "Bytes of photos uploaded through the web server.", uploadBytes);
+    formatCounter(out, "pislide_uploads_failed_total",
+            "Uploads that failed while being received.", uploadsFailed);
+    formatCounter(out, "pislide_uploads_rejected_total",
+            "Uploads rejected because the upload queue was full.", uploadsRejected);
+
+    formatHistogram(out, "pislide_twilio_fetch_seconds",
+            "Time to fetch and download new Twilio messages.", twilioFetchTime);
+    formatCounter(out, "pislide_twilio_fetch_failures_total",
+            "Twilio fetches that failed.", twilioFetchFailures);
+    formatHistogram(out, "pislide_bus_fetch_seconds",
+            "Time to fetch bus arrival times from 511.org.", busFetchTime);
+    formatCounter(out, "pislide_bus_fetch_failures_total",
+            "Bus arrival fetches that failed.", busFetchFailures);
+
+    return out;
+}
+
+Metrics &metrics() {
+    static Metrics metrics;
+    return metrics;
+}
+
+void formatMetricHeader(std::string &out, char const *name, char const *type, char const *help) {
+    fmt::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+void formatMetricValue(std::string &out, char const *name, std::string const &labels, double value) {
+    fmt::format_to(std::back_inserter(out), "{}{} {}\n", name, labels, value);
+}
@@ -0,0 +1,183 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Metrics are updated from hot paths on any thread with relaxed atomics,
+ * never a lock, and read when the web server's /metrics endpoint is
+ * scraped. They're formatted in the Prometheus text format.
+ */
+
+/**
+ * Count of events that only goes up.
+ */
+class Counter final {
+    std::atomic<uint64_t> mValue = 0;
+
+public:
+    void add(uint64_t amount = 1) {
+        mValue.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        return mValue.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Value that can go up and down.
+ */
+class Gauge final {
+    std::atomic<double> mValue = 0;
+
+public:
+    void set(double value) {
+        mValue.store(value, std::memory_order_relaxed);
+    }
+
+    double value() const {
+        return mValue.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Distribution of durations, in seconds, counted into fixed buckets.
+ */
+class Histogram final {
+    // Upper bound of each bucket, ascending. There's an implicit +Inf bucket.
+    std::vector<double> mBounds;
+    // Non-cumulative count per bucket, including the +Inf one.
+    std::vector<std::atomic<uint64_t>> mBuckets;
+    std::atomic<double> mSum = 0;
+
+public:
+    explicit Histogram(std::vector<double> bounds);
+
+    // Can't copy.
+    Histogram(const Histogram &) = delete;
+    Histogram &operator=(const Histogram &) = delete;
+
+    /**
+     * Record a duration in seconds.
+     */
+    void observe(double seconds);
+
+    /**
+     * Append the histogram's buckets, sum, and count in the Prometheus
+     * text format. The labels are either empty or like statement="getAllPhotos",
+     * without braces, since they're combined with the bucket label.
+     */
+    void format(std::string &out, char const *name, std::string const &labels = "") const;
+};
+
+/**
+ * Records the time from construction to destruction into a histogram.
+ */
+class HistogramTimer final {
+    Histogram &mHistogram;
+    std::chrono::steady_clock::time_point mBeginTime;
+
+public:
+    explicit HistogramTimer(Histogram &histogram)
+        : mHistogram(histogram), mBeginTime(std::chrono::steady_clock::now()) {}
+    ~HistogramTimer() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - mBeginTime;
+        mHistogram.observe(elapsed.count());
+    }
+
+    // Can't copy, would record twice.
+    HistogramTimer(const HistogramTimer &) = delete;
+    HistogramTimer &operator=(const HistogramTimer &) = delete;
+};
+
+/**
+ * Database operations, each timed into its own histogram.
+ */
+enum class DbStatement {
+    PRINT_PERSONS,
+    GET_ALL_PHOTOS,
+    GET_PHOTO_BY_HASH_BACK,
+    GET_PHOTO_BY_ID,
+    GET_ALL_PHOTO_FILES,
+    SAVE_PHOTO,
+    SAVE_PHOTO_LABEL,
+    INSERT_PHOTO,
+    SAVE_PHOTO_FILE,
+    COUNT,
+};
+
+/**
+ * Name of the statement for its metric label, like "getAllPhotos".
+ */
+char const *dbStatementName(DbStatement statement);
+
+/**
+ * All the metrics of the program.
+ */
+struct Metrics final {
+    // Render loop.
+    Histogram frameTime;
+    Gauge framesPerSecond;
+    Counter framesDrawn;
+    Counter framesSkipped;
+
+    // Slide cache and image loader.
+    Counter slideCacheHits;
+    Counter slideCacheMisses;
+    Counter slideCacheEvictions;
+    Gauge imageLoadsInFlight;
+    Counter imageLoadsPromoted;
+    Histogram decodeTime;
+
+    // Database, indexed by DbStatement.
+    std::deque<Histogram> dbStatementTimes;
+
+    // Web uploads.
+    Counter uploads;
+    Counter uploadBytes;
+    Counter uploadsFailed;
+    Counter uploadsRejected;
+
+    // Web services.
+    Histogram twilioFetchTime;
+    Counter twilioFetchFailures;
+    Histogram busFetchTime;
+    Counter busFetchFailures;
+
+    Metrics();
+
+    // Can't copy.
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    Histogram &dbStatementTime(DbStatement statement) {
+        return dbStatementTimes[static_cast<size_t>(statement)];
+    }
+
+    /**
+     * All the metrics in the Prometheus text format.
+     */
+    std::string format() const;
+};
+
+/**
+ * The process-wide metrics.
+ */
+Metrics &metrics();
+
+/**
+ * Append a metric's HELP and TYPE lines in the Prometheus text format.
+ */
+void formatMetricHeader(std::string &out, char const *name, char const *type, char const *help);
+
+/**
+ * Append a sample line in the Prometheus text format. The labels are
+ * either empty or like {class="network"}.
+ */
+void formatMetricValue(std::string &out, char const *name, std::string const &labels, double value);
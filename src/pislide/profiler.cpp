@@ -0,0 +1,76 @@
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "profiler.h"
+#include "constants.h"
+
+namespace {
+    /**
+     * Value at fraction (0 to 1) of the sorted samples.
+     */
+    double percentile(std::vector<double> const &sorted, double fraction) {
+        size_t index = static_cast<size_t>(fraction*(sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+}
+
+void Profiler::record(std::string_view name, double seconds) {
+    std::lock_guard lock(mMutex);
+
+    auto itr = mPhases.find(name);
+    if (itr == mPhases.end()) {
+        itr = mPhases.emplace(std::string(name), Phase {}).first;
+        itr->second.samples.reserve(PROFILER_WINDOW_SIZE);
+    }
+
+    Phase &phase = itr->second;
+    if (phase.samples.size() < PROFILER_WINDOW_SIZE) {
+        phase.samples.push_back(seconds);
+    } else {
+        phase.samples[phase.next] = seconds;
+        phase.next = (phase.next + 1) % PROFILER_WINDOW_SIZE;
+    }
+}
+
+std::vector<PhaseSummary> Profiler::summarize() const {
+    std::vector<PhaseSummary> summaries;
+    std::vector<double> sorted;
+
+    std::lock_guard lock(mMutex);
+    for (auto const &[name, phase] : mPhases) {
+        if (phase.samples.empty()) {
+            continue;
+        }
+
+        sorted = phase.samples;
+        std::sort(sorted.begin(), sorted.end());
+
+        summaries.emplace_back(PhaseSummary {
+            .name = name,
+            .count = static_cast<int>(sorted.size()),
+            .p50 = percentile(sorted, 0.50),
+            .p95 = percentile(sorted, 0.95),
+            .p99 = percentile(sorted, 0.99),
+            .max = sorted.back(),
+        });
+    }
+
+    return summaries;
+}
+
+void Profiler::log() const {
+    spdlog::info("Profile (ms, last {} samples):", PROFILER_WINDOW_SIZE);
+    for (auto const &summary : summarize()) {
+        spdlog::info("    {}: p50 {:.2f}, p95 {:.2f}, p99 {:.2f}, max {:.2f} ({} samples)",
+                summary.name,
+                summary.p50*1000, summary.p95*1000, summary.p99*1000, summary.max*1000,
+                summary.count);
+    }
+}
+
+Profiler &profiler() {
+    static Profiler profiler;
+    return profiler;
+}
@@ -0,0 +1,108 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+#include "trace.h"
+
+/**
+ * Summary of the recent durations of a phase, in seconds.
+ */
+struct PhaseSummary final {
+    std::string name;
+    // Number of samples in the window.
+    int count;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+/**
+ * Keeps a rolling window of durations for named phases (parts of the frame
+ * loop, texture uploads, text drawing, ...) and summarizes them as percentiles.
+ */
+class Profiler final {
+    // Rolling window of samples of one phase.
+    struct Phase {
+        // Circular buffer, up to PROFILER_WINDOW_SIZE long.
+        std::vector<double> samples;
+        // Where the next sample goes once the buffer is full.
+        size_t next = 0;
+    };
+
+    // Phase name to its samples. Transparent comparator so that lookups
+    // don't allocate a string.
+    std::map<std::string,Phase,std::less<>> mPhases;
+
+    // Recording is from the render thread, but summaries might be requested
+    // from elsewhere.
+    mutable std::mutex mMutex;
+
+public:
+    Profiler() = default;
+
+    // Can't copy.
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    /**
+     * Add a sample (in seconds) to the named phase.
+     */
+    void record(std::string_view name, double seconds);
+
+    /**
+     * Summarize all phases, sorted by name.
+     */
+    std::vector<PhaseSummary> summarize() const;
+
+    /**
+     * Write the summary to the log.
+     */
+    void log() const;
+};
+
+/**
+ * The process-wide profiler.
+ */
+Profiler &profiler();
+
+/**
+ * Records the time from construction to destruction (or stop()) under
+ * the given phase name. Also records a trace span if tracing.
+ */
+class ScopedTimer final {
+    // Must be a string literal or otherwise outlive this object.
+    char const *mName;
+    std::chrono::steady_clock::time_point mBeginTime;
+    bool mStopped = false;
+    TraceSpan mSpan;
+
+public:
+    explicit ScopedTimer(char const *name)
+        : mName(name), mBeginTime(std::chrono::steady_clock::now()), mSpan(name) {}
+    ~ScopedTimer() {
+        stop();
+    }
+
+    // Can't copy, would record twice.
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    /**
+     * Record the elapsed time now instead of at destruction.
+     */
+    void stop() {
+        if (!mStopped) {
+            mStopped = true;
+            mSpan.end();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - mBeginTime;
+            profiler().record(mName, elapsed.count());
+        }
+    }
+};
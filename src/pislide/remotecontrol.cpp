@@ -0,0 +1,58 @@
+
+#include "remotecontrol.h"
+
+void RemoteControl::publishSlide(int32_t photoId, std::string const &label,
+        std::string const &displayDate) {
+
+    {
+        std::lock_guard lock(mMutex);
+        mSlide.sequence += 1;
+        mSlide.photoId = photoId;
+        mSlide.label = label;
+        mSlide.displayDate = displayDate;
+    }
+    mCondition.notify_all();
+}
+
+std::optional<SlideEvent> RemoteControl::waitForSlide(uint64_t afterSequence,
+        std::chrono::milliseconds timeout) {
+
+    std::unique_lock lock(mMutex);
+    bool ready = mCondition.wait_for(lock, timeout, [this, afterSequence]() {
+        return mStopped || mSlide.sequence > afterSequence;
+    });
+
+    return ready && !mStopped ? std::make_optional(mSlide) : std::nullopt;
+}
+
+bool RemoteControl::openStream() {
+    if (isStopped()) {
+        return false;
+    }
+
+    int count = mStreamCount.load();
+    while (count < MAX_EVENT_STREAMS) {
+        if (mStreamCount.compare_exchange_weak(count, count + 1)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RemoteControl::closeStream() {
+    mStreamCount--;
+}
+
+void RemoteControl::stop() {
+    {
+        std::lock_guard lock(mMutex);
+        mStopped = true;
+    }
+    mCondition.notify_all();
+}
+
+bool RemoteControl::isStopped() {
+    std::lock_guard lock(mMutex);
+    return mStopped;
+}
@@ -0,0 +1,118 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "ringbuffer.h"
+
+/**
+ * Something a remote (a phone, via the web server) asked the slideshow to do.
+ * These mirror the keyboard commands.
+ */
+struct RemoteCommand final {
+    enum class Type {
+        NEXT,
+        PREVIOUS,
+        TOGGLE_PAUSE,
+        TOGGLE_PARTY,
+        // Value is the rating, 1 to 5.
+        RATE,
+        // Value is the degrees counter-clockwise, 90 or -90.
+        ROTATE,
+    };
+
+    Type type;
+    int value = 0;
+};
+
+/**
+ * The slide being shown, as sent to remotes.
+ */
+struct SlideEvent final {
+    // Goes up by one with each slide shown. Zero means nothing shown yet.
+    uint64_t sequence = 0;
+    int32_t photoId = 0;
+    std::string label;
+    std::string displayDate;
+};
+
+/**
+ * Connects the web server's remote-control endpoints to the render thread.
+ * Commands go from web threads to the render thread through a lock-free
+ * queue that's drained once per frame. Slide changes go the other way, to
+ * web threads waiting to push them to their event streams.
+ */
+class RemoteControl final {
+    MpscRingBuffer<RemoteCommand,REMOTE_COMMAND_QUEUE_CAPACITY> mCommands;
+
+    // Protects the fields below. The render thread only takes it when the
+    // slide changes.
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    SlideEvent mSlide;
+    bool mStopped = false;
+
+    // Number of open event streams.
+    std::atomic<int> mStreamCount = 0;
+
+public:
+    RemoteControl() = default;
+
+    // Can't copy.
+    RemoteControl(const RemoteControl &) = delete;
+    RemoteControl &operator=(const RemoteControl &) = delete;
+
+    /**
+     * Queue a command for the render thread. Returns false if the queue is
+     * full. Can be called from any thread, never blocks.
+     */
+    bool sendCommand(RemoteCommand const &command) {
+        return mCommands.try_emplace(command);
+    }
+
+    /**
+     * Dequeue all waiting commands, appending them to "out". Only call from
+     * the render thread. Returns the number of commands added.
+     */
+    size_t drainCommands(std::vector<RemoteCommand> &out) {
+        return mCommands.drain(out);
+    }
+
+    /**
+     * Tell event streams that this photo is now showing. Call from the
+     * render thread.
+     */
+    void publishSlide(int32_t photoId, std::string const &label, std::string const &displayDate);
+
+    /**
+     * Wait for a slide newer than the given sequence number. Returns nullopt
+     * on timeout or if stop() is called. Called from web server threads.
+     */
+    std::optional<SlideEvent> waitForSlide(uint64_t afterSequence, std::chrono::milliseconds timeout);
+
+    /**
+     * Reserve a slot for an event stream. Each stream ties up a web server
+     * thread, so there are at most MAX_EVENT_STREAMS. Returns false if
+     * they're all taken or we're stopping. Call closeStream() when done.
+     */
+    bool openStream();
+    void closeStream();
+
+    /**
+     * Release all waiting event streams so that the web server can shut down.
+     */
+    void stop();
+
+    /**
+     * Whether stop() has been called.
+     */
+    bool isStopped();
+};
@@ -0,0 +1,290 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Keep producer and consumer indices on separate cache lines.
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * Back off while a full ring buffer is drained. The consumer might be the
+ * render thread, which only drains once per frame, so don't spin for long.
+ */
+inline void waitForRoom(int attempt) {
+    if (attempt < 16) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer
+ * thread. Neither side ever takes a lock, so polling an empty queue is just
+ * two atomic loads. CAPACITY must be a power of two.
+ */
+template <typename T, size_t CAPACITY>
+class SpscRingBuffer final {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    std::array<std::optional<T>,CAPACITY> mSlots;
+    // Next slot to read. Only written by the consumer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> mHead = 0;
+    // Next slot to write. Only written by the producer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> mTail = 0;
+    // Whether the consumer has stopped draining. See close().
+    std::atomic<bool> mClosed = false;
+
+public:
+    // Only one thread may enqueue.
+    static constexpr bool MULTIPLE_PRODUCERS = false;
+
+    SpscRingBuffer() = default;
+
+    // Can't copy.
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+    SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+    /**
+     * Constructs the data in place at the end of the queue. Returns false
+     * (and leaves the arguments untouched) if the queue is full.
+     */
+    template <typename... ARGS>
+    bool try_emplace(ARGS &&...args) {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        mSlots[tail & MASK].emplace(std::forward<ARGS>(args)...);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Like try_emplace(), but waits until there's room. Returns false if
+     * the queue is closed while full, in which case the data is dropped.
+     */
+    template <typename... ARGS>
+    bool emplace(ARGS &&...args) {
+        for (int attempt = 0; !try_emplace(std::forward<ARGS>(args)...); attempt++) {
+            if (mClosed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            waitForRoom(attempt);
+        }
+        return true;
+    }
+
+    /**
+     * Enqueues the data, waiting until there's room. Returns the same as
+     * emplace().
+     */
+    bool enqueue(T &&data) {
+        return emplace(std::move(data));
+    }
+
+    /**
+     * Stop waiting for room. From now on emplace() and enqueue() give up if
+     * the queue is full, so that a producer can't wait forever on a consumer
+     * that's gone. Items already queued can still be dequeued.
+     */
+    void close() {
+        mClosed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Non-blocking way to dequeue data.
+     */
+    std::optional<T> try_dequeue() {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return std::optional<T>();
+        }
+        std::optional<T> &slot = mSlots[head & MASK];
+        std::optional<T> data(std::move(*slot));
+        slot.reset();
+        mHead.store(head + 1, std::memory_order_release);
+        return data;
+    }
+
+    /**
+     * Dequeue everything available, appending to "out". Returns the number
+     * of items added.
+     */
+    size_t drain(std::vector<T> &out) {
+        size_t count = 0;
+        while (auto data = try_dequeue()) {
+            out.push_back(std::move(*data));
+            count += 1;
+        }
+        return count;
+    }
+
+    /**
+     * Whether the queue is empty. Only a snapshot if the other side is active.
+     */
+    bool empty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+};
+
+/**
+ * Bounded lock-free queue for any number of producer threads and exactly
+ * one consumer thread. Each slot carries a sequence number that says whose
+ * turn it is (after Dmitry Vyukov's bounded MPMC queue). CAPACITY must be a
+ * power of two.
+ */
+template <typename T, size_t CAPACITY>
+class MpscRingBuffer final {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    struct Slot {
+        // Equal to the position when the slot is free to write, and to
+        // position + 1 when it's ready to read.
+        std::atomic<size_t> sequence;
+        std::optional<T> data;
+    };
+
+    std::array<Slot,CAPACITY> mSlots;
+    // Next slot to read. Only written by the consumer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> mHead = 0;
+    // Next slot to claim. Shared by producers.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> mTail = 0;
+    // Whether the consumer has stopped draining. See close().
+    std::atomic<bool> mClosed = false;
+
+public:
+    // Any number of threads may enqueue.
+    static constexpr bool MULTIPLE_PRODUCERS = true;
+
+    MpscRingBuffer() {
+        for (size_t i = 0; i < CAPACITY; i++) {
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Can't copy.
+    MpscRingBuffer(const MpscRingBuffer &) = delete;
+    MpscRingBuffer &operator=(const MpscRingBuffer &) = delete;
+
+    /**
+     * Constructs the data in place at the end of the queue. Returns false
+     * (and leaves the arguments untouched) if the queue is full.
+     */
+    template <typename... ARGS>
+    bool try_emplace(ARGS &&...args) {
+        size_t position = mTail.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &mSlots[position & MASK];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                // Slot is free, try to claim it.
+                if (mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // Consumer hasn't freed this slot yet.
+                return false;
+            } else {
+                // Another producer claimed it, try again.
+                position = mTail.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->data.emplace(std::forward<ARGS>(args)...);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Like try_emplace(), but waits until there's room. Returns false if
+     * the queue is closed while full, in which case the data is dropped.
+     */
+    template <typename... ARGS>
+    bool emplace(ARGS &&...args) {
+        for (int attempt = 0; !try_emplace(std::forward<ARGS>(args)...); attempt++) {
+            if (mClosed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            waitForRoom(attempt);
+        }
+        return true;
+    }
+
+    /**
+     * Enqueues the data, waiting until there's room. Returns the same as
+     * emplace().
+     */
+    bool enqueue(T &&data) {
+        return emplace(std::move(data));
+    }
+
+    /**
+     * Stop waiting for room. From now on emplace() and enqueue() give up if
+     * the queue is full, so that a producer can't wait forever on a consumer
+     * that's gone. Items already queued can still be dequeued.
+     */
+    void close() {
+        mClosed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Non-blocking way to dequeue data. Only call from the consumer thread.
+     */
+    std::optional<T> try_dequeue() {
+        size_t position = mHead.load(std::memory_order_relaxed);
+        Slot &slot = mSlots[position & MASK];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+            return std::optional<T>();
+        }
+        std::optional<T> data(std::move(*slot.data));
+        slot.data.reset();
+        slot.sequence.store(position + CAPACITY, std::memory_order_release);
+        mHead.store(position + 1, std::memory_order_relaxed);
+        return data;
+    }
+
+    /**
+     * Dequeue everything available, appending to "out". Returns the number
+     * of items added. Only call from the consumer thread.
+     */
+    size_t drain(std::vector<T> &out) {
+        size_t count = 0;
+        while (auto data = try_dequeue()) {
+            out.push_back(std::move(*data));
+            count += 1;
+        }
+        return count;
+    }
+
+    /**
+     * Whether the queue is empty. Only a snapshot if producers are active.
+     */
+    bool empty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+};
+
+// Capacity of the executors' response queues. Producers wait if it fills up,
+// until the queue is closed.
+constexpr size_t RESPONSE_QUEUE_CAPACITY = 64;
+
+/**
+ * Single-template-parameter versions for use as Executor response queues.
+ */
+template <typename T>
+using SpscQueue = SpscRingBuffer<T,RESPONSE_QUEUE_CAPACITY>;
+template <typename T>
+using MpscQueue = MpscRingBuffer<T,RESPONSE_QUEUE_CAPACITY>;
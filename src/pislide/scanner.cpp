@@ -0,0 +1,153 @@
+
+#include <algorithm>
+#include <map>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/std.h>
+
+#include "scanner.h"
+#include "util.h"
+
+namespace {
+    constexpr int MAX_FILE_WARNING_COUNT = 10;
+
+    /**
+     * Valid image file extensions. Must be lower case.
+     */
+    std::set<std::string> IMAGE_EXTENSIONS = {
+        ".jpeg",
+        ".jpg",
+    };
+
+    /**
+     * Insane that this is so complicated in C++.
+     */
+    std::string toLowerCase(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(),
+                [](unsigned char c) { return std::tolower(c); });
+        return s;
+    }
+
+    /**
+     * Whether the pathname refers to an image that we want to show.
+     */
+    bool isImagePathname(std::filesystem::path const &pathname) {
+        return IMAGE_EXTENSIONS.contains(toLowerCase(pathname.extension().string()));
+    }
+}
+
+std::set<std::filesystem::path> traverseDirectoryTree(Config const &config) {
+    auto rootDir = config.rootDir;
+    std::set<std::filesystem::path> pathnames;
+
+    if (rootDir.string().ends_with("/")) {
+        throw std::invalid_argument("rootDir must not end with a slash");
+    }
+
+    try {
+        for (auto itr = std::filesystem::recursive_directory_iterator(rootDir,
+                std::filesystem::directory_options::follow_directory_symlink);
+                itr != std::filesystem::recursive_directory_iterator(); ++itr) {
+
+            auto const &entry = *itr;
+            std::filesystem::path path = entry.path();
+            if (entry.is_regular_file()) {
+                if (isImagePathname(path)) {
+                    // Strip rootDir.
+                    if (path.string().starts_with(rootDir.string())) {
+                        // Create a relative path by removing the rootDir prefix
+                        pathnames.insert(path.lexically_relative(rootDir));
+                    } else {
+                        throw std::invalid_argument(std::string("path does not start with rootDir: ") + path.string());
+                    }
+                }
+            } else if (entry.is_directory()) {
+                if (config.unwantedDirs.contains(path.filename())) {
+                    // Don't recurse.
+                    itr.disable_recursion_pending();
+                }
+            } else {
+                spdlog::error("Unknown directory entry type: {}", path);
+                pathnames.clear();
+                return pathnames;
+            }
+        }
+    } catch (std::filesystem::filesystem_error const &e) {
+        spdlog::error("Filesystem error: {}", e.what());
+    }
+
+    return pathnames;
+}
+
+void filterPhotosByRating(std::vector<Photo> &dbPhotos, Config const &config) {
+    int minRating = config.minRating;
+
+    dbPhotos.erase(std::remove_if(dbPhotos.begin(), dbPhotos.end(),
+                [minRating](Photo const &photo) {
+                    return photo.rating < minRating;
+                }), dbPhotos.end());
+}
+
+void filterPhotosByDate(std::vector<Photo> &dbPhotos, Config const &config) {
+    time_t now = nowEpoch();
+    long maxDate = config.minDays == 0 ? 0 : now - config.minDays*24*60*60;
+    long minDate = config.maxDays == 0 ? 0 : now - config.maxDays*24*60*60;
+
+    dbPhotos.erase(std::remove_if(dbPhotos.begin(), dbPhotos.end(),
+                [minDate, maxDate](Photo const &photo) {
+                    return (minDate != 0 && photo.date < minDate) ||
+                        (maxDate != 0 && photo.date > maxDate);
+                }), dbPhotos.end());
+}
+
+std::vector<Photo> assignPhotoPathnames(Database const &database,
+        Config const &config,
+        std::vector<Photo> const &dbPhotos,
+        std::set<std::filesystem::path> const &diskPathnames) {
+
+    // Get all photo files. We did this before but have since modified the database.
+    std::vector<PhotoFile> dbPhotoFiles = database.getAllPhotoFiles();
+
+    // Map from hash to list of photo files.
+    std::multimap<std::string, PhotoFile *> photoFileMap;
+    for (auto &photoFile : dbPhotoFiles) {
+        photoFileMap.insert({photoFile.hashBack, &photoFile});
+    }
+
+    int warningCount = 0;
+
+    // Handle each photo, making a new array of photos.
+    std::vector<Photo> goodPhotos;
+    for (auto &photo : dbPhotos) {
+        // Try every photo file.
+        bool found = false;
+        auto [begin, end] = photoFileMap.equal_range(photo.hashBack);
+        for (auto photoFile = begin; photoFile != end; ++photoFile) {
+            // See if it's on disk.
+            if (diskPathnames.contains(photoFile->second->pathname)) {
+                Photo newPhoto = photo;
+                newPhoto.pathname = photoFile->second->pathname;
+                newPhoto.absolutePathname = config.rootDir / newPhoto.pathname;
+                goodPhotos.push_back(newPhoto);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            // Can't find any file on disk for this photo.
+            warningCount += 1;
+            if (warningCount <= MAX_FILE_WARNING_COUNT) {
+                spdlog::info("No file on disk for {} ({})", photo.hashBack, photo.label);
+            }
+        }
+    }
+
+    if (warningCount != 0) {
+        spdlog::info("Files missing on disk: {}", warningCount);
+    }
+
+    return goodPhotos;
+}
@@ -0,0 +1,34 @@
+
+#pragma once
+
+#include <set>
+#include <vector>
+#include <filesystem>
+
+#include "config.h"
+#include "database.h"
+
+/**
+ * Gets a set of all pathnames in the image directory. These are relative to the
+ * passed-in root dir.
+ */
+std::set<std::filesystem::path> traverseDirectoryTree(Config const &config);
+
+/**
+ * Keep photos of at least the configured rating.
+ */
+void filterPhotosByRating(std::vector<Photo> &dbPhotos, Config const &config);
+
+/**
+ * Keep photos in the configured date range.
+ */
+void filterPhotosByDate(std::vector<Photo> &dbPhotos, Config const &config);
+
+/**
+ * Assign a pathname to each photo, returning a new copy of dbPhotos with
+ * invalid photos (those with no disk files) removed.
+ */
+std::vector<Photo> assignPhotoPathnames(Database const &database,
+        Config const &config,
+        std::vector<Photo> const &dbPhotos,
+        std::set<std::filesystem::path> const &diskPathnames);
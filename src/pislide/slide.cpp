@@ -38,6 +38,15 @@ void Slide::computeIdealSize(int screenWidth, int screenHeight) {
 }
 
 void Slide::move(Config const &config, bool paused, bool promptingEmail, double time) {
+    // To see whether anything visibly changed.
+    bool wasConfigured = mConfigured;
+    float previousRotate = mActualRotate;
+    float previousWidth = mActualWidth;
+    float previousHeight = mActualHeight;
+    float previousZoom = mActualZoom;
+    float previousAlpha = mActualAlpha;
+    bool previousShowLabels = mShowLabels;
+
     // How much to move toward target.
     float step;
     if (mConfigured) {
@@ -81,6 +90,15 @@ void Slide::move(Config const &config, bool paused, bool promptingEmail, double
     // Alpha is always slow.
     mActualAlpha = interpolate(mActualAlpha, idealAlpha, 0.3);
 
+    // Thresholds are well under a pixel or a color step.
+    mSettled = wasConfigured &&
+        std::abs(mActualRotate - previousRotate) < 0.01f &&
+        std::abs(mActualWidth - previousWidth) < 0.1f &&
+        std::abs(mActualHeight - previousHeight) < 0.1f &&
+        std::abs(mActualZoom - previousZoom) < 0.00005f &&
+        std::abs(mActualAlpha - previousAlpha) < 0.001f &&
+        mShowLabels == previousShowLabels;
+
     touch();
 }
 
@@ -100,6 +118,7 @@ void Slide::draw(Config const &config, TextWriter &textWriter, Texture const &st
     float x = screenCenterX - (photoCenterX*c - photoCenterY*s);
     float y = screenCenterY - (photoCenterX*s + photoCenterY*c);
     DrawTextureEx(mTexture, Vector2 { x, y }, angle, scale, Fade(WHITE, mActualAlpha*opacity));
+    countDrawCalls();
 
     if (drawSlideInfo) {
         // We're drawing bottom to top.
@@ -119,6 +138,7 @@ void Slide::draw(Config const &config, TextWriter &textWriter, Texture const &st
                 };
                 DrawTextureEx(starTexture, position, 0, starScale, starColor);
             }
+            countDrawCalls(rating);
         }
         y -= 20;
 
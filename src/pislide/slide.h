@@ -43,6 +43,10 @@ class Slide final {
     // We've not moved yet, so our actuals are bogus.
     bool mConfigured = false;
 
+    // Our actuals have converged to their ideals, so the slide looks the same
+    // from frame to frame.
+    bool mSettled = false;
+
     // When we were last used (drawn, moved, requested).
     double mLastUsed = 0;
 
@@ -116,6 +120,7 @@ public:
      */
     void reset() {
         mConfigured = false;
+        mSettled = false;
         mActualAlpha = 0.0;
     }
 
@@ -158,4 +163,11 @@ public:
     bool configured() const {
         return mConfigured;
     }
+
+    /**
+     * Whether the most recent move() left the slide visibly unchanged.
+     */
+    bool settled() const {
+        return mSettled;
+    }
 };
@@ -1,21 +1,25 @@
 
 #include "slidecache.h"
 #include "constants.h"
+#include "profiler.h"
+#include "metrics.h"
 
-std::shared_ptr<Slide> SlideCache::get(Photo const &photo, bool fetch) {
+std::shared_ptr<Slide> SlideCache::get(Photo const &photo, bool fetch, TaskClass taskClass) {
     // Before doing anything, see if the loader has anything for us.
     checkImageLoader();
 
-    if (mCache.contains(photo.id)) {
-        return mCache.at(photo.id);
+    auto itr = mCache.find(photo.id);
+    if (itr != mCache.end()) {
+        return itr->second;
     }
 
     if (fetch) {
         // Cap size of cache. Do this before we load the next slide.
         shrinkCache();
 
-        // Load the photo.
-        mImageLoader.requestImage(photo);
+        // Load the photo. If too many loads are in flight this is dropped,
+        // and we'll be asked again on a later frame.
+        mImageLoader.requestImage(photo, taskClass);
     }
 
     // Empty pointer to indicate that we don't have it.
@@ -24,27 +28,45 @@ std::shared_ptr<Slide> SlideCache::get(Photo const &photo, bool fetch) {
 
 void SlideCache::checkImageLoader() {
     for (auto &loadedImage : mImageLoader.getLoadedImages()) {
-        // Make sure the cache has space.
-        shrinkCache();
+        addToCache(loadedImage);
+    }
+}
 
-        // Convert to a texture.
-        auto beginTime = std::chrono::high_resolution_clock::now();
-        std::shared_ptr<Image> image = loadedImage.image ? loadedImage.image : mBrokenImage;
-        Texture texture = LoadTextureFromImage(*image);
-        GenTextureMipmaps(&texture);
-        SetTextureFilter(texture, TEXTURE_FILTER_TRILINEAR);
-        SetTextureWrap(texture, TEXTURE_WRAP_CLAMP);
-        auto endTime = std::chrono::high_resolution_clock::now();
-        auto prepTime = endTime - beginTime;
-
-        // Add to our cache.
-        auto slide = std::make_shared<Slide>(loadedImage.photo, texture,
-                loadedImage.loadTime, prepTime, !loadedImage.image);
-        slide->computeIdealSize(mScreenWidth, mScreenHeight);
-        mCache[loadedImage.photo.id] = slide;
+void SlideCache::addLoadedImage(LoadedImage const &loadedImage) {
+    if (!mCache.contains(loadedImage.photo.id)) {
+        addToCache(loadedImage);
     }
 }
 
+void SlideCache::addToCache(LoadedImage const &loadedImage) {
+    // Make sure the cache has space.
+    shrinkCache();
+
+    // Convert to a texture.
+    ScopedTimer timer("textureUpload");
+    auto beginTime = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<Image> image = loadedImage.image ? loadedImage.image : mBrokenImage;
+    Texture texture = LoadTextureFromImage(*image);
+    GenTextureMipmaps(&texture);
+    SetTextureFilter(texture, TEXTURE_FILTER_TRILINEAR);
+    SetTextureWrap(texture, TEXTURE_WRAP_CLAMP);
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto prepTime = endTime - beginTime;
+
+    // Add to our cache.
+    auto slide = std::make_shared<Slide>(loadedImage.photo, texture,
+            loadedImage.loadTime, prepTime, !loadedImage.image);
+    addSlide(slide);
+}
+
+void SlideCache::addSlide(std::shared_ptr<Slide> const &slide) {
+    shrinkCache();
+
+    slide->computeIdealSize(mScreenWidth, mScreenHeight);
+    mCache[slide->photo().id] = slide;
+    traceCounter("slideCacheSize", mCache.size());
+}
+
 void SlideCache::shrinkCache() {
     while (mCache.size() >= SLIDE_CACHE_SIZE) {
         purgeOldest();
@@ -68,6 +90,7 @@ void SlideCache::purgeOldest() {
 
     if (oldestPhotoId != -1) {
         mCache.erase(oldestPhotoId);
+        metrics().slideCacheEvictions.add();
     }
 }
 
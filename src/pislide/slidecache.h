@@ -29,6 +29,9 @@ class SlideCache final {
     // Drain the return queue of the loader.
     void checkImageLoader();
 
+    // Make a slide of the loaded image and add it to the cache.
+    void addToCache(LoadedImage const &loadedImage);
+
     // Leave at least one place in the cache.
     void shrinkCache();
 
@@ -36,16 +39,30 @@ class SlideCache final {
     void purgeOldest();
 
 public:
-    SlideCache(int screenWidth, int screenHeight, std::shared_ptr<Image> brokenImage)
+    SlideCache(int screenWidth, int screenHeight, std::shared_ptr<Image> brokenImage,
+            ThreadPool &threadPool)
         : mScreenWidth(screenWidth), mScreenHeight(screenHeight),
-            mBrokenImage(brokenImage) {}
+            mBrokenImage(brokenImage), mImageLoader(threadPool) {}
 
     /**
      * Return immediately with a Slide object if we've loaded this photo,
      * or return an empty pointer and (if fetch is true) start loading the
-     * photo asynchronously.
+     * photo asynchronously with the given priority.
+     */
+    std::shared_ptr<Slide> get(Photo const &photo, bool fetch = true,
+            TaskClass taskClass = TaskClass::INTERACTIVE_DECODE);
+
+    /**
+     * Add an image that was loaded elsewhere (such as by the ingestion
+     * pipeline) so that it doesn't need to be loaded again.
+     */
+    void addLoadedImage(LoadedImage const &loadedImage);
+
+    /**
+     * Add a slide whose texture is already loaded, evicting the least
+     * recently used slide if the cache is full.
      */
-    std::shared_ptr<Slide> get(Photo const &photo, bool fetch = true);
+    void addSlide(std::shared_ptr<Slide> const &slide);
 
     /**
      * Reset all slides except these (which can be null).
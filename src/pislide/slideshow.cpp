@@ -1,13 +1,44 @@
 
 #include <cmath>
+#include <iterator>
+#include <locale>
 #include <sstream>
+#include <thread>
 
 #include <raylib.h>
 #include <spdlog/spdlog.h>
+#include <spdlog/fmt/fmt.h>
 
 #include "slideshow.h"
 #include "util.h"
 #include "constants.h"
+#include "profiler.h"
+#include "metrics.h"
+
+namespace {
+    /**
+     * The time of day as it's shown on the screen.
+     */
+    std::string formatTime() {
+        // All-C API because the C++ stuff is really bad at this.
+        std::time_t now = std::time(nullptr);
+        std::tm localTime = *std::localtime(&now);
+
+        char buffer[6];  // Enough for "h:mm\0" or "hh:mm\0"
+        std::strftime(buffer, sizeof(buffer), "%-I:%M", &localTime);
+
+        return buffer;
+    }
+
+    /**
+     * The user's locale, for thousands separators. Constructing it
+     * looks up the environment, so only do it once.
+     */
+    std::locale const &userLocale() {
+        static std::locale const locale("");
+        return locale;
+    }
+}
 
 bool Slideshow::loopRunning() const {
     return !WindowShouldClose() && !mQuit;
@@ -17,7 +48,9 @@ void Slideshow::prefetch() {
     int n = mSlideCache.cacheSize()/2 + 1;
     int photoIndex = getCurrentPhotoIndex();
     for (int i = 0; i < n; i++) {
-        auto slide = mSlideCache.get(photoByIndex(photoIndex + i));
+        // The current and next slides are needed on screen soon, the rest can wait.
+        TaskClass taskClass = i <= 1 ? TaskClass::INTERACTIVE_DECODE : TaskClass::PREFETCH;
+        auto slide = mSlideCache.get(photoByIndex(photoIndex + i), true, taskClass);
         if (slide) {
             // Consider the prefetched slides touched because we always prefer them
             // to the oldest slides.
@@ -43,8 +76,12 @@ void Slideshow::move() {
     if (mShowingBus && mBusStartTime != 0 && now - mBusStartTime >= mConfig.maxBusTime) {
         mShowingBus = false;
         mBusStartTime = 0;
+        mRedrawNeeded = true;
     }
 
+    // Only fetch bus times while they're shown.
+    mBusInfo.update(mConfig, mShowingBus);
+
     /*
     // Auto-disable Twilio after a while.
     if self.fetching_twilio && self.twilio_start_time is not None && time.time() - self.twilio_start_time >= MAX_TWILIO_SECONDS:
@@ -65,9 +102,72 @@ void Slideshow::move() {
     }
 }
 
+bool Slideshow::needsRedraw() {
+    // Ken Burns effect, or something explicitly changed.
+    if (!mPaused || mRedrawNeeded) {
+        return true;
+    }
+
+    // Slides still animating toward their paused positions, or just loaded.
+    auto cs = getCurrentSlides();
+    if ((cs.currentSlide && !cs.currentSlide->settled()) ||
+            (cs.nextSlide && !cs.nextSlide->settled())) {
+
+        return true;
+    }
+
+    // Clock ticked.
+    if (formatTime() != mDrawnTime) {
+        return true;
+    }
+
+    // Bus times and debug info change without telling us.
+    if ((mShowingBus || mDebug) && nowArbitrary() - mPreviousDrawTime >= IDLE_REFRESH_S) {
+        return true;
+    }
+
+    return false;
+}
+
+void Slideshow::idle() {
+    // Don't use WaitTime(), it may busy-wait.
+    std::this_thread::sleep_for(std::chrono::duration<double>(IDLE_POLL_S));
+
+    // EndDrawing() normally does this.
+    PollInputEvents();
+
+    updateDutyCycle(false);
+}
+
+void Slideshow::updateDutyCycle(bool drew) {
+    double now = nowArbitrary();
+    if (mDutyCycleStartTime == 0) {
+        mDutyCycleStartTime = now;
+    }
+    if (drew) {
+        mDutyCycleFrameCount += 1;
+    }
+
+    double elapsed = now - mDutyCycleStartTime;
+    if (elapsed >= DUTY_CYCLE_WINDOW_S) {
+        mDutyCycle = mDutyCycleFrameCount/(elapsed*TARGET_FPS);
+        mDutyCycleStartTime = now;
+        mDutyCycleFrameCount = 0;
+    }
+}
+
 void Slideshow::draw(Texture const &starTexture, std::optional<qrcodegen::QrCode> const &qrCode) {
+    ScopedTimer drawTimer("draw");
+
     auto cs = getCurrentSlides();
 
+    mRedrawNeeded = false;
+    mPreviousDrawTime = nowArbitrary();
+    updateDutyCycle(true);
+
+    // Nothing from the previous frame is still queued to be drawn.
+    mTextWriter.startFrame();
+
     BeginDrawing();
     ClearBackground(BLACK);
 
@@ -116,41 +216,36 @@ void Slideshow::draw(Texture const &starTexture, std::optional<qrcodegen::QrCode
 
         // Draw party QR code.
         if (qrCode) {
-            // QR code sticker.
-            int border = 1;
-            int size = qrCode->getSize();
-            int moduleSize = 5;
-            int stickerSize = (size + 2*border)*moduleSize;
-            // Upper-left of QR code:
-            int x = mScreenWidth - DISPLAY_MARGIN - stickerSize;
-            int y = mScreenHeight - DISPLAY_MARGIN - stickerSize;
-            Color darkColor = Fade(BLACK, fade);
-            Color lightColor = Fade(DARKGRAY, fade);
-            for (int yy = -border; yy < size + border; yy++) {
-                for (int xx = -border; xx < size + border; xx++) {
-                    bool dark = qrCode->getModule(xx, yy);
-                    DrawRectangle(
-                            x + xx*moduleSize,
-                            y + yy*moduleSize,
-                            moduleSize, moduleSize,
-                            dark ? darkColor : lightColor);
-                }
-            }
-
-            // Instructions.
-            x += stickerSize/2;
-            y -= 15;
-            std::vector<std::string> lines = { "photo", "party", "upload", "Scan to" };
-            for (auto line : lines) {
-                mTextWriter.write(line, Vector2 { (float) x, (float) y },
-                        48, lightColor,
-                        TextWriter::Alignment::CENTER, TextWriter::Alignment::END);
-                y -= 37;
-            }
+            drawQrCode(*qrCode, fade);
         }
     }
 
+    mDrawCallCount = takeDrawCallCount();
+
+    drawTimer.stop();
+
+    // Swaps buffers and waits to hit the target frame rate.
+    ScopedTimer presentTimer("present");
     EndDrawing();
+
+    // Nothing's queued to draw them anymore.
+    mRetiredDebugTextures.clear();
+}
+
+void Slideshow::drawQrCode(qrcodegen::QrCode const &qrCode, float fade) {
+    // The QR code never changes, so render it once and tint it with the fade.
+    if (!mQrCodeTexture) {
+        makeQrCodeTexture(qrCode);
+    }
+
+    // Lower-right corner. The instructions may be wider than the sticker, so
+    // position the texture such that the sticker itself is against the margins.
+    Vector2 position {
+        mScreenWidth - DISPLAY_MARGIN - mQrCodeSticker.width - mQrCodeSticker.x,
+        mScreenHeight - DISPLAY_MARGIN - mQrCodeSticker.height - mQrCodeSticker.y,
+    };
+    DrawTextureV(*mQrCodeTexture, position, Fade(WHITE, fade));
+    countDrawCalls();
 }
 
 Slideshow::CurrentSlides Slideshow::getCurrentSlides() {
@@ -170,6 +265,13 @@ Slideshow::CurrentSlides Slideshow::getCurrentSlides() {
     double slideTotalTime = mConfig.slideTotalTime();
 
     cs.currentSlide = mSlideCache.get(photoByIndex(photoIndex));
+
+    // Count whether each slide was ready when it came on screen. Lookups
+    // happen every frame, so counting those would measure the frame rate.
+    if (photoIndex != mCacheCountedIndex) {
+        mCacheCountedIndex = photoIndex;
+        (cs.currentSlide ? metrics().slideCacheHits : metrics().slideCacheMisses).add();
+    }
     if (cs.currentSlide && !cs.currentSlide->swapZoom().has_value()) {
         cs.currentSlide->setSwapZoom(modulo(photoIndex, 2) == 0);
     }
@@ -198,6 +300,7 @@ void Slideshow::handleKeyboard() {
     // Unicode code point.
     int ch = GetCharPressed();
     if (ch != KEY_NULL) {
+        mRedrawNeeded = true;
         spdlog::trace("Got char {}", ch);
         /*
         if self.prompting_email:
@@ -295,6 +398,7 @@ void Slideshow::handleKeyboard() {
     // Non-character keys.
     int key = GetKeyPressed();
     if (key != 0) {
+        mRedrawNeeded = true;
         // To debug the problem of arrow keys not working after a while:
         spdlog::debug("Got key {}", key);
         if (key == KEY_LEFT) {
@@ -309,6 +413,40 @@ void Slideshow::handleKeyboard() {
     }
 }
 
+void Slideshow::handleRemoteCommand(RemoteCommand const &command) {
+    mRedrawNeeded = true;
+    spdlog::debug("Got remote command {} ({})", static_cast<int>(command.type), command.value);
+
+    switch (command.type) {
+        case RemoteCommand::Type::NEXT:
+            jumpRelative(1);
+            break;
+        case RemoteCommand::Type::PREVIOUS:
+            jumpRelative(-1);
+            break;
+        case RemoteCommand::Type::TOGGLE_PAUSE:
+            togglePause();
+            break;
+        case RemoteCommand::Type::TOGGLE_PARTY:
+            toggleParty();
+            break;
+        case RemoteCommand::Type::RATE:
+            if (!mParty) {
+                ratePhoto(command.value);
+            }
+            break;
+        case RemoteCommand::Type::ROTATE:
+            if (!mParty) {
+                rotatePhoto(command.value);
+            }
+            break;
+    }
+}
+
+Photo const &Slideshow::currentPhoto() const {
+    return mDbPhotos.at(modulo(getCurrentPhotoIndex(), mDbPhotos.size()));
+}
+
 void Slideshow::jumpRelative(int deltaSlide) {
     double oldTime = mTime;
     auto cs = getCurrentSlides();
@@ -325,6 +463,13 @@ void Slideshow::togglePause() {
 
 void Slideshow::toggleDebug() {
     mDebug = !mDebug;
+
+    // Rebuild with fresh values when next drawn. We're between frames, so
+    // the textures can be unloaded.
+    mDebugLineCount = 0;
+    if (!mDebug) {
+        mDebugLines.clear();
+    }
 }
 
 void Slideshow::toggleParty() {
@@ -334,72 +479,134 @@ void Slideshow::toggleParty() {
 void Slideshow::toggleBus() {
     mShowingBus = !mShowingBus;
     mBusStartTime = mShowingBus ? nowArbitrary() : 0;
+
+    // Start fetching now, so the times are in by the time we draw.
+    mBusInfo.update(mConfig, mShowingBus);
 }
 
 void Slideshow::drawTime(Color color) {
-    // All-C API because the C++ stuff is really bad at this.
-    std::time_t now = std::time(nullptr);
-    std::tm localTime = *std::localtime(&now);
-
-    char buffer[6];  // Enough for "h:mm\0" or "hh:mm\0"
-    std::strftime(buffer, sizeof(buffer), "%-I:%M", &localTime);
+    mDrawnTime = formatTime();
 
-    mTextWriter.write(buffer, Vector2 { mScreenWidth - DISPLAY_MARGIN, DISPLAY_MARGIN },
+    mTextWriter.write(mDrawnTime, Vector2 { mScreenWidth - DISPLAY_MARGIN, DISPLAY_MARGIN },
             64, color, TextWriter::Alignment::END, TextWriter::Alignment::START);
 }
 
 void Slideshow::drawDebug() {
     constexpr float FONT_SIZE = 30;
 
-    auto cs = getCurrentSlides();
+    updateDebugLines(getCurrentSlides());
 
+    // Each line has its own texture, rendered in white and tinted, and only
+    // re-rendered when its text changes. Most of the lines change with every
+    // rebuild, so don't fill up the TextWriter's cache with them.
     Vector2 pos { DISPLAY_MARGIN, DISPLAY_MARGIN };
+    for (size_t i = 0; i < mDebugLineCount; i++) {
+        auto &line = mDebugLines[i];
+        if (line.text != line.renderedText) {
+            // The old texture may have been drawn earlier in this frame.
+            if (line.texture) {
+                mRetiredDebugTextures.push_back(std::move(line.texture));
+            }
+            if (!line.text.empty()) {
+                auto image = mTextWriter.makeImage(line.text, FONT_SIZE, WHITE);
+                line.texture = makeTextureSharedPtr(LoadTextureFromImage(*image));
+            }
+            line.renderedText = line.text;
+        }
+
+        if (line.texture) {
+            DrawTextureV(*line.texture, pos, line.color);
+            countDrawCalls();
+        }
+        pos.y += FONT_SIZE;
+    }
+}
+
+Slideshow::DebugLine &Slideshow::addDebugLine(Color color) {
+    if (mDebugLineCount == mDebugLines.size()) {
+        mDebugLines.emplace_back();
+    }
+
+    // Clearing keeps the string's buffer.
+    DebugLine &line = mDebugLines[mDebugLineCount++];
+    line.text.clear();
+    line.color = color;
+
+    return line;
+}
+
+void Slideshow::updateDebugLines(CurrentSlides const &cs) {
+    double now = nowArbitrary();
+    bool stale = mDebugLineCount == 0
+        || now - mDebugUpdateTime >= DEBUG_OVERLAY_REFRESH_S
+        || cs.index != mDebugPhotoIndex
+        || mPhotosVersion != mDebugPhotosVersion;
+    if (!stale) {
+        return;
+    }
+    mDebugUpdateTime = now;
+    mDebugPhotoIndex = cs.index;
+    mDebugPhotosVersion = mPhotosVersion;
+    mDebugLineCount = 0;
 
     // Write FPS.
-    mTextWriter.write(TextFormat("Frames per second: %i", GetFPS()), pos, FONT_SIZE, WHITE,
-            TextWriter::Alignment::START, TextWriter::Alignment::START);
-    pos.y += FONT_SIZE;
+    fmt::format_to(std::back_inserter(addDebugLine(WHITE).text),
+            "Frames per second: {}", GetFPS());
+
+    // Write draw calls of the previous frame.
+    fmt::format_to(std::back_inserter(addDebugLine(WHITE).text),
+            "Draw calls per frame: {}", mDrawCallCount);
+
+    // Write how often we render compared to an always-animating slideshow.
+    fmt::format_to(std::back_inserter(addDebugLine(WHITE).text),
+            "Render duty cycle: {:.0f}%", mDutyCycle*100);
 
     // Basic stats.
-    std::stringstream ss;
-    ss.imbue(std::locale(""));
-    ss << "Number of photos: " << mDbPhotos.size();
-    mTextWriter.write(ss.str().c_str(), pos, FONT_SIZE, WHITE,
-            TextWriter::Alignment::START, TextWriter::Alignment::START);
-    pos.y += FONT_SIZE;
+    fmt::format_to(std::back_inserter(addDebugLine(WHITE).text), userLocale(),
+            "Number of photos: {:L}", mDbPhotos.size());
+    fmt::format_to(std::back_inserter(addDebugLine(WHITE).text),
+            "Time: {:.1f}s", mTime);
+
+    addDebugLine(WHITE);
+
+    // Write phase timings.
+    for (auto const &summary : profiler().summarize()) {
+        fmt::format_to(std::back_inserter(addDebugLine(WHITE).text),
+                "{}: p50 {:.1f}, p95 {:.1f}, p99 {:.1f}, max {:.1f} ms",
+                summary.name, summary.p50*1000, summary.p95*1000, summary.p99*1000, summary.max*1000);
+    }
 
-    mTextWriter.write(TextFormat("Time: %.1fs", mTime), pos, FONT_SIZE, WHITE,
-            TextWriter::Alignment::START, TextWriter::Alignment::START);
-    pos.y += FONT_SIZE;
+    addDebugLine(WHITE);
 
-    pos.y += FONT_SIZE;
+    // Write thread pool activity.
+    for (auto const &stats : mThreadPool.stats()) {
+        fmt::format_to(std::back_inserter(addDebugLine(WHITE).text),
+                "{}: {} queued, {}/{} running, {} done, {:.1f} s",
+                taskClassName(stats.taskClass), stats.queued, stats.running, stats.limit,
+                stats.completed, stats.runTime);
+    }
+
+    addDebugLine(WHITE);
 
     // Write slide info.
     for (int photoIndex = cs.index - 5; photoIndex <= cs.index + 5; photoIndex++) {
         auto photo = photoByIndex(photoIndex);
         auto slide = mSlideCache.get(photo, false);
-        Color color;
-        std::stringstream ss;
-        ss << photoIndex << ": " << photo;
+        Color color = photoIndex == cs.index ? YELLOW : slide ? WHITE : GRAY;
+
+        mDebugStream.str("");
+        mDebugStream << photoIndex << ": " << photo;
         if (slide) {
-            ss << ", " << *slide;
-            color = WHITE;
-        } else {
-            color = GRAY;
-        }
-        if (photoIndex == cs.index) {
-            color = YELLOW;
+            mDebugStream << ", " << *slide;
         }
-        mTextWriter.write(ss.str(), pos, FONT_SIZE, color, TextWriter::Alignment::START, TextWriter::Alignment::START);
-        pos.y += FONT_SIZE;
+        addDebugLine(color).text = mDebugStream.view();
     }
 
-    pos.y += FONT_SIZE;
+    addDebugLine(WHITE);
 
     // Write logs.
     // last_raw() is also available if we want to highlight warn/error logs, dim debug, etc.
-    std::vector<std::string> logMessages = mLogRingBufferSink->last_formatted();
-    for (auto const &logMessage : logMessages) {
+    for (auto &logMessage : mLogRingBufferSink->last_formatted()) {
         Color color = WHITE;
         if (logMessage.contains("[debug]")) {
             color = GRAY;
@@ -408,30 +615,44 @@ void Slideshow::drawDebug() {
         } else if (logMessage.contains("[error]")) {
             color = RED;
         }
-        mTextWriter.write(logMessage, pos, FONT_SIZE, color,
-                TextWriter::Alignment::START, TextWriter::Alignment::START);
-        pos.y += FONT_SIZE;
+        addDebugLine(color).text = std::move(logMessage);
     }
 }
 
 void Slideshow::drawBus(Color color) {
-    // Fetch the most recent info.
-    std::vector<time_t> times = mBusInfo.getTimes(mConfig);
+    // The most recent info, which might be old if fetches are failing.
+    BusTimes const &busTimes = mBusInfo.times();
+    time_t now = nowEpoch();
+
+    // Skip buses that have come and gone.
+    std::vector<time_t> times;
+    for (time_t time : busTimes.times) {
+        if (time >= now - 60) {
+            times.push_back(time);
+        }
+    }
 
     std::stringstream ss;
-    ss << "Bus arrivals: ";
+    ss << "Bus arrivals";
+    if (busTimes.fetchTime != 0 && now - busTimes.fetchTime >= BUS_INFO_STALE_S) {
+        ss << " (" << (now - busTimes.fetchTime)/60 << " min old)";
+    }
+    ss << ": ";
 
-    if (times.empty()) {
+    if (busTimes.fetchTime == 0) {
         if (nowArbitrary() - mBusStartTime <= 1) {
             // If we just turned it on, don't show anything, it'll flicker.
             return;
+        } else if (mBusInfo.failureCount() > 0) {
+            ss << "unavailable";
         } else {
             // While loading.
             ss << ". . .";
         }
+    } else if (times.empty()) {
+        ss << "none";
     } else {
         bool first = true;
-        time_t now = nowEpoch();
         for (time_t time : times) {
             if (first) {
                 first = false;
@@ -476,6 +697,9 @@ void Slideshow::ratePhoto(int rating) {
 }
 
 void Slideshow::insertPhoto(Photo const &photo) {
+    mRedrawNeeded = true;
+    mPhotosVersion++;
+
     if (mDbPhotos.empty()) {
         // First photo, just add it.
         mDbPhotos.push_back(photo);
@@ -507,6 +731,11 @@ void Slideshow::insertPhoto(Photo const &photo) {
     }
 }
 
+void Slideshow::insertPhoto(Photo const &photo, LoadedImage const &loadedImage) {
+    mSlideCache.addLoadedImage(loadedImage);
+    insertPhoto(photo);
+}
+
 std::shared_ptr<Image> Slideshow::makeBrokenImage(TextWriter &textWriter) {
     Image image = GenImageGradientRadial(1024, 1024, 0.0f,
             ColorFromHSV(20.0f, 0.2f, 0.2f),
@@ -520,3 +749,63 @@ std::shared_ptr<Image> Slideshow::makeBrokenImage(TextWriter &textWriter) {
     return makeImageSharedPtr(image);
 }
 
+
+void Slideshow::makeQrCodeTexture(qrcodegen::QrCode const &qrCode) {
+    int border = 1;
+    int size = qrCode.getSize();
+    int moduleSize = 5;
+    int stickerSize = (size + 2*border)*moduleSize;
+
+    // Instructions, bottom line first. Each line's bottom is relative to the
+    // top of the sticker.
+    std::vector<std::string> lines = { "photo", "party", "upload", "Scan to" };
+    std::vector<std::shared_ptr<Image>> lineImages;
+    int width = stickerSize;
+    int top = 0;
+    int bottom = -15;
+    for (auto const &line : lines) {
+        auto lineImage = mTextWriter.makeImage(line, 48, DARKGRAY);
+        width = std::max(width, lineImage->width);
+        top = std::min(top, bottom - lineImage->height);
+        lineImages.push_back(lineImage);
+        bottom -= 37;
+    }
+
+    // Upper-left of QR code sticker within the image.
+    int x = (width - stickerSize)/2;
+    int y = -top;
+    Image image = GenImageColor(width, y + stickerSize, BLANK);
+
+    // QR code sticker.
+    ImageDrawRectangle(&image, x, y, stickerSize, stickerSize, DARKGRAY);
+    for (int yy = 0; yy < size; yy++) {
+        for (int xx = 0; xx < size; xx++) {
+            if (qrCode.getModule(xx, yy)) {
+                ImageDrawRectangle(&image,
+                        x + (xx + border)*moduleSize,
+                        y + (yy + border)*moduleSize,
+                        moduleSize, moduleSize, BLACK);
+            }
+        }
+    }
+
+    // Instructions.
+    bottom = y - 15;
+    for (auto const &lineImage : lineImages) {
+        float lineWidth = lineImage->width;
+        float lineHeight = lineImage->height;
+        Rectangle srcRec = { 0.0f, 0.0f, lineWidth, lineHeight };
+        Rectangle dstRec = { x + stickerSize/2 - lineWidth/2, bottom - lineHeight, lineWidth, lineHeight };
+        ImageDraw(&image, *lineImage, srcRec, dstRec, WHITE);
+        bottom -= 37;
+    }
+
+    mQrCodeTexture = makeTextureSharedPtr(LoadTextureFromImage(image));
+    mQrCodeSticker = Rectangle {
+        .x = static_cast<float>(x),
+        .y = static_cast<float>(y),
+        .width = static_cast<float>(stickerSize),
+        .height = static_cast<float>(stickerSize),
+    };
+    UnloadImage(image);
+}
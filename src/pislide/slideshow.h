@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <optional>
+#include <sstream>
 
 #include "qrcodegen.hpp"
 
@@ -12,6 +13,8 @@
 #include "slidecache.h"
 #include "textwriter.h"
 #include "businfo.h"
+#include "threadpool.h"
+#include "remotecontrol.h"
 
 #include <spdlog/sinks/ringbuffer_sink.h>
 
@@ -24,6 +27,7 @@ class Slideshow final {
     int mScreenHeight;
     Config const &mConfig;
     Database const &mDatabase;
+    ThreadPool const &mThreadPool;
     TextWriter mTextWriter;
     SlideCache mSlideCache;
     std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> mLogRingBufferSink;
@@ -37,6 +41,55 @@ class Slideshow final {
     bool mDebug = false;
     bool mParty = false;
     bool mQuit = false;
+    int mDrawCallCount = 0;
+
+    // Goes up whenever photos are added to mDbPhotos.
+    uint64_t mPhotosVersion = 0;
+
+    // Photo index whose slide was last counted as a cache hit or miss.
+    std::optional<int> mCacheCountedIndex;
+
+    // For skipping frames when nothing on screen would change.
+    bool mRedrawNeeded = true;
+    double mPreviousDrawTime = 0;
+    std::string mDrawnTime;
+
+    // For computing the fraction of frames that we actually render.
+    double mDutyCycleStartTime = 0;
+    int mDutyCycleFrameCount = 0;
+    float mDutyCycle = 1;
+
+    /**
+     * One line of the debug overlay. Empty text is a blank line.
+     */
+    struct DebugLine {
+        std::string text;
+        Color color;
+        // The text that's in the texture, which is empty for a blank line.
+        std::string renderedText;
+        std::shared_ptr<Texture> texture;
+    };
+
+    // Text of the debug overlay, rebuilt by updateDebugLines() only when
+    // stale. Lines past mDebugLineCount are unused but keep their buffers
+    // and textures for the next rebuild.
+    std::vector<DebugLine> mDebugLines;
+    size_t mDebugLineCount = 0;
+    double mDebugUpdateTime = 0;
+    int mDebugPhotoIndex = 0;
+    uint64_t mDebugPhotosVersion = 0;
+
+    // Textures of debug lines that changed this frame, unloaded after
+    // the frame is drawn.
+    std::vector<std::shared_ptr<Texture>> mRetiredDebugTextures;
+
+    // Reused to format photo and slide descriptions.
+    std::ostringstream mDebugStream;
+
+    // Pre-rendered party QR code sticker with its instructions, and the
+    // location of the sticker within the texture.
+    std::shared_ptr<Texture> mQrCodeTexture;
+    Rectangle mQrCodeSticker {};
 
     /**
      * Information about the slides we're showing now.
@@ -64,10 +117,20 @@ class Slideshow final {
     Photo photoByIndex(int index) const;
 
     // Draw various things.
+    void drawQrCode(qrcodegen::QrCode const &qrCode, float fade);
     void drawTime(Color color);
     void drawBus(Color color);
     void drawDebug();
 
+    // Rebuild mDebugLines if they're out of date.
+    void updateDebugLines(CurrentSlides const &cs);
+
+    // Get the next line of mDebugLines to fill, cleared.
+    DebugLine &addDebugLine(Color color);
+
+    // Record whether this frame was rendered, for the debug display.
+    void updateDutyCycle(bool drew);
+
     // Control the slideshow.
     void jumpRelative(int deltaPhoto);
     void togglePause();
@@ -82,20 +145,26 @@ class Slideshow final {
     // Make the image that will be used if an image file fails to load.
     static std::shared_ptr<Image> makeBrokenImage(TextWriter &textWriter);
 
+    // Render the QR code sticker and its instructions into mQrCodeTexture.
+    void makeQrCodeTexture(qrcodegen::QrCode const &qrCode);
+
 public:
     Slideshow(std::vector<Photo> &dbPhotos,
             int screenWidth,
             int screenHeight,
             Config const &config,
             Database const &database,
+            ThreadPool &threadPool,
             std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> ringBufferSink)
         : mDbPhotos(dbPhotos),
         mScreenWidth(screenWidth),
         mScreenHeight(screenHeight),
         mConfig(config),
         mDatabase(database),
-        mSlideCache(screenWidth, screenHeight, makeBrokenImage(mTextWriter)),
-        mLogRingBufferSink(ringBufferSink) {
+        mThreadPool(threadPool),
+        mSlideCache(screenWidth, screenHeight, makeBrokenImage(mTextWriter), threadPool),
+        mLogRingBufferSink(ringBufferSink),
+        mBusInfo(threadPool) {
 
         // We'll handle this.
         SetExitKey(0);
@@ -108,9 +177,42 @@ public:
     bool loopRunning() const;
     void prefetch();
     void move();
+
+    /**
+     * Whether anything on screen would change if we drew now (animation,
+     * input, new photo, clock). If not, call idle() instead of draw().
+     */
+    bool needsRedraw();
     void draw(Texture const &starTexture, std::optional<qrcodegen::QrCode> const &qrCode);
+
+    /**
+     * Sleep briefly and poll for input. Replaces draw() when nothing changed.
+     */
+    void idle();
     void handleKeyboard();
+
+    /**
+     * Do what a remote asked, like the equivalent key.
+     */
+    void handleRemoteCommand(RemoteCommand const &command);
+
+    /**
+     * The photo being shown now.
+     */
+    Photo const &currentPhoto() const;
     void insertPhoto(Photo const &photo);
+
+    /**
+     * Like insertPhoto(), but with the image already loaded so that it
+     * shows without waiting for the loader.
+     */
+    void insertPhoto(Photo const &photo, LoadedImage const &loadedImage);
     bool isParty() const { return mParty; }
+
+    /**
+     * Changes whenever the photo list changes, so the caller knows when
+     * to republish it.
+     */
+    uint64_t photosVersion() const { return mPhotosVersion; }
 };
 
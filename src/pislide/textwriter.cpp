@@ -1,6 +1,11 @@
 
+#include <algorithm>
+#include <vector>
+
 #include "textwriter.h"
 #include "util.h"
+#include "constants.h"
+#include "profiler.h"
 
 namespace {
     // Extra spacing between letters.
@@ -24,6 +29,83 @@ std::shared_ptr<Font> TextWriter::getFont(float fontSize) {
     return font;
 }
 
+std::shared_ptr<Texture> TextWriter::getTextTexture(std::string const &text, float fontSize, double now) {
+    auto &textures = mTextCache[fontSize];
+
+    auto itr = textures.find(text);
+    if (itr == textures.end()) {
+        // Render in white so that the color can be applied as a tint.
+        std::shared_ptr<Image> image = makeImage(text, fontSize, WHITE);
+        CachedText cachedText {
+            .texture = makeTextureSharedPtr(LoadTextureFromImage(*image)),
+            .lastUsedFrame = mFrame,
+            .lastUsedTime = now,
+        };
+        itr = textures.emplace(text, cachedText).first;
+        mTextCacheSize += 1;
+    }
+
+    itr->second.lastUsedFrame = mFrame;
+    itr->second.lastUsedTime = now;
+    return itr->second.texture;
+}
+
+void TextWriter::startFrame() {
+    purgeUnusedText(nowArbitrary());
+    mFrame += 1;
+}
+
+void TextWriter::purgeUnusedText(double now) {
+    // Don't bother scanning every frame.
+    if (now - mPreviousPurge < 1 && mTextCacheSize <= TEXT_CACHE_MAX_SIZE) {
+        return;
+    }
+    mPreviousPurge = now;
+
+    // Unload text that's been unused for a while, and note when the rest
+    // was used in case we're still over the limit.
+    std::vector<uint64_t> lastUsedFrames;
+    for (auto fontItr = mTextCache.begin(); fontItr != mTextCache.end(); ) {
+        auto &textures = fontItr->second;
+        for (auto itr = textures.begin(); itr != textures.end(); ) {
+            if (itr->second.lastUsedFrame != mFrame
+                    && now - itr->second.lastUsedTime > TEXT_CACHE_MAX_UNUSED_S) {
+
+                itr = textures.erase(itr);
+                mTextCacheSize -= 1;
+            } else {
+                lastUsedFrames.push_back(itr->second.lastUsedFrame);
+                ++itr;
+            }
+        }
+        fontItr = textures.empty() ? mTextCache.erase(fontItr) : std::next(fontItr);
+    }
+
+    if (mTextCacheSize <= TEXT_CACHE_MAX_SIZE) {
+        return;
+    }
+
+    // Something is writing lots of different strings. Unload the least
+    // recently used text, keeping everything drawn in the previous frame
+    // even if that alone is over the limit.
+    auto excess = lastUsedFrames.begin() + (mTextCacheSize - TEXT_CACHE_MAX_SIZE - 1);
+    std::nth_element(lastUsedFrames.begin(), excess, lastUsedFrames.end());
+    uint64_t evictFrame = *excess;
+
+    for (auto fontItr = mTextCache.begin(); fontItr != mTextCache.end(); ) {
+        auto &textures = fontItr->second;
+        for (auto itr = textures.begin(); itr != textures.end() && mTextCacheSize > TEXT_CACHE_MAX_SIZE; ) {
+            if (itr->second.lastUsedFrame <= evictFrame && itr->second.lastUsedFrame != mFrame) {
+                itr = textures.erase(itr);
+                mTextCacheSize -= 1;
+            } else {
+                ++itr;
+            }
+        }
+        fontItr = textures.empty() ? mTextCache.erase(fontItr) : std::next(fontItr);
+    }
+}
+
 Rectangle TextWriter::write(std::string const &text,
         Vector2 position,
         float fontSize,
@@ -31,9 +113,26 @@ Rectangle TextWriter::write(std::string const &text,
         Alignment horizontal,
         Alignment vertical) {
 
-    std::shared_ptr<Font> font = getFont(fontSize);
+    ScopedTimer timer("text");
 
-    Vector2 size = MeasureTextEx(*font, text.c_str(), fontSize, SPACING);
+    double now = nowArbitrary();
+
+    // Can't make a texture with no width.
+    if (text.empty()) {
+        return Rectangle {
+            .x = position.x,
+            .y = position.y,
+            .width = 0,
+            .height = fontSize,
+        };
+    }
+
+    std::shared_ptr<Texture> texture = getTextTexture(text, fontSize, now);
+
+    Vector2 size {
+        static_cast<float>(texture->width),
+        static_cast<float>(texture->height),
+    };
 
     if (horizontal != Alignment::START || vertical != Alignment::START) {
         switch (horizontal) {
@@ -65,7 +164,8 @@ Rectangle TextWriter::write(std::string const &text,
         }
     }
 
-    DrawTextEx(*font, text.c_str(), position, fontSize, SPACING, color);
+    DrawTextureV(*texture, position, color);
+    countDrawCalls();
 
     return Rectangle {
         .x = position.x,
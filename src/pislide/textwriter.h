@@ -4,21 +4,58 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <cstdint>
 
 #include "raylib.h"
 
 /**
  * Writes text to the screen, loading and caching fonts of the right size.
+ * Each string is rasterized once into a texture and drawn as a single quad.
  */
 class TextWriter final {
+    /**
+     * A string rendered in white, so that it can be tinted to any color.
+     */
+    struct CachedText {
+        std::shared_ptr<Texture> texture;
+        // Frame in which we last drew this text.
+        uint64_t lastUsedFrame;
+        // When we last drew this text.
+        double lastUsedTime;
+    };
+
     // Font size to font.
     std::map<float,std::shared_ptr<Font>> mFontCache;
 
+    // Font size to text to rendered text.
+    std::map<float,std::map<std::string,CachedText>> mTextCache;
+
+    // Total number of entries in mTextCache.
+    int mTextCacheSize = 0;
+
+    // Incremented by startFrame().
+    uint64_t mFrame = 0;
+
+    // When we last looked for unused entries in mTextCache.
+    double mPreviousPurge = 0;
+
     /**
      * Get or load (and cache) a font at the given size.
      */
     std::shared_ptr<Font> getFont(float fontSize);
 
+    /**
+     * Get or render (and cache) the text at the given size.
+     */
+    std::shared_ptr<Texture> getTextTexture(std::string const &text, float fontSize, double now);
+
+    /**
+     * Unload rendered text that hasn't been drawn recently, then the least
+     * recently drawn text until the cache is down to TEXT_CACHE_MAX_SIZE.
+     * Text drawn in the previous frame is always kept.
+     */
+    void purgeUnusedText(double now);
+
 public:
     TextWriter() = default;
 
@@ -37,6 +74,13 @@ public:
         END,
     };
 
+    /**
+     * Call once per frame before BeginDrawing(). Textures can't be unloaded
+     * while they're queued in raylib's batch, so this is the only place that
+     * rendered text is unloaded.
+     */
+    void startFrame();
+
     /**
      * Write the text at the given position, size, color, and alignment. Return the
      * rectangle on screen where the text was written.
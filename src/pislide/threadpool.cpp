@@ -0,0 +1,256 @@
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "threadpool.h"
+#include "trace.h"
+
+namespace {
+    // The pool and index of the worker running on this thread, if any.
+    thread_local ThreadPool const *tPool = nullptr;
+    thread_local size_t tWorkerIndex = 0;
+
+    constexpr std::array<TaskClass,TASK_CLASS_COUNT> TASK_CLASSES = {
+        TaskClass::INTERACTIVE_DECODE,
+        TaskClass::PREFETCH,
+        TaskClass::NETWORK,
+        TaskClass::THUMBNAIL,
+        TaskClass::MAINTENANCE,
+    };
+}
+
+char const *taskClassName(TaskClass taskClass) {
+    switch (taskClass) {
+        case TaskClass::INTERACTIVE_DECODE: return "interactive";
+        case TaskClass::PREFETCH: return "prefetch";
+        case TaskClass::NETWORK: return "network";
+        case TaskClass::THUMBNAIL: return "thumbnail";
+        case TaskClass::MAINTENANCE: return "maintenance";
+    }
+    return "unknown";
+}
+
+ThreadPool::ThreadPool(int threadCount) {
+    threadCount = std::max(threadCount, 1);
+
+    // Decoding what's on screen can use every thread. Keep one thread free
+    // of prefetching, and don't let slow network calls or a gallery full
+    // of thumbnails tie up more than half the threads.
+    setConcurrencyLimit(TaskClass::INTERACTIVE_DECODE, threadCount);
+    setConcurrencyLimit(TaskClass::PREFETCH, std::max(threadCount - 1, 1));
+    setConcurrencyLimit(TaskClass::NETWORK, std::max(threadCount/2, 1));
+    setConcurrencyLimit(TaskClass::THUMBNAIL, std::max(threadCount/2, 1));
+    setConcurrencyLimit(TaskClass::MAINTENANCE, 1);
+
+    for (int i = 0; i < threadCount; i++) {
+        mWorkers.emplace_back(std::make_unique<Worker>());
+    }
+    // Start the threads once all the workers exist, since they steal from each other.
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->thread = std::thread(&ThreadPool::loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mIdleMutex);
+        mStopping = true;
+    }
+    mIdleCondition.notify_all();
+
+    for (auto &worker : mWorkers) {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::submit(TaskClass taskClass, Task task) {
+    // Keep work on the thread that created it, otherwise spread it around.
+    size_t workerIndex = tPool == this
+        ? tWorkerIndex
+        : mNextWorker++ % mWorkers.size();
+    Worker &worker = *mWorkers[workerIndex];
+
+    {
+        std::lock_guard lock(worker.mutex);
+        worker.queues[static_cast<size_t>(taskClass)].push_back(std::move(task));
+    }
+    mClasses[static_cast<size_t>(taskClass)].queued++;
+
+    notify();
+}
+
+void ThreadPool::submitToMainThread(Task task) {
+    mMainThreadTasks.enqueue(std::move(task));
+}
+
+size_t ThreadPool::runMainThreadTasks() {
+    mMainThreadBatch.clear();
+    mMainThreadTasks.drain(mMainThreadBatch);
+
+    for (auto &task : mMainThreadBatch) {
+        try {
+            task();
+        } catch (std::exception const &e) {
+            spdlog::error("Main thread task threw exception: {}", e.what());
+        } catch (...) {
+            spdlog::error("Main thread task threw exception");
+        }
+    }
+
+    size_t count = mMainThreadBatch.size();
+    mMainThreadBatch.clear();
+    return count;
+}
+
+void ThreadPool::setConcurrencyLimit(TaskClass taskClass, int limit) {
+    mClasses[static_cast<size_t>(taskClass)].limit = std::max(limit, 1);
+    notify();
+}
+
+void ThreadPool::notify() {
+    {
+        std::lock_guard lock(mIdleMutex);
+        mEpoch++;
+    }
+    mIdleCondition.notify_one();
+}
+
+void ThreadPool::loop(size_t workerIndex) {
+    tPool = this;
+    tWorkerIndex = workerIndex;
+    std::string threadName = "Worker " + std::to_string(workerIndex + 1);
+    traceThreadName(threadName.c_str());
+
+    while (true) {
+        uint64_t epoch;
+        {
+            std::lock_guard lock(mIdleMutex);
+            if (mStopping) {
+                return;
+            }
+            epoch = mEpoch;
+        }
+
+        Task task;
+        TaskClass taskClass;
+        if (findTask(workerIndex, task, taskClass)) {
+            ClassState &classState = mClasses[static_cast<size_t>(taskClass)];
+
+            auto beginTime = std::chrono::steady_clock::now();
+            {
+                TraceSpan span(taskClassName(taskClass));
+                try {
+                    task();
+                } catch (std::exception const &e) {
+                    spdlog::error("Thread pool task threw exception: {}", e.what());
+                } catch (...) {
+                    spdlog::error("Thread pool task threw exception");
+                }
+                // Release captured state on this thread, before we count it done.
+                task = nullptr;
+            }
+            auto endTime = std::chrono::steady_clock::now();
+
+            classState.runTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    endTime - beginTime).count();
+            classState.completed++;
+            classState.running--;
+
+            // Another worker might have skipped this class because it was at its limit.
+            if (classState.queued > 0) {
+                notify();
+            }
+        } else {
+            // Nothing to do. Sleep until something changes since we looked.
+            std::unique_lock lock(mIdleMutex);
+            mIdleCondition.wait(lock, [this, epoch]() {
+                return mStopping || mEpoch != epoch;
+            });
+        }
+    }
+}
+
+bool ThreadPool::findTask(size_t workerIndex, Task &task, TaskClass &taskClass) {
+    for (TaskClass candidate : TASK_CLASSES) {
+        if (mClasses[static_cast<size_t>(candidate)].queued == 0 || !tryReserve(candidate)) {
+            continue;
+        }
+
+        // Our own queue first, then steal from the others.
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            size_t otherIndex = (workerIndex + i) % mWorkers.size();
+            if (popTask(*mWorkers[otherIndex], candidate, i != 0, task)) {
+                taskClass = candidate;
+                return true;
+            }
+        }
+
+        // Someone else got it first.
+        mClasses[static_cast<size_t>(candidate)].running--;
+    }
+
+    return false;
+}
+
+bool ThreadPool::popTask(Worker &worker, TaskClass taskClass, bool steal, Task &task) {
+    std::lock_guard lock(worker.mutex);
+
+    auto &queue = worker.queues[static_cast<size_t>(taskClass)];
+    if (queue.empty()) {
+        return false;
+    }
+
+    if (steal) {
+        task = std::move(queue.back());
+        queue.pop_back();
+    } else {
+        task = std::move(queue.front());
+        queue.pop_front();
+    }
+    mClasses[static_cast<size_t>(taskClass)].queued--;
+
+    return true;
+}
+
+bool ThreadPool::tryReserve(TaskClass taskClass) {
+    ClassState &classState = mClasses[static_cast<size_t>(taskClass)];
+
+    int running = classState.running;
+    while (running < classState.limit) {
+        if (classState.running.compare_exchange_weak(running, running + 1)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<TaskClassStats> ThreadPool::stats() const {
+    std::vector<TaskClassStats> stats;
+
+    for (TaskClass taskClass : TASK_CLASSES) {
+        ClassState const &classState = mClasses[static_cast<size_t>(taskClass)];
+        stats.emplace_back(TaskClassStats {
+            .taskClass = taskClass,
+            .queued = classState.queued,
+            .running = classState.running,
+            .limit = classState.limit,
+            .completed = classState.completed,
+            .runTime = static_cast<double>(classState.runTimeNs)/1e9,
+        });
+    }
+
+    return stats;
+}
+
+void ThreadPool::log() const {
+    spdlog::info("Thread pool ({} threads):", mWorkers.size());
+    for (auto const &s : stats()) {
+        spdlog::info("    {:<12} queued {:4} running {}/{} completed {:8} run time {:.1f} s",
+                taskClassName(s.taskClass), s.queued, s.running, s.limit,
+                s.completed, s.runTime);
+    }
+}
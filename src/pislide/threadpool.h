@@ -0,0 +1,181 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tsqueue.h"
+
+/**
+ * Priority class of a task submitted to the thread pool. Workers always pick
+ * the highest-priority class that has queued work and is under its
+ * concurrency limit. Listed from highest to lowest priority.
+ */
+enum class TaskClass {
+    // Decoding an image that's needed on screen now.
+    INTERACTIVE_DECODE,
+    // Decoding images that will be needed soon.
+    PREFETCH,
+    // Talking to web services (Twilio, 511.org).
+    NETWORK,
+    // Making thumbnails for the web gallery.
+    THUMBNAIL,
+    // Database and disk housekeeping.
+    MAINTENANCE,
+};
+
+constexpr size_t TASK_CLASS_COUNT = 5;
+
+/**
+ * Name of the task class, for logs and traces.
+ */
+char const *taskClassName(TaskClass taskClass);
+
+/**
+ * Snapshot of the activity of one task class.
+ */
+struct TaskClassStats final {
+    TaskClass taskClass;
+    // Tasks waiting to run.
+    int queued;
+    // Tasks running now.
+    int running;
+    // Maximum number of tasks allowed to run at once.
+    int limit;
+    // Tasks that have finished since the pool was created.
+    uint64_t completed;
+    // Total time spent running tasks of this class, in seconds.
+    double runTime;
+};
+
+/**
+ * Process-wide pool of worker threads that all subsystems submit to.
+ * Each worker has its own queue per task class; tasks submitted from a
+ * worker go to its own queue, others are spread round-robin, and idle
+ * workers steal from each other.
+ */
+class ThreadPool final {
+public:
+    using Task = std::function<void()>;
+
+private:
+    /**
+     * One worker thread and its queues.
+     */
+    struct Worker final {
+        std::mutex mutex;
+        std::array<std::deque<Task>,TASK_CLASS_COUNT> queues;
+        std::thread thread;
+    };
+
+    /**
+     * Counters for one task class.
+     */
+    struct ClassState final {
+        std::atomic<int> queued = 0;
+        std::atomic<int> running = 0;
+        std::atomic<int> limit = 1;
+        std::atomic<uint64_t> completed = 0;
+        std::atomic<int64_t> runTimeNs = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::array<ClassState,TASK_CLASS_COUNT> mClasses;
+
+    // For round-robin submission from non-worker threads.
+    std::atomic<size_t> mNextWorker = 0;
+
+    // Idle workers wait on this. The epoch changes whenever there might be
+    // new work available to an idle worker.
+    std::mutex mIdleMutex;
+    std::condition_variable mIdleCondition;
+    uint64_t mEpoch = 0;
+    bool mStopping = false;
+
+    // Tasks for the render thread. Not a bounded ring buffer because the
+    // render thread itself submits here, and it can't wait for itself to
+    // drain a full queue.
+    ThreadSafeQueue<Task> mMainThreadTasks;
+    // Reused buffer for draining mMainThreadTasks.
+    std::vector<Task> mMainThreadBatch;
+
+    // Top-level function of worker threads.
+    void loop(size_t workerIndex);
+
+    // Find a task for the worker, reserving a slot in its class. Returns
+    // false if there's nothing that can run now.
+    bool findTask(size_t workerIndex, Task &task, TaskClass &taskClass);
+
+    // Pop a task of this class from the worker's queue, from the front
+    // if it's our own queue, the back if we're stealing.
+    bool popTask(Worker &worker, TaskClass taskClass, bool steal, Task &task);
+
+    // Reserve a running slot in the class, if it's under its limit.
+    bool tryReserve(TaskClass taskClass);
+
+    // Wake up an idle worker.
+    void notify();
+
+public:
+    /**
+     * Start the given number of worker threads, with default concurrency limits.
+     */
+    explicit ThreadPool(int threadCount);
+
+    /**
+     * Waits for running tasks to finish. Queued tasks are discarded.
+     */
+    ~ThreadPool();
+
+    // Can't copy.
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * Queue the task to run on a worker thread. Tasks must not throw.
+     */
+    void submit(TaskClass taskClass, Task task);
+
+    /**
+     * Queue the task to run on the render thread the next time it calls
+     * runMainThreadTasks(). Can be called from any thread.
+     */
+    void submitToMainThread(Task task);
+
+    /**
+     * Run the tasks queued with submitToMainThread(). Call once per frame
+     * from the render thread. Tasks queued while this runs wait for the
+     * next call. Returns the number of tasks run.
+     */
+    size_t runMainThreadTasks();
+
+    /**
+     * Set the maximum number of tasks of this class that can run at once.
+     */
+    void setConcurrencyLimit(TaskClass taskClass, int limit);
+
+    /**
+     * Number of worker threads.
+     */
+    int threadCount() const {
+        return static_cast<int>(mWorkers.size());
+    }
+
+    /**
+     * Snapshot of each task class, from highest to lowest priority.
+     */
+    std::vector<TaskClassStats> stats() const;
+
+    /**
+     * Write the stats to the log.
+     */
+    void log() const;
+};
@@ -0,0 +1,126 @@
+
+#include <atomic>
+#include <chrono>
+
+#include <raylib.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/std.h>
+
+#include "thumbnailcache.h"
+#include "constants.h"
+#include "trace.h"
+#include "util.h"
+
+namespace {
+    // For unique temporary filenames.
+    std::atomic<uint64_t> gTempThumbnailCounter = 0;
+
+    /**
+     * Normalize a rotation to 0, 90, 180, or 270 degrees counter-clockwise.
+     */
+    int normalizeRotation(int rotation) {
+        return ((rotation % 360) + 360) % 360;
+    }
+}
+
+ThumbnailCache::ThumbnailCache(ThreadPool &threadPool, std::filesystem::path dir)
+    : mThreadPool(threadPool), mDir(std::move(dir)) {
+
+    std::error_code ec;
+    std::filesystem::create_directories(mDir, ec);
+    if (ec) {
+        spdlog::error("Can't create thumbnail directory {} ({})", mDir, ec.message());
+    }
+}
+
+int ThumbnailCache::snapSize(int size) {
+    for (int snappedSize : THUMBNAIL_SIZES) {
+        if (size <= snappedSize) {
+            return snappedSize;
+        }
+    }
+    return THUMBNAIL_SIZES.back();
+}
+
+std::filesystem::path ThumbnailCache::pathnameFor(Photo const &photo, int size) const {
+    return mDir / fmt::format("{}-{}-{}.jpg", photo.hashBack, size,
+            normalizeRotation(photo.rotation));
+}
+
+std::optional<std::filesystem::path> ThumbnailCache::get(Photo const &photo, int size) {
+    std::filesystem::path pathname = pathnameFor(photo, size);
+    if (std::filesystem::exists(pathname)) {
+        return pathname;
+    }
+
+    // Join the request that's already making it, or start one.
+    std::shared_future<bool> future;
+    {
+        std::lock_guard lock(mMutex);
+        auto itr = mInFlight.find(pathname);
+        if (itr != mInFlight.end()) {
+            future = itr->second;
+        } else {
+            auto promise = std::make_shared<std::promise<bool>>();
+            future = promise->get_future().share();
+            mInFlight.emplace(pathname, future);
+
+            // Someone is waiting for it, but it mustn't hold up the slideshow.
+            mThreadPool.submit(TaskClass::THUMBNAIL, [promise, photo, size, pathname]() {
+                promise->set_value(makeThumbnail(photo, size, pathname));
+            });
+        }
+    }
+
+    bool success = future.wait_for(std::chrono::seconds(THUMBNAIL_TIMEOUT_S))
+        == std::future_status::ready && future.get();
+
+    // Whoever gets here first forgets the finished request. Later requests
+    // will find the file on disk.
+    if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        std::lock_guard lock(mMutex);
+        mInFlight.erase(pathname);
+    }
+
+    return success ? std::make_optional(pathname) : std::nullopt;
+}
+
+bool ThumbnailCache::makeThumbnail(Photo const &photo, int size,
+        std::filesystem::path const &pathname) {
+
+    TraceSpan span("makeThumbnail");
+
+    Image image = LoadImage(photo.absolutePathname.c_str());
+    if (!IsImageValid(image)) {
+        spdlog::error("Failed to load {} for thumbnail", photo.absolutePathname);
+        return false;
+    }
+
+    // Shrink first so the rotation has less to do.
+    resizeImageToFit(&image, size);
+    switch (normalizeRotation(photo.rotation)) {
+        case 90: ImageRotateCCW(&image); break;
+        case 180: ImageRotateCW(&image); ImageRotateCW(&image); break;
+        case 270: ImageRotateCW(&image); break;
+        default: break;
+    }
+
+    // Write to a temporary file and rename, so that a web thread never
+    // serves a partial file. The extension tells raylib to write a JPEG.
+    std::filesystem::path tempPathname = pathname.parent_path() /
+        fmt::format(".thumbnail-{:08}.jpg", ++gTempThumbnailCounter);
+    bool success = ExportImage(image, tempPathname.c_str());
+    UnloadImage(image);
+
+    std::error_code ec;
+    if (success) {
+        std::filesystem::rename(tempPathname, pathname, ec);
+        success = !ec;
+    }
+    if (!success) {
+        spdlog::error("Can't write thumbnail {}", pathname);
+        std::filesystem::remove(tempPathname, ec);
+    }
+
+    return success;
+}
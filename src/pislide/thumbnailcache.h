@@ -0,0 +1,61 @@
+
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include "model.h"
+#include "threadpool.h"
+
+/**
+ * Small JPEG versions of photos for the web gallery, made on the thread pool
+ * and kept on disk. Files are named by the photo's hash, size, and rotation,
+ * so they never need to be invalidated.
+ */
+class ThumbnailCache final {
+    ThreadPool &mThreadPool;
+    std::filesystem::path mDir;
+
+    // Thumbnails being made, so that simultaneous requests for the same one
+    // share the work. The value is whether it succeeded.
+    std::mutex mMutex;
+    std::map<std::filesystem::path,std::shared_future<bool>> mInFlight;
+
+    /**
+     * Load, shrink, rotate, and save the photo as a JPEG. Runs on a worker
+     * thread. Returns whether it succeeded.
+     */
+    static bool makeThumbnail(Photo const &photo, int size, std::filesystem::path const &pathname);
+
+public:
+    /**
+     * Thumbnails are stored in the given directory, which is created if necessary.
+     */
+    ThumbnailCache(ThreadPool &threadPool, std::filesystem::path dir);
+
+    // Can't copy.
+    ThumbnailCache(const ThumbnailCache &) = delete;
+    ThumbnailCache &operator=(const ThumbnailCache &) = delete;
+
+    /**
+     * Round a requested size to one we make, so that the cache holds at
+     * most a few versions of each photo.
+     */
+    static int snapSize(int size);
+
+    /**
+     * Pathname of the thumbnail that fits in a size by size box. The size
+     * must have gone through snapSize().
+     */
+    std::filesystem::path pathnameFor(Photo const &photo, int size) const;
+
+    /**
+     * Pathname of the thumbnail, making it first if it's not on disk.
+     * Blocks until it's made, or returns nullopt if that fails or takes
+     * longer than THUMBNAIL_TIMEOUT_S. Called from web server threads.
+     */
+    std::optional<std::filesystem::path> get(Photo const &photo, int size);
+};
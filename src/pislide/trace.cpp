@@ -0,0 +1,149 @@
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/fmt/std.h>
+
+#include "trace.h"
+#include "constants.h"
+
+namespace {
+    /**
+     * One recorded event.
+     */
+    struct TraceEvent final {
+        char const *name;
+        // 'X' for complete span, 'C' for counter.
+        char phase;
+        uint32_t threadId;
+        int64_t timestamp;
+        // Duration for spans, value for counters.
+        union {
+            int64_t duration;
+            double value;
+        };
+    };
+
+    std::mutex gMutex;
+    std::vector<TraceEvent> gEvents;
+    std::map<uint32_t,std::string> gThreadNames;
+    std::filesystem::path gPathname;
+    std::chrono::steady_clock::time_point gStartTime;
+
+    // Threads are numbered as they first record an event.
+    std::atomic<uint32_t> gNextThreadId = 1;
+    thread_local uint32_t tThreadId = 0;
+
+    uint32_t currentThreadId() {
+        if (tThreadId == 0) {
+            tThreadId = gNextThreadId++;
+        }
+        return tThreadId;
+    }
+
+    /**
+     * Add the event to the list. Stops tracing if the list is full.
+     */
+    void addEvent(TraceEvent const &event) {
+        std::lock_guard lock(gMutex);
+        if (!isTracing()) {
+            // Stopped while we were getting here.
+            return;
+        }
+        if (gEvents.size() >= TRACE_MAX_EVENTS) {
+            trace_detail::gTracing = false;
+            spdlog::warn("Trace buffer full, no longer tracing");
+            return;
+        }
+        gEvents.push_back(event);
+    }
+}
+
+namespace trace_detail {
+    std::atomic<bool> gTracing = false;
+
+    int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - gStartTime).count();
+    }
+
+    void recordSpan(char const *name, int64_t beginTime, int64_t endTime) {
+        TraceEvent event {
+            .name = name,
+            .phase = 'X',
+            .threadId = currentThreadId(),
+            .timestamp = beginTime,
+        };
+        event.duration = endTime - beginTime;
+        addEvent(event);
+    }
+}
+
+void startTracing(std::filesystem::path const &pathname) {
+    std::lock_guard lock(gMutex);
+    gPathname = pathname;
+    gStartTime = std::chrono::steady_clock::now();
+    gEvents.clear();
+    gEvents.reserve(TRACE_MAX_EVENTS/16);
+    trace_detail::gTracing = true;
+    spdlog::info("Tracing to {}", pathname);
+}
+
+void stopTracing() {
+    std::lock_guard lock(gMutex);
+    if (gPathname.empty()) {
+        return;
+    }
+    trace_detail::gTracing = false;
+
+    std::ofstream f(gPathname);
+    f << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (auto const &[threadId, name] : gThreadNames) {
+        f << (first ? "" : ",\n") << fmt::format(
+                R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}})",
+                threadId, name);
+        first = false;
+    }
+    for (auto const &event : gEvents) {
+        f << (first ? "" : ",\n");
+        if (event.phase == 'X') {
+            f << fmt::format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{},"dur":{}}})",
+                    event.name, event.threadId, event.timestamp, event.duration);
+        } else {
+            f << fmt::format(R"({{"name":"{}","ph":"C","pid":1,"tid":{},"ts":{},"args":{{"value":{}}}}})",
+                    event.name, event.threadId, event.timestamp, event.value);
+        }
+        first = false;
+    }
+    f << "\n]}\n";
+
+    spdlog::info("Wrote {} trace events to {}", gEvents.size(), gPathname);
+    gEvents.clear();
+    gPathname.clear();
+}
+
+void traceThreadName(char const *name) {
+    if (isTracing()) {
+        uint32_t threadId = currentThreadId();
+        std::lock_guard lock(gMutex);
+        gThreadNames[threadId] = name;
+    }
+}
+
+void traceCounter(char const *name, double value) {
+    if (isTracing()) {
+        TraceEvent event {
+            .name = name,
+            .phase = 'C',
+            .threadId = currentThreadId(),
+            .timestamp = trace_detail::now(),
+        };
+        event.value = value;
+        addEvent(event);
+    }
+}
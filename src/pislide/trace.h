@@ -0,0 +1,87 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * Optional recording of trace events (spans and counters) from all threads.
+ * The events are written as a Chrome JSON trace file, which can be opened in
+ * Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * All names passed to these functions must be string literals (or otherwise
+ * live until tracing is stopped) and must not need JSON escaping. When
+ * tracing is off, each call costs one atomic load.
+ */
+
+namespace trace_detail {
+    extern std::atomic<bool> gTracing;
+
+    // Microseconds since tracing started.
+    int64_t now();
+
+    // Record a complete span.
+    void recordSpan(char const *name, int64_t beginTime, int64_t endTime);
+}
+
+/**
+ * Whether trace events are being recorded.
+ */
+inline bool isTracing() {
+    return trace_detail::gTracing.load(std::memory_order_relaxed);
+}
+
+/**
+ * Start recording events. They'll be written to the pathname by stopTracing().
+ */
+void startTracing(std::filesystem::path const &pathname);
+
+/**
+ * Stop recording events and write the trace file. Does nothing if we weren't tracing.
+ */
+void stopTracing();
+
+/**
+ * Name the current thread in the trace.
+ */
+void traceThreadName(char const *name);
+
+/**
+ * Record the value of a counter, shown as a graph in the trace.
+ */
+void traceCounter(char const *name, double value);
+
+/**
+ * Records a span from construction to destruction (or end()) on the
+ * current thread.
+ */
+class TraceSpan final {
+    char const *mName;
+    int64_t mBeginTime;
+    bool mActive;
+
+public:
+    explicit TraceSpan(char const *name) : mName(name), mBeginTime(0), mActive(isTracing()) {
+        if (mActive) {
+            mBeginTime = trace_detail::now();
+        }
+    }
+    ~TraceSpan() {
+        end();
+    }
+
+    // Can't copy, would record twice.
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    /**
+     * End the span now instead of at destruction.
+     */
+    void end() {
+        if (mActive) {
+            mActive = false;
+            trace_detail::recordSpan(mName, mBeginTime, trace_detail::now());
+        }
+    }
+};
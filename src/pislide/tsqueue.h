@@ -1,31 +1,193 @@
 
 #pragma once
 
-#include <queue>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <optional>
+#include <utility>
 
 /**
- * A thread-safe blocking queue.
+ * What a bounded queue does when an item is enqueued while it's full.
+ */
+enum class OverflowPolicy {
+    // Wait for the consumer to make room.
+    BLOCK,
+    // Discard the oldest item to make room.
+    DROP_OLDEST,
+    // Don't enqueue the new item.
+    REJECT,
+};
+
+/**
+ * Snapshot of a queue's occupancy and overflows.
+ */
+struct QueueStats final {
+    size_t size;
+    // Zero if unbounded.
+    size_t capacity;
+    // Items discarded by DROP_OLDEST.
+    uint64_t dropped;
+    // Items refused by REJECT.
+    uint64_t rejected;
+};
+
+/**
+ * A thread-safe blocking queue. Items are moved in and out, never copied.
+ * Storage is a circular buffer that only grows, so once it has reached its
+ * working size, enqueueing and dequeueing don't allocate.
+ *
+ * Unbounded by default. Call setCapacity() to bound it.
  */
 template <typename T>
 class ThreadSafeQueue {
 private:
-    std::queue<T> mDataQueue;
+    // Circular buffer. Empty slots are nullopt.
+    std::vector<std::optional<T>> mSlots;
+    // Index of the oldest item.
+    size_t mHead = 0;
+    // Number of items.
+    size_t mCount = 0;
+    // Maximum number of items, or zero for unbounded.
+    size_t mCapacity = 0;
+    OverflowPolicy mPolicy = OverflowPolicy::BLOCK;
+    uint64_t mDropped = 0;
+    uint64_t mRejected = 0;
+    // Whether BLOCK producers should give up rather than wait.
+    bool mClosed = false;
     std::mutex mMutex;
+    // Signaled when an item is added.
     std::condition_variable mConditionVariable;
+    // Signaled when an item is removed, for BLOCK producers.
+    std::condition_variable mNotFullConditionVariable;
+
+    /**
+     * Apply the overflow policy if the queue is full. Returns whether
+     * there's now room for an item. Must hold the lock.
+     */
+    bool makeRoom(std::unique_lock<std::mutex> &lock) {
+        if (mCapacity == 0 || mCount < mCapacity) {
+            return true;
+        }
+
+        switch (mPolicy) {
+            case OverflowPolicy::BLOCK:
+                mNotFullConditionVariable.wait(lock, [this]() {
+                    return mCapacity == 0 || mCount < mCapacity || mClosed;
+                });
+                if (mCapacity != 0 && mCount >= mCapacity) {
+                    // Closed while full, nobody is going to make room.
+                    mRejected += 1;
+                    return false;
+                }
+                return true;
+
+            case OverflowPolicy::DROP_OLDEST:
+                while (mCount >= mCapacity) {
+                    pop();
+                    mDropped += 1;
+                }
+                return true;
+
+            case OverflowPolicy::REJECT:
+            default:
+                mRejected += 1;
+                return false;
+        }
+    }
+
+    /**
+     * Make room for one more item. Must hold the lock.
+     */
+    void reserveOne() {
+        if (mCount < mSlots.size()) {
+            return;
+        }
+
+        // Full, double the size and unwrap.
+        std::vector<std::optional<T>> slots(std::max<size_t>(16, mSlots.size()*2));
+        for (size_t i = 0; i < mCount; i++) {
+            // Emplace rather than assign, T might not be assignable.
+            slots[i].emplace(std::move(*mSlots[(mHead + i) % mSlots.size()]));
+        }
+        mSlots = std::move(slots);
+        mHead = 0;
+    }
+
+    /**
+     * Remove and return the oldest item. Must hold the lock and the queue
+     * must not be empty.
+     */
+    T pop() {
+        std::optional<T> &slot = mSlots[mHead];
+        T data = std::move(*slot);
+        slot.reset();
+        mHead = (mHead + 1) % mSlots.size();
+        mCount -= 1;
+        if (mCapacity != 0) {
+            mNotFullConditionVariable.notify_one();
+        }
+        return data;
+    }
 
 public:
+    // Any number of threads may enqueue.
+    static constexpr bool MULTIPLE_PRODUCERS = true;
+
     /**
-     * Enqueues the data.
+     * Bound the queue to "capacity" items (zero for unbounded), and set
+     * what happens when it's full. Items already queued are kept.
      */
-    void enqueue(T data) {
+    void setCapacity(size_t capacity, OverflowPolicy policy) {
         {
             std::lock_guard lock(mMutex);
-            mDataQueue.push(data);
+            mCapacity = capacity;
+            mPolicy = policy;
+        }
+        mNotFullConditionVariable.notify_all();
+    }
+
+    /**
+     * Stop waiting for room. From now on a BLOCK producer that finds the
+     * queue full drops its item instead, so that it can't wait forever on
+     * a consumer that's gone. Items already queued can still be dequeued.
+     */
+    void close() {
+        {
+            std::lock_guard lock(mMutex);
+            mClosed = true;
+        }
+        mNotFullConditionVariable.notify_all();
+    }
+
+    /**
+     * Enqueues the data. Returns whether it was enqueued, which is always
+     * true unless the queue is full and either its policy is REJECT or
+     * it's been closed.
+     */
+    bool enqueue(T &&data) {
+        return emplace(std::move(data));
+    }
+
+    /**
+     * Constructs the data in place at the end of the queue. Returns the
+     * same as enqueue().
+     */
+    template <typename... ARGS>
+    bool emplace(ARGS &&...args) {
+        {
+            std::unique_lock lock(mMutex);
+            if (!makeRoom(lock)) {
+                return false;
+            }
+            reserveOne();
+            mSlots[(mHead + mCount) % mSlots.size()].emplace(std::forward<ARGS>(args)...);
+            mCount += 1;
         }
         mConditionVariable.notify_one();
+        return true;
     }
 
     /**
@@ -33,12 +195,10 @@ public:
      */
     T dequeue() {
         std::unique_lock lock(mMutex);
-        while (mDataQueue.empty()) {
+        while (mCount == 0) {
             mConditionVariable.wait(lock);
         }
-        T data = mDataQueue.front();
-        mDataQueue.pop();
-        return data;
+        return pop();
     }
 
     /**
@@ -46,11 +206,10 @@ public:
      */
     bool try_dequeue(T& data) {
         std::lock_guard lock(mMutex);
-        if (mDataQueue.empty()) {
+        if (mCount == 0) {
             return false;
         }
-        data = mDataQueue.front();
-        mDataQueue.pop();
+        data = pop();
         return true;
     }
 
@@ -59,12 +218,24 @@ public:
      */
     std::optional<T> try_dequeue() {
         std::lock_guard lock(mMutex);
-        if (mDataQueue.empty()) {
+        if (mCount == 0) {
             return std::optional<T>();
         }
-        T data = mDataQueue.front();
-        mDataQueue.pop();
-        return std::make_optional(data);
+        return std::optional<T>(pop());
+    }
+
+    /**
+     * Non-blocking way to dequeue all the data at once. Appends to "out"
+     * and returns the number of items added. Doesn't allocate if "out"
+     * has enough capacity.
+     */
+    size_t drain(std::vector<T> &out) {
+        std::lock_guard lock(mMutex);
+        size_t count = mCount;
+        while (mCount != 0) {
+            out.push_back(pop());
+        }
+        return count;
     }
 
     /**
@@ -72,7 +243,9 @@ public:
      */
     void clear() {
       std::lock_guard lock(mMutex);
-      mDataQueue = {};
+      while (mCount != 0) {
+          pop();
+      }
     }
 
     /**
@@ -80,6 +253,19 @@ public:
      */
     bool empty() {
       std::lock_guard lock(mMutex);
-      return mDataQueue.empty();
+      return mCount == 0;
+    }
+
+    /**
+     * Occupancy and overflow counts.
+     */
+    QueueStats stats() {
+        std::lock_guard lock(mMutex);
+        return QueueStats {
+            .size = mCount,
+            .capacity = mCapacity,
+            .dropped = mDropped,
+            .rejected = mRejected,
+        };
     }
 };
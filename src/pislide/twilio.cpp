@@ -1,5 +1,16 @@
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <set>
+#include <functional>
+#include <stdexcept>
+#include <thread>
 
 #include <cpr/cpr.h>
 #include <nlohmann/json.hpp>
@@ -7,45 +18,52 @@
 #include <spdlog/fmt/std.h>
 
 #include "twilio.h"
+#include "trace.h"
+#include "constants.h"
 
 namespace {
-    static std::string URL_BASE = "https://api.twilio.com";
-
     // We get a 403 fetching images without this:
     static std::string USER_AGENT = "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_14_6) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/78.0.3904.108 Safari/537.36";
 
     /**
-     * The info we need out of each Twilio message.
+     * An image attached to a message.
      */
-    struct TwilioMessage final {
+    struct TwilioMedia final {
+        // Index into the list of messages.
+        size_t messageIndex;
+        std::string sid;
+        std::string contentType;
+        // Of the JSON description. The image is the same without ".json".
         std::string uri;
-        std::string sourcePhoneNumber;
-        std::string dateSent;
-        std::string mediaListUrl;
     };
 
-    // Returns the JSON content of the specified Twilio-relative path (after the
-    // domain name), or a null JSON object if an error occurred.
-    nlohmann::json fetchJson(std::string const &path, Config const &config) {
-        cpr::Response r = cpr::Get(
-                cpr::Url{URL_BASE + path},
-                cpr::Authentication{config.twilioSid, config.twilioToken, cpr::AuthMode::BASIC},
-                cpr::Header{{"User-Agent", USER_AGENT}});
+    // Fetch the JSON at the specified Twilio-relative path (after the
+    // domain name) and parse it with the handler. Returns whether successful.
+    bool fetchJson(cpr::Session &session, std::string const &path,
+            JsonSaxHandler &handler, Config const &config) {
+
+        TraceSpan span("Twilio fetchJson");
+        session.SetUrl(cpr::Url{config.twilioBaseUrl + path});
+        cpr::Response r = session.Get();
         if (r.status_code != 200) {
             spdlog::warn("Got status code {} fetching Twilio information at {}",
                     r.status_code, path);
-            return nullptr;
+            return false;
+        }
+
+        if (!handler.parse(r.text)) {
+            spdlog::warn("Can't parse Twilio information at {} ({})", path, handler.error());
+            return false;
         }
 
-        return nlohmann::json::parse(r.text);
+        return true;
     }
 
     // Delete the specified resource (message or media). Returns whether successful.
-    bool deleteResource(std::string const &path, Config const &config) {
-        cpr::Response r = cpr::Delete(
-                cpr::Url{URL_BASE + path},
-                cpr::Authentication{config.twilioSid, config.twilioToken, cpr::AuthMode::BASIC},
-                cpr::Header{{"User-Agent", USER_AGENT}});
+    bool deleteResource(cpr::Session &session, std::string const &path, Config const &config) {
+        TraceSpan span("Twilio deleteResource");
+        session.SetUrl(cpr::Url{config.twilioBaseUrl + path});
+        cpr::Response r = session.Delete();
         if (r.status_code != 200 && r.status_code != 204) {
             spdlog::warn("Got status code {} deleting Twilio resource at {}",
                     r.status_code, path);
@@ -57,7 +75,10 @@ namespace {
 
     // Download and save the image at the specified Twilio-relative path (after
     // the domain name). Returns whether successful.
-    bool downloadImage(std::string const &path, std::filesystem::path const &pathname) {
+    bool downloadImage(cpr::Session &session, std::string const &path,
+            std::filesystem::path const &pathname, Config const &config) {
+
+        TraceSpan span("Twilio downloadImage");
         spdlog::info("Fetching Twilio photo to {}", pathname);
 
         // Make sure the directory exists.
@@ -69,9 +90,8 @@ namespace {
 
         // Stream the file.
         std::ofstream f(pathname, std::ios::binary);
-        cpr::Response r = cpr::Download(f,
-                cpr::Url{URL_BASE + path},
-                cpr::Header{{"User-Agent", USER_AGENT}});
+        session.SetUrl(cpr::Url{config.twilioBaseUrl + path});
+        cpr::Response r = session.Download(f);
         if (r.status_code != 200) {
             spdlog::warn("Got status code {} fetching Twilio image at {}",
                     r.status_code, path);
@@ -80,76 +100,583 @@ namespace {
         return true;
     }
 
-    // Return top-level message information, or an empty vector if it can't be fetched.
-    std::vector<std::shared_ptr<TwilioMessage>> fetchMessages(Config const &config) {
-        std::vector<std::shared_ptr<TwilioMessage>> messages;
+    /**
+     * Call fn(i, session) for each i in [0, count), on as many threads as the
+     * pool has sessions, each thread with its own session. Returns when all
+     * calls have returned. An exception only fails its own item, and returns
+     * false for it; otherwise the results are what fn returned.
+     */
+    std::vector<bool> forEachInParallel(TwilioSessionPool &sessionPool, size_t count,
+            std::function<bool(size_t, cpr::Session &)> const &fn) {
 
-        std::string path = "/2010-04-01/Accounts/" + config.twilioSid + "/Messages.json";
-        auto j = fetchJson(path, config);
-        if (j == nullptr) {
-            // Error already printed.
-            return messages;
+        // Not vector<bool>, its elements can't be written from different threads.
+        std::vector<uint8_t> results(count, false);
+        std::atomic<size_t> nextIndex = 0;
+
+        auto work = [&sessionPool, &fn, &results, &nextIndex, count]() {
+            TwilioSessionPool::Lease lease = sessionPool.acquire();
+            for (size_t i = nextIndex++; i < count; i = nextIndex++) {
+                try {
+                    results[i] = fn(i, lease.session());
+                } catch (std::exception const &e) {
+                    spdlog::warn("Twilio request failed ({})", e.what());
+                }
+            }
+        };
+
+        // This thread does its share too.
+        size_t threadCount = std::min(count, sessionPool.maxSessions());
+        {
+            std::vector<std::jthread> threads;
+            for (size_t i = 1; i < threadCount; i++) {
+                threads.emplace_back([&work, i]() {
+                    std::string threadName = "Twilio " + std::to_string(i);
+                    traceThreadName(threadName.c_str());
+                    work();
+                });
+            }
+            if (threadCount > 0) {
+                work();
+            }
         }
 
-        for (auto const &jmsg : j["messages"]) {
-            int numMedia = std::stoi(jmsg["num_media"].get<std::string>());
-            if (numMedia > 0 && jmsg["direction"] == "inbound") {
-                messages.emplace_back(std::make_shared<TwilioMessage>(TwilioMessage{
-                    .uri = jmsg["uri"],
-                    .sourcePhoneNumber = jmsg["from"],
-                    .dateSent = jmsg["date_sent"],
-                    .mediaListUrl = jmsg["subresource_uris"]["media"],
-                }));
+        return std::vector<bool>(results.begin(), results.end());
+    }
+
+    // Parse a Twilio date, such as "Sat, 01 Nov 2025 20:00:00 +0000", to
+    // seconds since the epoch. Twilio always sends them in UTC.
+    std::optional<int64_t> parseTwilioDate(std::string const &date) {
+        struct std::tm tm = {};
+        char *p = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S +0000", &tm);
+        if (p == nullptr || *p != '\0') {
+            return std::nullopt;
+        }
+        return timegm(&tm);
+    }
+
+    // Format the UTC day of the time for the DateSent filter, such as "2025-11-01".
+    std::string formatTwilioDay(int64_t time) {
+        std::time_t t = time;
+        struct std::tm tm = {};
+        gmtime_r(&t, &tm);
+        char buf[16];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+        return buf;
+    }
+
+    // List messages starting at "path", up to "maxPages" pages, stopping at
+    // messages sent before "floor". Returns the inbound messages with images
+    // that haven't been processed yet. On error returns what it got so far,
+    // marked as truncated.
+    TwilioMessageList listMessages(cpr::Session &session, TwilioPollState const &pollState,
+            std::string path, int64_t floor, int maxPages, Config const &config) {
+
+        TwilioMessageList list;
+
+        for (int page = 0; !path.empty(); page++) {
+            if (page == maxPages) {
+                list.truncated = true;
+                list.nextPageUri = std::move(path);
+                break;
+            }
+
+            TwilioMessagePageParser parser(pollState, list, floor);
+            if (!fetchJson(session, path, parser, config)) {
+                // Error already printed.
+                list.truncated = true;
+                break;
             }
+            path = parser.nextPageUri();
+        }
+
+        return list;
+    }
+
+    // Return the inbound messages with images that were sent after the poll
+    // state's high-water mark and haven't been processed yet.
+    TwilioMessageList fetchMessages(cpr::Session &session, TwilioPollState const &pollState,
+            Config const &config) {
+
+        // Twilio lists newest first and only filters by day, so ask for
+        // the high-water mark's day and onward. Parsing stops paging once
+        // it reaches the mark itself.
+        std::string path = "/2010-04-01/Accounts/" + config.twilioSid + "/Messages.json"
+            "?PageSize=" + std::to_string(TWILIO_MESSAGE_PAGE_SIZE);
+        if (pollState.highWaterMark() > 0) {
+            path += "&DateSent%3E=" + formatTwilioDay(pollState.highWaterMark());
+        }
+
+        TwilioMessageList list = listMessages(session, pollState, std::move(path),
+                pollState.highWaterMark(), TWILIO_MAX_MESSAGE_PAGES, config);
+        if (!list.nextPageUri.empty()) {
+            spdlog::warn("Twilio: Stopped listing messages after {} pages, "
+                    "will list the older ones later", TWILIO_MAX_MESSAGE_PAGES);
+        }
+
+        return list;
+    }
+
+    /**
+     * Picks the JPEG images out of a message's media list.
+     */
+    class MediaListParser final : public JsonSaxHandler {
+        size_t mMessageIndex;
+        std::vector<TwilioMedia> &mMediaList;
+
+        // Fields of the media being parsed.
+        std::string mSid;
+        std::string mContentType;
+        std::string mUri;
+
+    protected:
+        void onString(std::string &value) override {
+            if (isAt({"media_list", "", "sid"})) {
+                mSid = std::move(value);
+            } else if (isAt({"media_list", "", "content_type"})) {
+                mContentType = std::move(value);
+            } else if (isAt({"media_list", "", "uri"})) {
+                mUri = std::move(value);
+            }
+        }
+
+        void onEndObject() override {
+            if (isAt({"media_list", ""})) {
+                if (mContentType == "image/jpeg" && mUri.ends_with(".json") && !mSid.empty()) {
+                    mMediaList.emplace_back(TwilioMedia {
+                        .messageIndex = mMessageIndex,
+                        .sid = std::move(mSid),
+                        .contentType = std::move(mContentType),
+                        .uri = std::move(mUri),
+                    });
+                }
+                mSid.clear();
+                mContentType.clear();
+                mUri.clear();
+            }
+        }
+
+    public:
+        MediaListParser(size_t messageIndex, std::vector<TwilioMedia> &mediaList)
+            : mMessageIndex(messageIndex), mMediaList(mediaList) {}
+    };
+
+    // Return the JPEG images attached to the message. Throws if the list
+    // can't be fetched.
+    std::vector<TwilioMedia> fetchMediaList(cpr::Session &session, size_t messageIndex,
+            TwilioMessage const &message, Config const &config) {
+
+        std::vector<TwilioMedia> mediaList;
+
+        MediaListParser parser(messageIndex, mediaList);
+        if (!fetchJson(session, message.mediaListUrl, parser, config)) {
+            throw std::runtime_error("can't fetch media list for " + message.uri);
+        }
+
+        return mediaList;
+    }
+}
+
+TwilioMessagePageParser::TwilioMessagePageParser(TwilioPollState const &pollState,
+        TwilioMessageList &list, int64_t floor)
+    : mPollState(pollState), mList(list), mFloor(floor) {}
+
+void TwilioMessagePageParser::onString(std::string &value) {
+    if (isAt({"messages", "", "sid"})) {
+        mSid = std::move(value);
+    } else if (isAt({"messages", "", "uri"})) {
+        mUri = std::move(value);
+    } else if (isAt({"messages", "", "num_media"})) {
+        mNumMedia = std::move(value);
+    } else if (isAt({"messages", "", "direction"})) {
+        mDirection = std::move(value);
+    } else if (isAt({"messages", "", "from"})) {
+        mFrom = std::move(value);
+    } else if (isAt({"messages", "", "date_sent"})) {
+        mDateSent = std::move(value);
+    } else if (isAt({"messages", "", "subresource_uris", "media"})) {
+        mMediaListUrl = std::move(value);
+    } else if (isAt({"next_page_uri"})) {
+        mNextPageUri = std::move(value);
+    }
+}
+
+void TwilioMessagePageParser::onEndObject() {
+    if (isAt({"messages", ""})) {
+        finishMessage();
+
+        mSid.clear();
+        mUri.clear();
+        mNumMedia.clear();
+        mDirection.clear();
+        mFrom.clear();
+        mDateSent.clear();
+        mMediaListUrl.clear();
+    }
+}
+
+void TwilioMessagePageParser::finishMessage() {
+    // Messages are newest first, so the rest of them are old too.
+    if (mReachedMark) {
+        return;
+    }
+
+    std::optional<int64_t> dateSentTime = parseTwilioDate(mDateSent);
+    if (!dateSentTime.has_value()) {
+        // Queued and sending messages have no date yet. They're not
+        // inbound, but if one is we'll see it again once it has a date.
+        spdlog::debug("Twilio: Skipping message {} with date \"{}\"", mSid, mDateSent);
+        return;
+    }
+
+    // Messages in the high-water mark's second may have arrived after we
+    // last listed them, so keep going and rely on the SIDs for those.
+    if (*dateSentTime < mFloor) {
+        mReachedMark = true;
+        return;
+    }
+    mList.newestListedTime = std::max(mList.newestListedTime, *dateSentTime);
+
+    int numMedia = 0;
+    std::from_chars(mNumMedia.data(), mNumMedia.data() + mNumMedia.size(), numMedia);
+    if (numMedia == 0 || mDirection != "inbound" || mSid.empty()) {
+        return;
+    }
+    mList.newestTime = std::max(mList.newestTime, *dateSentTime);
+
+    if (!mPollState.hasMessage(mSid)) {
+        mList.messages.emplace_back(std::make_shared<TwilioMessage>(TwilioMessage{
+            .sid = std::move(mSid),
+            .uri = std::move(mUri),
+            .sourcePhoneNumber = std::move(mFrom),
+            .dateSent = std::move(mDateSent),
+            .dateSentTime = *dateSentTime,
+            .mediaListUrl = std::move(mMediaListUrl),
+        }));
+    }
+}
+
+TwilioSessionPool::Lease::Lease(TwilioSessionPool &pool, std::unique_ptr<cpr::Session> session)
+    : mPool(pool), mSession(std::move(session)) {}
+
+TwilioSessionPool::Lease::~Lease() {
+    std::lock_guard lock(mPool.mMutex);
+    mPool.mIdleSessions.push_back(std::move(mSession));
+}
+
+TwilioSessionPool::TwilioSessionPool(Config const &config, size_t maxSessions)
+    : mConfig(config), mMaxSessions(std::max(maxSessions, size_t(1))) {}
+
+TwilioSessionPool::~TwilioSessionPool() = default;
+
+TwilioSessionPool::Lease TwilioSessionPool::acquire() {
+    {
+        std::lock_guard lock(mMutex);
+        if (!mIdleSessions.empty()) {
+            std::unique_ptr<cpr::Session> session = std::move(mIdleSessions.back());
+            mIdleSessions.pop_back();
+            return Lease(*this, std::move(session));
+        }
+    }
+
+    // Everything we send is authenticated and has the same user agent.
+    auto session = std::make_unique<cpr::Session>();
+    session->SetAuth(cpr::Authentication{mConfig.twilioSid, mConfig.twilioToken, cpr::AuthMode::BASIC});
+    session->SetHeader(cpr::Header{{"User-Agent", USER_AGENT}});
+    return Lease(*this, std::move(session));
+}
+
+TwilioPollState::TwilioPollState(std::filesystem::path pathname)
+    : mPathname(std::move(pathname)) {}
+
+void TwilioPollState::load() {
+    if (mPathname.empty() || !std::filesystem::exists(mPathname)) {
+        return;
+    }
+
+    try {
+        std::ifstream f(mPathname);
+        auto j = nlohmann::json::parse(f);
+        mHighWaterMark = j.at("high_water_mark").get<int64_t>();
+        mMessages = j.at("messages").get<std::map<std::string,int64_t>>();
+        mMedia = j.at("media").get<std::map<std::string,int64_t>>();
+
+        // Not in files from older versions.
+        for (auto const &item : j.value("retries", nlohmann::json::array())) {
+            TwilioRetry retry {
+                .message = TwilioMessage {
+                    .sid = item.at("sid").get<std::string>(),
+                    .uri = item.at("uri").get<std::string>(),
+                    .sourcePhoneNumber = item.at("from").get<std::string>(),
+                    .dateSent = item.at("date_sent").get<std::string>(),
+                    .dateSentTime = item.at("date_sent_time").get<int64_t>(),
+                    .mediaListUrl = item.at("media_list_url").get<std::string>(),
+                },
+                .attempts = item.at("attempts").get<int>(),
+            };
+            mRetries.emplace(retry.message.sid, std::move(retry));
+        }
+        for (auto const &item : j.value("backlogs", nlohmann::json::array())) {
+            mBacklogs.push_back(TwilioBacklog {
+                .uri = item.at("uri").get<std::string>(),
+                .floor = item.at("floor").get<int64_t>(),
+            });
         }
 
-        return messages;
+        spdlog::info("Twilio: Loaded poll state from {} ({} messages, {} media, {} retries, {} backlogs)",
+                mPathname, mMessages.size(), mMedia.size(), mRetries.size(), mBacklogs.size());
+    } catch (std::exception const &e) {
+        spdlog::warn("Twilio: Ignoring bad poll state file {} ({})", mPathname, e.what());
+        mHighWaterMark = 0;
+        mMessages.clear();
+        mMedia.clear();
+        mRetries.clear();
+        mBacklogs.clear();
     }
 }
 
+void TwilioPollState::save() {
+    if (mPathname.empty() || !mDirty) {
+        return;
+    }
+
+    nlohmann::json retries = nlohmann::json::array();
+    for (auto const &[sid, retry] : mRetries) {
+        retries.push_back({
+            { "sid", retry.message.sid },
+            { "uri", retry.message.uri },
+            { "from", retry.message.sourcePhoneNumber },
+            { "date_sent", retry.message.dateSent },
+            { "date_sent_time", retry.message.dateSentTime },
+            { "media_list_url", retry.message.mediaListUrl },
+            { "attempts", retry.attempts },
+        });
+    }
+    nlohmann::json backlogs = nlohmann::json::array();
+    for (auto const &backlog : mBacklogs) {
+        backlogs.push_back({
+            { "uri", backlog.uri },
+            { "floor", backlog.floor },
+        });
+    }
+
+    nlohmann::json j = {
+        { "high_water_mark", mHighWaterMark },
+        { "messages", mMessages },
+        { "media", mMedia },
+        { "retries", retries },
+        { "backlogs", backlogs },
+    };
+
+    // Write to the side so a crash doesn't leave a partial file.
+    std::filesystem::path tmpPathname = mPathname;
+    tmpPathname += ".tmp";
+    {
+        std::ofstream f(tmpPathname);
+        f << j.dump(2) << '\n';
+        if (!f) {
+            spdlog::warn("Twilio: Can't write poll state to {}", tmpPathname);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPathname, mPathname, ec);
+    if (ec) {
+        spdlog::warn("Twilio: Can't rename {} to {} ({})", tmpPathname, mPathname, ec.message());
+        return;
+    }
+    mDirty = false;
+}
+
+void TwilioPollState::addFailure(TwilioMessage const &message) {
+    auto [itr, inserted] = mRetries.try_emplace(message.sid, TwilioRetry { message, 0 });
+    itr->second.attempts += 1;
+    mDirty = true;
+
+    if (itr->second.attempts >= TWILIO_MAX_MESSAGE_ATTEMPTS) {
+        spdlog::error("Twilio: Giving up on message {} after {} attempts",
+                message.uri, itr->second.attempts);
+        addMessage(message.sid, message.dateSentTime);
+    } else {
+        spdlog::warn("Twilio: Will retry message {} ({} attempts)",
+                message.uri, itr->second.attempts);
+    }
+}
+
+std::vector<std::shared_ptr<TwilioMessage>> TwilioPollState::retryMessages() const {
+    std::vector<std::shared_ptr<TwilioMessage>> messages;
+    for (auto const &[sid, retry] : mRetries) {
+        messages.push_back(std::make_shared<TwilioMessage>(retry.message));
+    }
+    std::ranges::sort(messages, std::greater(), &TwilioMessage::dateSentTime);
+    return messages;
+}
+
+void TwilioPollState::addBacklog(TwilioBacklog backlog) {
+    mBacklogs.push_back(std::move(backlog));
+    mDirty = true;
+}
+
+void TwilioPollState::advanceBacklog(std::string uri) {
+    if (uri.empty()) {
+        mBacklogs.pop_back();
+    } else {
+        mBacklogs.back().uri = std::move(uri);
+    }
+    mDirty = true;
+}
+
+void TwilioPollState::setHighWaterMark(int64_t highWaterMark) {
+    if (highWaterMark <= mHighWaterMark) {
+        return;
+    }
+    mHighWaterMark = highWaterMark;
+    mDirty = true;
+
+    // Anything before the mark is skipped by date, we don't need its SID.
+    // Messages in the mark's second are listed again and skipped by SID.
+    std::erase_if(mMessages, [this](auto const &item) { return item.second < mHighWaterMark; });
+    std::erase_if(mMedia, [this](auto const &item) { return item.second < mHighWaterMark; });
+}
+
 std::vector<std::shared_ptr<TwilioImage>> downloadTwilioImages(
+        TwilioSessionPool &sessionPool,
+        TwilioPollState &pollState,
         bool deleteMessages, bool deleteImages,
         Config const &config) {
 
     std::vector<std::shared_ptr<TwilioImage>> images;
 
     spdlog::info("Twilio: Fetching messages");
-    auto messages = fetchMessages(config);
-    for (auto message : messages) {
-        spdlog::debug("Twilio: Processing message {}", message->uri);
-        bool allSuccess = true;
-        if (!message->mediaListUrl.empty()) {
-            auto medias = fetchJson(message->mediaListUrl, config);
-            for (auto const &media : medias["media_list"]) {
-                std::string contentType = media["content_type"];
-                std::string photoSid = media["sid"];
-                std::string mediaUri = media["uri"];
-                if (contentType == "image/jpeg" && mediaUri.ends_with(".json")) {
-                    std::string imageUri = mediaUri.substr(0, mediaUri.length() - 5);
-                    std::filesystem::path imagePathname = config.twilioSubdir / (photoSid + ".jpg");
-                    bool success = downloadImage(imageUri, config.rootDir / imagePathname);
-                    if (success) {
-                        images.emplace_back(std::make_shared<TwilioImage>(
-                                    TwilioImage{
-                                        .pathname = imagePathname,
-                                        .contentType = contentType,
-                                        .sourcePhoneNumber = message->sourcePhoneNumber,
-                                        .dateSent = message->dateSent
-                                    }));
-                        if (deleteImages) {
-                            deleteResource(mediaUri, config);
-                        }
-                    } else {
-                        allSuccess = false;
+    TwilioMessageList list;
+    TwilioMessageList backlogList;
+    TwilioBacklog const *backlog = pollState.backlog();
+    {
+        TwilioSessionPool::Lease lease = sessionPool.acquire();
+        list = fetchMessages(lease.session(), pollState, config);
+
+        // Work through older messages a little at a time.
+        if (backlog != nullptr) {
+            spdlog::info("Twilio: Listing backlog");
+            backlogList = listMessages(lease.session(), pollState, backlog->uri,
+                    backlog->floor, TWILIO_BACKLOG_PAGES_PER_POLL, config);
+        }
+    }
+
+    // New messages, then older ones, then ones that failed before. A
+    // message that's listed and also to be retried only goes in once.
+    std::vector<std::shared_ptr<TwilioMessage>> messages = std::move(list.messages);
+    messages.insert(messages.end(), backlogList.messages.begin(), backlogList.messages.end());
+    std::set<std::string> listedSids;
+    for (auto const &message : messages) {
+        listedSids.insert(message->sid);
+    }
+    for (auto &message : pollState.retryMessages()) {
+        if (!listedSids.contains(message->sid)) {
+            messages.push_back(std::move(message));
+        }
+    }
+
+    // Get all the media lists at once. The poll state is only read
+    // until all the requests are done.
+    std::vector<std::vector<TwilioMedia>> mediaLists(messages.size());
+    std::vector<bool> mediaListSuccess = forEachInParallel(sessionPool, messages.size(),
+            [&messages, &mediaLists, &pollState, &config](size_t i, cpr::Session &session) {
+                spdlog::debug("Twilio: Processing message {}", messages[i]->uri);
+                if (!messages[i]->mediaListUrl.empty()) {
+                    mediaLists[i] = fetchMediaList(session, i, *messages[i], config);
+                    // Skip images we got in an earlier poll.
+                    std::erase_if(mediaLists[i], [&pollState](TwilioMedia const &media) {
+                        return pollState.hasMedia(media.sid);
+                    });
+                }
+                return true;
+            });
+
+    // Then all the images.
+    std::vector<TwilioMedia> allMedia;
+    for (auto &mediaList : mediaLists) {
+        allMedia.insert(allMedia.end(),
+                std::make_move_iterator(mediaList.begin()),
+                std::make_move_iterator(mediaList.end()));
+    }
+    std::vector<std::shared_ptr<TwilioImage>> downloadedImages(allMedia.size());
+    std::vector<bool> downloadSuccess = forEachInParallel(sessionPool, allMedia.size(),
+            [&messages, &allMedia, &downloadedImages, &config, deleteImages](
+                size_t i, cpr::Session &session) {
+
+                TwilioMedia const &media = allMedia[i];
+                TwilioMessage const &message = *messages[media.messageIndex];
+                std::string imageUri = media.uri.substr(0, media.uri.length() - 5);
+                std::filesystem::path imagePathname = config.twilioSubdir / (media.sid + ".jpg");
+                bool success = downloadImage(session, imageUri, config.rootDir / imagePathname, config);
+                if (success) {
+                    downloadedImages[i] = std::make_shared<TwilioImage>(
+                            TwilioImage{
+                                .pathname = imagePathname,
+                                .contentType = media.contentType,
+                                .sourcePhoneNumber = message.sourcePhoneNumber,
+                                .dateSent = message.dateSent
+                            });
+                    if (deleteImages) {
+                        deleteResource(session, media.uri, config);
                     }
                 }
-            }
+                return success;
+            });
+
+    // Keep the images in message order, and remember them.
+    for (size_t i = 0; i < allMedia.size(); i++) {
+        if (downloadedImages[i]) {
+            pollState.addMedia(allMedia[i].sid, messages[allMedia[i].messageIndex]->dateSentTime);
+            images.push_back(std::move(downloadedImages[i]));
+        }
+    }
+
+    // A message is done when we got all its images.
+    std::vector<bool> allSuccess = mediaListSuccess;
+    for (size_t i = 0; i < allMedia.size(); i++) {
+        if (!downloadSuccess[i]) {
+            allSuccess[allMedia[i].messageIndex] = false;
         }
-        if (deleteMessages && allSuccess) {
-            deleteResource(message->uri, config);
+    }
+
+    // Messages that failed are retried on their own, so they don't hold
+    // back the high-water mark.
+    std::vector<std::string> toDelete;
+    for (size_t i = 0; i < messages.size(); i++) {
+        if (allSuccess[i]) {
+            pollState.addMessage(messages[i]->sid, messages[i]->dateSentTime);
+            toDelete.push_back(messages[i]->uri);
+        } else {
+            pollState.addFailure(*messages[i]);
         }
     }
 
+    // Move on through the backlog unless listing the backlog failed.
+    if (backlog != nullptr && (!backlogList.truncated || !backlogList.nextPageUri.empty())) {
+        pollState.advanceBacklog(std::move(backlogList.nextPageUri));
+    }
+
+    // If we stopped at the page limit, everything we listed is handled
+    // and the rest, down to the old mark, is left for a new backlog.
+    if (!list.nextPageUri.empty()) {
+        pollState.addBacklog(TwilioBacklog {
+            .uri = std::move(list.nextPageUri),
+            .floor = pollState.highWaterMark(),
+        });
+        pollState.setHighWaterMark(list.newestListedTime);
+    } else if (!list.truncated) {
+        pollState.setHighWaterMark(list.newestTime);
+    }
+
+    // Delete the messages whose images we all got.
+    if (deleteMessages) {
+        forEachInParallel(sessionPool, toDelete.size(),
+                [&toDelete, &config](size_t i, cpr::Session &session) {
+                    return deleteResource(session, toDelete[i], config);
+                });
+    }
+
     return images;
 }
 
@@ -169,19 +696,25 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    TwilioSessionPool sessionPool(config, TWILIO_MAX_PARALLEL_REQUESTS);
+    TwilioPollState pollState(config.twilioStateFile);
+    pollState.load();
+
     if (false) {
-        auto messages = fetchMessages(config);
-        for (auto message : messages) {
+        TwilioSessionPool::Lease lease = sessionPool.acquire();
+        auto list = fetchMessages(lease.session(), pollState, config);
+        for (auto message : list.messages) {
             spdlog::info("{} {} {}", message->sourcePhoneNumber,
                     message->dateSent, message->mediaListUrl);
         }
     }
     if (true) {
-        auto images = downloadTwilioImages(false, true, config);
+        auto images = downloadTwilioImages(sessionPool, pollState, false, true, config);
         for (auto image : images) {
             spdlog::info("{} {} {}", image->sourcePhoneNumber,
                     image->dateSent, image->pathname);
         }
+        pollState.save();
     }
 }
 #endif
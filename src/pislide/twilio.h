@@ -4,9 +4,17 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <cstdint>
 
 #include "config.h"
+#include "jsonsax.h"
+
+namespace cpr {
+    class Session;
+}
 
 /**
  * Information about downloaded Twilio image.
@@ -19,13 +27,266 @@ struct TwilioImage final {
 };
 
 /**
- * Connects to Twilio, downloads available messages, downloads their
- * images to files on disk, and optionally deletes the images and/or messages.
+ * HTTP sessions for talking to Twilio, kept between fetches. Each session
+ * keeps its connection open, so only its first request pays for the TLS
+ * handshake. The number of sessions bounds how many requests are made at
+ * once. Thread-safe.
+ */
+class TwilioSessionPool final {
+    Config const &mConfig;
+    size_t mMaxSessions;
+
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<cpr::Session>> mIdleSessions;
+
+public:
+    /**
+     * A session checked out of the pool. Returned to the pool on destruction.
+     */
+    class Lease final {
+        TwilioSessionPool &mPool;
+        std::unique_ptr<cpr::Session> mSession;
+
+    public:
+        Lease(TwilioSessionPool &pool, std::unique_ptr<cpr::Session> session);
+        ~Lease();
+
+        // Can't copy, would return the session twice.
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        cpr::Session &session() {
+            return *mSession;
+        }
+    };
+
+    TwilioSessionPool(Config const &config, size_t maxSessions);
+    ~TwilioSessionPool();
+
+    // Can't copy.
+    TwilioSessionPool(const TwilioSessionPool &) = delete;
+    TwilioSessionPool &operator=(const TwilioSessionPool &) = delete;
+
+    /**
+     * Maximum number of sessions, and so of requests in flight.
+     */
+    size_t maxSessions() const {
+        return mMaxSessions;
+    }
+
+    /**
+     * Check out an idle session, or make a new one. Callers must not hold
+     * more than maxSessions() leases at once between them.
+     */
+    Lease acquire();
+};
+
+/**
+ * The info we need out of each Twilio message.
+ */
+struct TwilioMessage final {
+    std::string sid;
+    std::string uri;
+    std::string sourcePhoneNumber;
+    std::string dateSent;
+    // Parsed dateSent, in seconds since the epoch.
+    int64_t dateSentTime;
+    std::string mediaListUrl;
+};
+
+/**
+ * A message that we failed to process, to try again on later polls.
+ */
+struct TwilioRetry final {
+    TwilioMessage message;
+    // Number of polls that failed to process it.
+    int attempts;
+};
+
+/**
+ * Where to continue listing messages that are older than the ones a poll
+ * got to before hitting its page limit.
+ */
+struct TwilioBacklog final {
+    // Path of the next page to list.
+    std::string uri;
+    // Listing can stop at messages before this time.
+    int64_t floor;
+};
+
+/**
+ * What we've already fetched from Twilio, so that each poll only asks for
+ * new messages. Saved to a file between runs. Not thread-safe.
+ */
+class TwilioPollState final {
+    std::filesystem::path mPathname;
+    // Every message sent at or before this time (seconds since the epoch)
+    // has been processed. Zero if we've never fetched.
+    int64_t mHighWaterMark = 0;
+    // Whether anything changed since we loaded or saved the file.
+    bool mDirty = false;
+    // SIDs of processed messages and of downloaded media, each with the
+    // time its message was sent, for pruning.
+    std::map<std::string,int64_t> mMessages;
+    std::map<std::string,int64_t> mMedia;
+    // Messages that failed, by SID. They don't hold back the high-water
+    // mark, they're fetched directly until they work or we give up.
+    std::map<std::string,TwilioRetry> mRetries;
+    // Older messages not yet listed, most recent last.
+    std::vector<TwilioBacklog> mBacklogs;
+
+public:
+    /**
+     * State saved in the given file, or only in memory if the pathname is empty.
+     */
+    explicit TwilioPollState(std::filesystem::path pathname);
+
+    /**
+     * Read the file, if any. Starts from scratch if it's missing or bad.
+     */
+    void load();
+
+    /**
+     * Write the file, if any, and if anything changed since it was
+     * loaded or last saved.
+     */
+    void save();
+
+    int64_t highWaterMark() const {
+        return mHighWaterMark;
+    }
+
+    bool hasMessage(std::string const &sid) const {
+        return mMessages.contains(sid);
+    }
+
+    bool hasMedia(std::string const &sid) const {
+        return mMedia.contains(sid);
+    }
+
+    void addMessage(std::string const &sid, int64_t dateSent) {
+        mMessages[sid] = dateSent;
+        mRetries.erase(sid);
+        mDirty = true;
+    }
+
+    /**
+     * Record that the message failed, to try again on later polls. After
+     * TWILIO_MAX_MESSAGE_ATTEMPTS failures it's given up on and treated
+     * as processed.
+     */
+    void addFailure(TwilioMessage const &message);
+
+    /**
+     * Messages to try again, newest first.
+     */
+    std::vector<std::shared_ptr<TwilioMessage>> retryMessages() const;
+
+    /**
+     * The backlog to list next, or null if there's none.
+     */
+    TwilioBacklog const *backlog() const {
+        return mBacklogs.empty() ? nullptr : &mBacklogs.back();
+    }
+
+    /**
+     * Add a backlog of messages older than a truncated listing.
+     */
+    void addBacklog(TwilioBacklog backlog);
+
+    /**
+     * Continue the backlog returned by backlog() at this path, or drop it if
+     * the path is empty.
+     */
+    void advanceBacklog(std::string uri);
+
+    void addMedia(std::string const &sid, int64_t dateSent) {
+        mMedia[sid] = dateSent;
+        mDirty = true;
+    }
+
+    /**
+     * Raise the high-water mark and forget messages and media that are
+     * too old to be listed again.
+     */
+    void setHighWaterMark(int64_t highWaterMark);
+};
+
+/**
+ * The messages listed by one poll.
+ */
+struct TwilioMessageList final {
+    // New messages with images, newest first.
+    std::vector<std::shared_ptr<TwilioMessage>> messages;
+    // Date of the newest inbound message with images listed, whether or
+    // not it's new. Zero if none.
+    int64_t newestTime = 0;
+    // Date of the newest message listed, of any kind. Zero if none.
+    int64_t newestListedTime = 0;
+    // Whether we stopped paging before reaching the floor, so older
+    // messages might be missing.
+    bool truncated = false;
+    // If we stopped at the page limit, where to continue.
+    std::string nextPageUri;
+};
+
+/**
+ * Parses one page of Twilio's message list, adding the inbound messages
+ * with images that were sent at or after the floor and haven't been
+ * processed to the list. Only the fields we need are kept.
+ */
+class TwilioMessagePageParser final : public JsonSaxHandler {
+    TwilioPollState const &mPollState;
+    TwilioMessageList &mList;
+    // Usually the high-water mark.
+    int64_t mFloor;
+    std::string mNextPageUri;
+    // Whether we've reached a message before the floor.
+    bool mReachedMark = false;
+
+    // Fields of the message being parsed.
+    std::string mSid;
+    std::string mUri;
+    std::string mNumMedia;
+    std::string mDirection;
+    std::string mFrom;
+    std::string mDateSent;
+    std::string mMediaListUrl;
+
+    // Add the message we just parsed to the list, if it's wanted.
+    void finishMessage();
+
+protected:
+    void onString(std::string &value) override;
+    void onEndObject() override;
+
+public:
+    TwilioMessagePageParser(TwilioPollState const &pollState, TwilioMessageList &list,
+            int64_t floor);
+
+    /**
+     * Path of the next page to fetch, or empty if this is the last page or
+     * the rest are before the floor.
+     */
+    std::string nextPageUri() const {
+        return mReachedMark ? "" : mNextPageUri;
+    }
+};
+
+/**
+ * Connects to Twilio, downloads messages that are newer than the poll
+ * state's high-water mark (plus a page of its backlog, if any, and the
+ * messages that failed on earlier polls), downloads their images to files on disk, and
+ * optionally deletes the images and/or messages. Media lists, images, and
+ * deletions are fetched in parallel, up to the session pool's limit. The
+ * poll state is updated (but not saved) with what was fetched.
  *
- * Returns the list of downloaded images. If something goes wrong, returns
- * an empty vector.
+ * Returns the list of downloaded images, in message order. If something
+ * goes wrong, returns an empty vector.
  */
 std::vector<std::shared_ptr<TwilioImage>> downloadTwilioImages(
+        TwilioSessionPool &sessionPool,
+        TwilioPollState &pollState,
         bool deleteMessages, bool deleteImages,
         Config const &config);
 
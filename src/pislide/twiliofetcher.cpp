@@ -1,24 +1,56 @@
 
 #include <iostream>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 
 #include "twiliofetcher.h"
 #include "util.h"
+#include "metrics.h"
+#include "constants.h"
 
-TwilioFetcher::TwilioFetcher(Config const &config)
-    : mExecutor(1, []<typename T0>(T0 && PH1) { return fetchImagesInThread(std::forward<T0>(PH1)); }),
-    mConfig(config) {}
+TwilioFetcher::TwilioFetcher(Config const &config, ThreadPool &threadPool)
+    : mThreadPool(threadPool), mConfig(config),
+    mSessionPool(std::make_shared<TwilioSessionPool>(config, TWILIO_MAX_PARALLEL_REQUESTS)),
+    mPollState(std::make_shared<TwilioPollState>(config.twilioStateFile)) {
+
+    mPollState->load();
+}
 
 void TwilioFetcher::initiateFetch() {
     if (!mConfig.twilioSid.empty() && !mConfig.twilioToken.empty()) {
         // We don't want these to queue up, one is enough.
+        if (mFetching) {
+            return;
+        }
+        mFetching = true;
+
         spdlog::info("TwilioFetcher: Initiating fetch");
-        mExecutor.clearRequestQueue();
-        mExecutor.ask(Request {
-            .deleteMessages = mDeleteMessages,
-            .deleteImages = mDeleteImages,
-            .config = mConfig,
+        runAsync(mThreadPool, TaskClass::NETWORK,
+                [deleteMessages = mDeleteMessages, deleteImages = mDeleteImages, &config = mConfig,
+                 sessionPool = mSessionPool, pollState = mPollState]() {
+
+            spdlog::info("TwilioFetcher: Fetch in thread");
+            HistogramTimer timer(metrics().twilioFetchTime);
+            try {
+                auto images = downloadTwilioImages(*sessionPool, *pollState,
+                        deleteMessages, deleteImages, config);
+                pollState->save();
+                return images;
+            } catch (std::exception const &e) {
+                spdlog::error("TwilioFetcher: Fetch failed ({})", e.what());
+                metrics().twilioFetchFailures.add();
+                return std::vector<std::shared_ptr<TwilioImage>>();
+            }
+        }).onMainThread([this](std::vector<std::shared_ptr<TwilioImage>> &&images) {
+            mFetching = false;
+            mImages.insert(mImages.end(),
+                    std::make_move_iterator(images.begin()),
+                    std::make_move_iterator(images.end()));
+        }, [this](std::exception_ptr) {
+            // Anything that wasn't a std::exception. Logged by the future.
+            mFetching = false;
+            metrics().twilioFetchFailures.add();
         });
     }
 }
@@ -32,16 +64,5 @@ void TwilioFetcher::initiateFetch(double throttleSeconds) {
 }
 
 std::vector<std::shared_ptr<TwilioImage>> TwilioFetcher::get() {
-    std::optional<Response> response = mExecutor.get();
-    return response.has_value()
-        ? response->images
-        : std::vector<std::shared_ptr<TwilioImage>>();
-}
-
-TwilioFetcher::Response TwilioFetcher::fetchImagesInThread(Request const &request) {
-    spdlog::info("TwilioFetcher: Fetch in thread");
-    return Response {
-        .images = downloadTwilioImages(
-                request.deleteMessages, request.deleteImages, request.config),
-    };
+    return std::exchange(mImages, {});
 }
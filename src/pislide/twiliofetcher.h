@@ -5,39 +5,33 @@
 #include <memory>
 #include <filesystem>
 
-#include "executor.h"
+#include "future.h"
 #include "twilio.h"
 #include "config.h"
 
 /**
- * Asynchronously fetches Twilio images.
+ * Asynchronously fetches Twilio images on the thread pool.
  */
 class TwilioFetcher final {
-    // Request sent to the executor's thread.
-    struct Request {
-        bool deleteMessages;
-        bool deleteImages;
-        Config const &config;
-    };
-
-    // Response from the executor's thread.
-    struct Response {
-        std::vector<std::shared_ptr<TwilioImage>> images;
-    };
-
-    // Executor to fetch images in another thread.
-    Executor<Request,Response> mExecutor;
-
+    ThreadPool &mThreadPool;
     Config const &mConfig;
     bool mDeleteMessages = false;
     bool mDeleteImages = false;
     double mPreviousFetch = 0;
 
-    // Fetch the images. Runs in a different thread.
-    static Response fetchImagesInThread(Request const &request);
+    // Shared with the fetch task, which might outlive us.
+    std::shared_ptr<TwilioSessionPool> mSessionPool;
+    // Only used by the fetch task, and there's only one at a time.
+    std::shared_ptr<TwilioPollState> mPollState;
+
+    // Whether a fetch is in progress. Only used on the render thread.
+    bool mFetching = false;
+
+    // Images that have been fetched but not yet returned by get().
+    std::vector<std::shared_ptr<TwilioImage>> mImages;
 
 public:
-    TwilioFetcher(Config const &config);
+    TwilioFetcher(Config const &config, ThreadPool &threadPool);
 
     /**
      * Whether to delete Twilio messages after having fetched them.
@@ -57,7 +51,9 @@ public:
 
     /**
      * Request an asynchronous fetch of Twilio images. It's safe to call this
-     * multiple times even if an ongoing fetch is happening.
+     * multiple times even if an ongoing fetch is happening. The results are
+     * delivered in ThreadPool::runMainThreadTasks(), so this object must
+     * outlive the render loop.
      */
     void initiateFetch();
 
@@ -67,6 +63,14 @@ public:
      */
     void initiateFetch(double throttleSeconds);
 
+    /**
+     * Whether a fetch has been initiated and its results haven't been
+     * delivered yet.
+     */
+    bool isFetching() const {
+        return mFetching;
+    }
+
     /**
      * Return the images that have been fetched, if any.
      */
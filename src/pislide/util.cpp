@@ -6,8 +6,24 @@
 #include "TinySHA1.hpp"
 
 #include "util.h"
+#include "constants.h"
 
 namespace {
+    // Hex of the SHA-1 of the bytes processed so far.
+    std::string digestHex(sha1::SHA1 &s) {
+        uint32_t digest[5];
+        s.getDigest(digest);
+
+        char hex[41];
+        snprintf(hex, sizeof(hex), "%08x%08x%08x%08x%08x",
+                digest[0], digest[1], digest[2], digest[3], digest[4]);
+
+        return hex;
+    }
+
+    // Draw calls made since the last call to takeDrawCallCount().
+    int gDrawCallCount = 0;
+
     // Unload and delete the image.
     void deleteImage(const Image *image) {
         UnloadImage(*image);
@@ -19,6 +35,12 @@ namespace {
         UnloadFont(*font);
         delete font;
     }
+
+    // Unload and delete the texture object.
+    void deleteTexture(const Texture *texture) {
+        UnloadTexture(*texture);
+        delete texture;
+    }
 }
 
 int modulo(int a, int b) {
@@ -43,10 +65,68 @@ std::shared_ptr<Image> makeImageSharedPtr(Image image) {
     return std::shared_ptr<Image>(new Image(image), deleteImage);
 }
 
+void resizeImageToFit(Image *image, int maxSize) {
+    int width = image->width;
+    int height = image->height;
+
+    if (width >= height && width > maxSize) {
+        int newHeight = (height*maxSize + width/2)/width;
+        ImageResize(image, maxSize, newHeight);
+    } else if (height >= width && height > maxSize) {
+        int newWidth = (width*maxSize + height/2)/height;
+        ImageResize(image, newWidth, maxSize);
+    }
+}
+
+void drawTransparentBorder(Image *image, int size) {
+    int width = image->width;
+    int height = image->height;
+
+    // Top.
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < width; x++) {
+            ImageDrawPixel(image, x, y, BLANK);
+        }
+    }
+
+    // Bottom.
+    for (int y = height - size; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            ImageDrawPixel(image, x, y, BLANK);
+        }
+    }
+
+    for (int y = 0; y < height; y++) {
+        // Left.
+        for (int x = 0; x < size; x++) {
+            ImageDrawPixel(image, x, y, BLANK);
+        }
+
+        // Right.
+        for (int x = width - size; x < width; x++) {
+            ImageDrawPixel(image, x, y, BLANK);
+        }
+    }
+}
+
 std::shared_ptr<Font> makeFontSharedPtr(Font font) {
     return std::shared_ptr<Font>(new Font(font), deleteFont);
 }
 
+std::shared_ptr<Texture> makeTextureSharedPtr(Texture texture) {
+    return std::shared_ptr<Texture>(new Texture(texture), deleteTexture);
+}
+
+void countDrawCalls(int count) {
+    gDrawCallCount += count;
+}
+
+int takeDrawCallCount() {
+    int count = gDrawCallCount;
+    gDrawCallCount = 0;
+    return count;
+}
+
 std::vector<std::string> split(std::string const &input, char delimiter) {
     std::vector<std::string> result;
     std::string_view view{input};
@@ -82,6 +162,21 @@ std::string stripExtension(std::string const &pathname) {
     }
 }
 
+TempFile::~TempFile() {
+    if (!mPathname.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(mPathname, ec);
+    }
+}
+
+TempFile &TempFile::operator=(TempFile &&other) noexcept {
+    if (this != &other) {
+        TempFile old(std::move(*this));
+        mPathname = std::exchange(other.mPathname, {});
+    }
+    return *this;
+}
+
 std::vector<std::byte> readFileBytes(std::filesystem::path const &path) {
     // "ate" positions the pointer at the end of the file.
     std::ifstream file(path, std::ios::binary | std::ios::ate);
@@ -103,14 +198,60 @@ std::vector<std::byte> readFileBytes(std::filesystem::path const &path) {
 std::string sha1Hex(void const *data, size_t byteCount) {
     sha1::SHA1 s;
     s.processBytes(data, byteCount);
+    return digestHex(s);
+}
+
+FileHasher::FileHasher() : mSha1(std::make_unique<sha1::SHA1>()) {
+    mBack.reserve(HASH_BACK_SIZE*2);
+}
 
-    uint32_t digest[5];
-    s.getDigest(digest);
+FileHasher::~FileHasher() = default;
+FileHasher::FileHasher(FileHasher &&) noexcept = default;
+FileHasher &FileHasher::operator=(FileHasher &&) noexcept = default;
 
-    char hex[41];
-    snprintf(hex, sizeof(hex), "%08x%08x%08x%08x%08x",
-            digest[0], digest[1], digest[2], digest[3], digest[4]);
+void FileHasher::update(void const *data, size_t byteCount) {
+    mSha1->processBytes(data, byteCount);
+
+    // Keep only the tail. Let the buffer grow to twice the size before
+    // trimming so that small pieces don't each shift the whole buffer.
+    char const *bytes = static_cast<char const *>(data);
+    if (byteCount >= HASH_BACK_SIZE) {
+        mBack.assign(bytes + byteCount - HASH_BACK_SIZE, bytes + byteCount);
+    } else {
+        mBack.insert(mBack.end(), bytes, bytes + byteCount);
+        if (mBack.size() >= HASH_BACK_SIZE*2) {
+            mBack.erase(mBack.begin(), mBack.end() - HASH_BACK_SIZE);
+        }
+    }
+}
+
+FileHashes FileHasher::finish() const {
+    // Digest a copy so that we could keep adding.
+    sha1::SHA1 all = *mSha1;
+    size_t backSize = std::min(mBack.size(), HASH_BACK_SIZE);
+
+    return FileHashes {
+        .hashAll = digestHex(all),
+        .hashBack = sha1Hex(mBack.data() + mBack.size() - backSize, backSize),
+    };
+}
+
+FileHashes computeFileHashes(std::filesystem::path const &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Couldn't open file");
+    }
+
+    FileHasher hasher;
+    std::vector<char> buffer(HASH_READ_CHUNK_SIZE);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hasher.update(buffer.data(), file.gcount());
+    }
+    if (file.bad()) {
+        throw std::runtime_error("Couldn't read file");
+    }
 
-    return hex;
+    return hasher.finish();
 }
 
@@ -5,6 +5,7 @@
 #include <chrono>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include <filesystem>
 #include <cstddef>   // for std::byte
@@ -43,6 +44,29 @@ time_t nowEpoch();
  */
 std::shared_ptr<Image> makeImageSharedPtr(Image image);
 std::shared_ptr<Font> makeFontSharedPtr(Font font);
+std::shared_ptr<Texture> makeTextureSharedPtr(Texture texture);
+
+/**
+ * If the image is bigger than maxSize in width or height, it is
+ * resized to fit, keeping its aspect ratio.
+ */
+void resizeImageToFit(Image *image, int maxSize);
+
+/**
+ * Replace the "size" pixels at the border of the image
+ * with transparent pixels.
+ */
+void drawTransparentBorder(Image *image, int size);
+
+/**
+ * Record that "count" draw calls were made. Only call from the render thread.
+ */
+void countDrawCalls(int count = 1);
+
+/**
+ * Return the number of draw calls recorded since the previous call.
+ */
+int takeDrawCallCount();
 
 /**
  * Split the input at the delimiter, keeping empty parts. Will always
@@ -59,6 +83,37 @@ std::vector<std::string> split(std::string const &input, char delimiter);
  */
 std::string stripExtension(std::string const &pathname);
 
+/**
+ * Owns a temporary file, and deletes it on destruction unless it's been
+ * released (for example after renaming it to its final name). Move-only.
+ */
+class TempFile final {
+    std::filesystem::path mPathname;
+
+public:
+    TempFile() = default;
+    explicit TempFile(std::filesystem::path pathname) : mPathname(std::move(pathname)) {}
+    ~TempFile();
+
+    TempFile(TempFile &&other) noexcept : mPathname(std::exchange(other.mPathname, {})) {}
+    TempFile &operator=(TempFile &&other) noexcept;
+
+    // Can't copy, would delete twice.
+    TempFile(const TempFile &) = delete;
+    TempFile &operator=(const TempFile &) = delete;
+
+    std::filesystem::path const &pathname() const {
+        return mPathname;
+    }
+
+    /**
+     * Stop owning the file, so that it's not deleted.
+     */
+    void release() {
+        mPathname.clear();
+    }
+};
+
 /**
  * Read all the bytes of a file. Throws runtime_error() if it can't
  * open or read the file.
@@ -70,3 +125,49 @@ std::vector<std::byte> readFileBytes(std::filesystem::path const &path);
  */
 std::string sha1Hex(void const *data, size_t byteCount);
 
+namespace sha1 {
+    class SHA1;
+}
+
+/**
+ * The hashes that identify a photo file: the SHA-1 of the whole file, and
+ * of its last HASH_BACK_SIZE bytes (which survives metadata edits at the
+ * front of the file).
+ */
+struct FileHashes final {
+    std::string hashAll;
+    std::string hashBack;
+};
+
+/**
+ * Computes FileHashes from data that arrives in pieces, so that the whole
+ * file never needs to be in memory.
+ */
+class FileHasher final {
+    std::unique_ptr<sha1::SHA1> mSha1;
+    // The most recent HASH_BACK_SIZE bytes.
+    std::vector<char> mBack;
+
+public:
+    FileHasher();
+    ~FileHasher();
+    FileHasher(FileHasher &&) noexcept;
+    FileHasher &operator=(FileHasher &&) noexcept;
+
+    /**
+     * Add the next piece of the file.
+     */
+    void update(void const *data, size_t byteCount);
+
+    /**
+     * The hashes of everything added so far.
+     */
+    FileHashes finish() const;
+};
+
+/**
+ * Compute the hashes of a file on disk, reading it in chunks. Throws
+ * runtime_error() if it can't open or read the file.
+ */
+FileHashes computeFileHashes(std::filesystem::path const &path);
+
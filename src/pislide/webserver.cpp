@@ -1,10 +1,191 @@
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+
 #include <httplib.h>
+#include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
+#include <spdlog/fmt/std.h>
 
 #include "webserver.h"
+#include "thumbnailcache.h"
+#include "remotecontrol.h"
+#include "metrics.h"
+#include "logging.h"
+#include "trace.h"
+#include "constants.h"
 
 namespace {
+    // Prefix of the temporary files that uploads are streamed to.
+    constexpr char const *TEMP_UPLOAD_PREFIX = ".upload-";
+
+    // For unique temporary filenames.
+    std::atomic<uint64_t> gTempUploadCounter = 0;
+
+    /**
+     * An upload being streamed to disk.
+     */
+    struct PartialUpload final {
+        std::string filename;
+        std::string contentType;
+        std::filesystem::path tempPathname;
+        std::ofstream stream;
+        FileHasher hasher;
+        size_t size = 0;
+        // Whether the part has ended. Data for other form fields must not
+        // be appended to the file.
+        bool finished = false;
+
+        PartialUpload(std::string filename, std::string contentType,
+                std::filesystem::path tempPathname)
+            : filename(std::move(filename)), contentType(std::move(contentType)),
+            tempPathname(std::move(tempPathname)),
+            stream(this->tempPathname, std::ios::binary) {}
+
+        /**
+         * Close the file, if we haven't already. Returns whether everything
+         * was written.
+         */
+        bool finish() {
+            if (!finished) {
+                finished = true;
+                stream.close();
+            }
+            return !stream.fail();
+        }
+    };
+
+    /**
+     * Pathname for a new temporary upload file in the directory.
+     */
+    std::filesystem::path makeTempPathname(std::filesystem::path const &absoluteDir) {
+        return absoluteDir / fmt::format("{}{:08}.tmp", TEMP_UPLOAD_PREFIX, ++gTempUploadCounter);
+    }
+
+    /**
+     * Delete temporary upload files left over from a previous run.
+     */
+    void deleteStaleTempFiles(std::filesystem::path const &absoluteDir) {
+        std::error_code ec;
+        for (auto const &entry : std::filesystem::directory_iterator(absoluteDir, ec)) {
+            std::string filename = entry.path().filename().string();
+            if (filename.starts_with(TEMP_UPLOAD_PREFIX) && filename.ends_with(".tmp")) {
+                spdlog::info("Deleting stale upload {}", entry.path());
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    /**
+     * Path of an API endpoint under the web path.
+     */
+    std::string apiPath(Config const &config, std::string const &endpoint) {
+        std::string path = config.webPath;
+        if (!path.ends_with('/')) {
+            path += '/';
+        }
+        return path + "api/" + endpoint;
+    }
+
+    /**
+     * Integer query parameter, or the default if it's missing or malformed.
+     */
+    int getIntParam(httplib::Request const &req, std::string const &key, int defaultValue) {
+        if (!req.has_param(key)) {
+            return defaultValue;
+        }
+        try {
+            return std::stoi(req.get_param_value(key));
+        } catch (std::exception const &e) {
+            return defaultValue;
+        }
+    }
+
+    /**
+     * Set the response's ETag. If the client already has this version,
+     * make the response a 304 and return true, in which case the caller
+     * should not set any content.
+     */
+    bool checkNotModified(httplib::Request const &req, httplib::Response &res,
+            std::string const &etag) {
+
+        // Clients may keep the response, but must ask whether it's still good.
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "no-cache");
+
+        if (req.has_header("If-None-Match")) {
+            std::string ifNoneMatch = req.get_header_value("If-None-Match");
+            if (ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string::npos) {
+                res.status = httplib::StatusCode::NotModified_304;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Parse a remote-control command from its endpoint name and parameters.
+     */
+    std::optional<RemoteCommand> parseRemoteCommand(std::string const &name,
+            httplib::Request const &req) {
+
+        if (name == "next") {
+            return RemoteCommand { .type = RemoteCommand::Type::NEXT };
+        }
+        if (name == "previous") {
+            return RemoteCommand { .type = RemoteCommand::Type::PREVIOUS };
+        }
+        if (name == "pause") {
+            return RemoteCommand { .type = RemoteCommand::Type::TOGGLE_PAUSE };
+        }
+        if (name == "party") {
+            return RemoteCommand { .type = RemoteCommand::Type::TOGGLE_PARTY };
+        }
+        if (name == "rate") {
+            int rating = getIntParam(req, "rating", 0);
+            if (rating >= 1 && rating <= 5) {
+                return RemoteCommand { .type = RemoteCommand::Type::RATE, .value = rating };
+            }
+        }
+        if (name == "rotate") {
+            int degrees = getIntParam(req, "degrees", 0);
+            if (degrees == 90 || degrees == -90) {
+                return RemoteCommand { .type = RemoteCommand::Type::ROTATE, .value = degrees };
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Format the slide as a server-sent event.
+     */
+    std::string formatSlideEvent(SlideEvent const &slide) {
+        nlohmann::json data = {
+            {"id", slide.photoId},
+            {"label", slide.label},
+            {"displayDate", slide.displayDate},
+        };
+        return fmt::format("id: {}\nevent: slide\ndata: {}\n\n", slide.sequence, data.dump());
+    }
+
+    /**
+     * Append a metric with one sample per thread pool task class.
+     */
+    void formatPoolMetric(std::string &out, char const *name, char const *type, char const *help,
+            std::vector<TaskClassStats> const &poolStats,
+            std::function<double(TaskClassStats const &)> const &getValue) {
+
+        formatMetricHeader(out, name, type, help);
+        for (auto const &s : poolStats) {
+            formatMetricValue(out, name, fmt::format("{{class=\"{}\"}}", taskClassName(s.taskClass)),
+                    getValue(s));
+        }
+    }
+
     /**
      * Maps an HTTP status to a log level.
      */
@@ -27,7 +208,8 @@ WebServer::~WebServer() {
     mThread->join();
 }
 
-std::unique_ptr<WebServer> startWebServer(Config const &config, ThreadSafeQueue<WebUpload> &queue) {
+std::unique_ptr<WebServer> startWebServer(Config const &config, ThreadSafeQueue<WebUpload> &queue,
+        ThreadPool &threadPool, Gallery const &gallery, RemoteControl &remoteControl) {
     if (config.webSubdir.empty()) {
         spdlog::info("Web serving is disabled in config");
         return std::unique_ptr<WebServer>();
@@ -46,30 +228,281 @@ std::unique_ptr<WebServer> startWebServer(Config const &config, ThreadSafeQueue<
         return std::unique_ptr<WebServer>();
     }
 
-    server->Post(config.webPath, [&queue, &config](httplib::Request const &req, httplib::Response &res) {
-        // Access uploaded files.
-        auto const &files = req.form.get_files("image");
-        for (auto const &file : files) {
-            spdlog::info("Uploaded file: {} ({}) {} bytes",
-                    file.filename, file.content_type, file.content.size());
+    // Uploads are streamed here before being handed to the main thread.
+    std::filesystem::path absoluteDir = config.rootDir / config.webSubdir;
+    std::filesystem::create_directories(absoluteDir);
+    deleteStaleTempFiles(absoluteDir);
+
+    server->Post(config.webPath, [&queue, &config, absoluteDir](httplib::Request const &req,
+                httplib::Response &res, httplib::ContentReader const &contentReader) {
 
-            // TODO delete this, it's just to see what Cloudflair sends us.
-            for (auto const &header : file.headers) {
-                spdlog::info("Header: {} = {}", header.first, header.second);
+        TraceSpan span("web upload");
+
+        if (!req.is_multipart_form_data()) {
+            res.status = httplib::StatusCode::BadRequest_400;
+            return;
+        }
+
+        // Write each "image" part to its own file as it arrives.
+        std::vector<PartialUpload> uploads;
+        bool success = contentReader(
+            [&uploads, &absoluteDir](httplib::FormData const &file) {
+                if (!uploads.empty()) {
+                    uploads.back().finish();
+                }
+                if (file.name == "image" && !file.filename.empty()) {
+                    spdlog::info("Uploading file: {} ({})", file.filename, file.content_type);
+
+                    // TODO delete this, it's just to see what Cloudflair sends us.
+                    for (auto const &header : file.headers) {
+                        spdlog::info("Header: {} = {}", header.first, header.second);
+                    }
+
+                    uploads.emplace_back(file.filename, file.content_type,
+                            makeTempPathname(absoluteDir));
+                    if (!uploads.back().stream) {
+                        spdlog::error("Can't create {}", uploads.back().tempPathname);
+                        return false;
+                    }
+                }
+                return true;
+            },
+            [&uploads](char const *data, size_t length) {
+                if (!uploads.empty() && !uploads.back().finished) {
+                    PartialUpload &upload = uploads.back();
+                    upload.stream.write(data, length);
+                    upload.hasher.update(data, length);
+                    upload.size += length;
+                    return static_cast<bool>(upload.stream);
+                }
+                return true;
+            });
+
+        for (auto &upload : uploads) {
+            success = upload.finish() && success;
+        }
+        if (!success) {
+            spdlog::warn("Upload failed, deleting {} partial files", uploads.size());
+            metrics().uploadsFailed.add(uploads.size());
+            for (auto const &upload : uploads) {
+                std::filesystem::remove(upload.tempPathname);
             }
+            res.status = httplib::StatusCode::BadRequest_400;
+            return;
+        }
 
-            queue.enqueue(WebUpload {
-                .filename = file.filename,
-                .contentType = file.content_type,
-                .content = file.content,
+        for (size_t i = 0; i < uploads.size(); i++) {
+            PartialUpload &upload = uploads[i];
+            spdlog::info("Uploaded file: {} ({}) {} bytes",
+                    upload.filename, upload.contentType, upload.size);
+
+            bool queued = queue.enqueue(WebUpload {
+                .filename = std::move(upload.filename),
+                .contentType = std::move(upload.contentType),
+                .tempFile = TempFile(upload.tempPathname),
+                .hashes = upload.hasher.finish(),
             });
+            if (queued) {
+                metrics().uploads.add();
+                metrics().uploadBytes.add(upload.size);
+            } else {
+                // Too many uploads waiting to be processed. Tell the client
+                // to back off rather than filling up the disk.
+                // The rejected one's file was deleted with its WebUpload.
+                spdlog::warn("Upload queue full, rejecting {} uploads", uploads.size() - i);
+                metrics().uploadsRejected.add(uploads.size() - i);
+                for (size_t j = i + 1; j < uploads.size(); j++) {
+                    std::filesystem::remove(uploads[j].tempPathname);
+                }
+                res.status = httplib::StatusCode::ServiceUnavailable_503;
+                res.set_header("Retry-After", std::to_string(UPLOAD_RETRY_AFTER_S));
+                res.set_content("Too many uploads right now, please try again in a few seconds.",
+                        "text/plain");
+                return;
+            }
         }
 
         // Redirect back home with a message.
         res.set_redirect(config.webPath + "?uploaded=1", httplib::StatusCode::SeeOther_303);
     });
 
+    // Unique to this run of the program, so that ETags from a previous run,
+    // whose gallery versions started at the same number, don't match.
+    std::string runId = fmt::format("{:x}",
+            std::chrono::system_clock::now().time_since_epoch().count());
+
+    // One page of the photos in the slideshow, in slideshow order.
+    server->Get(apiPath(config, "gallery"), [&gallery, &config, runId](
+                httplib::Request const &req, httplib::Response &res) {
+
+        TraceSpan span("web gallery");
+
+        auto snapshot = gallery.snapshot();
+        int total = static_cast<int>(snapshot->photos.size());
+        int offset = std::clamp(getIntParam(req, "offset", 0), 0, total);
+        int limit = std::clamp(getIntParam(req, "limit", GALLERY_DEFAULT_PAGE_SIZE),
+                1, GALLERY_MAX_PAGE_SIZE);
+        int end = std::min(offset + limit, total);
+
+        std::string etag = fmt::format("\"{}-{}-{}-{}\"", runId, snapshot->version, offset, limit);
+        if (checkNotModified(req, res, etag)) {
+            return;
+        }
+
+        nlohmann::json photos = nlohmann::json::array();
+        for (int i = offset; i < end; i++) {
+            Photo const &photo = snapshot->photos[i];
+            photos.push_back({
+                {"id", photo.id},
+                {"label", photo.label},
+                {"date", photo.date},
+                {"displayDate", photo.displayDate},
+                {"rating", photo.rating},
+                {"thumbnail", apiPath(config, fmt::format("thumbnails/{}", photo.id))},
+            });
+        }
+
+        nlohmann::json body = {
+            {"total", total},
+            {"offset", offset},
+            {"limit", limit},
+            {"photos", photos},
+        };
+        res.set_content(body.dump(), "application/json");
+    });
+
+    // Small JPEG of one photo. The optional "size" parameter is the
+    // maximum width and height.
+    auto thumbnailCache = std::make_shared<ThumbnailCache>(threadPool, config.webThumbnailDir);
+    server->Get(apiPath(config, "thumbnails/:id"), [&gallery, thumbnailCache](
+                httplib::Request const &req, httplib::Response &res) {
+
+        TraceSpan span("web thumbnail");
+
+        int32_t id;
+        try {
+            id = std::stoi(req.path_params.at("id"));
+        } catch (std::exception const &e) {
+            res.status = httplib::StatusCode::BadRequest_400;
+            return;
+        }
+
+        auto snapshot = gallery.snapshot();
+        Photo const *photo = snapshot->findById(id);
+        if (photo == nullptr) {
+            res.status = httplib::StatusCode::NotFound_404;
+            return;
+        }
+
+        // The thumbnail only depends on these, so they make a good ETag.
+        int size = ThumbnailCache::snapSize(getIntParam(req, "size", THUMBNAIL_SIZES.front()));
+        std::string etag = fmt::format("\"{}\"", thumbnailCache->pathnameFor(*photo, size)
+                .stem().string());
+        if (checkNotModified(req, res, etag)) {
+            return;
+        }
+
+        auto pathname = thumbnailCache->get(*photo, size);
+        if (!pathname) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            res.set_header("Retry-After", std::to_string(THUMBNAIL_TIMEOUT_S));
+            return;
+        }
+        res.set_file_content(pathname->string(), "image/jpeg");
+    });
+
+    // Remote control: next, previous, pause, party, rate?rating=N, rotate?degrees=N.
+    server->Post(apiPath(config, "control/:command"), [&remoteControl](
+                httplib::Request const &req, httplib::Response &res) {
+
+        auto command = parseRemoteCommand(req.path_params.at("command"), req);
+        if (!command) {
+            res.status = httplib::StatusCode::BadRequest_400;
+            return;
+        }
+        if (!remoteControl.sendCommand(*command)) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            res.set_header("Retry-After", "1");
+            return;
+        }
+        res.status = httplib::StatusCode::NoContent_204;
+    });
+
+    // Stream of server-sent events, one per slide shown, starting with the
+    // current one.
+    server->Get(apiPath(config, "events"), [&remoteControl](
+                httplib::Request const &req, httplib::Response &res) {
+
+        if (!remoteControl.openStream()) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            res.set_header("Retry-After", std::to_string(EVENT_STREAM_KEEPALIVE_S));
+            return;
+        }
+
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [&remoteControl, lastSequence = uint64_t(0)](size_t offset, httplib::DataSink &sink) mutable {
+                auto slide = remoteControl.waitForSlide(lastSequence,
+                        std::chrono::seconds(EVENT_STREAM_KEEPALIVE_S));
+                if (remoteControl.isStopped()) {
+                    sink.done();
+                    return true;
+                }
+
+                std::string chunk;
+                if (slide) {
+                    lastSequence = slide->sequence;
+                    chunk = formatSlideEvent(*slide);
+                } else {
+                    // Comment line, so that proxies don't time out the connection.
+                    chunk = ": keepalive\n\n";
+                }
+                return sink.write(chunk.data(), chunk.size());
+            },
+            [&remoteControl](bool success) {
+                remoteControl.closeStream();
+            });
+    });
+
+    // Internal counters, in the Prometheus text format. Not under the web
+    // path, it's for whatever is scraping us, not guests.
+    server->Get("/metrics", [&queue, &threadPool](
+                httplib::Request const &req, httplib::Response &res) {
+
+        std::string out = metrics().format();
+
+        formatMetricHeader(out, "pislide_log_messages_dropped_total", "counter",
+                "Log messages dropped because the logging queue was full.");
+        formatMetricValue(out, "pislide_log_messages_dropped_total", "", logMessagesDropped());
+
+        // Queue and pool depths are read from their owners.
+        QueueStats queueStats = queue.stats();
+        formatMetricHeader(out, "pislide_upload_queue_length", "gauge",
+                "Uploads waiting to be added to the slideshow.");
+        formatMetricValue(out, "pislide_upload_queue_length", "", queueStats.size);
+        formatMetricHeader(out, "pislide_upload_queue_dropped_total", "counter",
+                "Uploads dropped from the full queue.");
+        formatMetricValue(out, "pislide_upload_queue_dropped_total", "", queueStats.dropped);
+
+        std::vector<TaskClassStats> poolStats = threadPool.stats();
+        formatPoolMetric(out, "pislide_pool_tasks_queued", "gauge",
+                "Thread pool tasks waiting to run.", poolStats,
+                [](TaskClassStats const &s) { return static_cast<double>(s.queued); });
+        formatPoolMetric(out, "pislide_pool_tasks_running", "gauge",
+                "Thread pool tasks running now.", poolStats,
+                [](TaskClassStats const &s) { return static_cast<double>(s.running); });
+        formatPoolMetric(out, "pislide_pool_tasks_completed_total", "counter",
+                "Thread pool tasks that have finished.", poolStats,
+                [](TaskClassStats const &s) { return static_cast<double>(s.completed); });
+        formatPoolMetric(out, "pislide_pool_task_seconds_total", "counter",
+                "Time spent running thread pool tasks.", poolStats,
+                [](TaskClassStats const &s) { return s.runTime; });
+
+        res.set_content(out, "text/plain; version=0.0.4");
+    });
+
     auto webThread = std::make_shared<std::thread>([server, &config]() {
+        traceThreadName("WebServer");
         spdlog::info("Starting the web server at {}:{}", config.webHostname, config.webPort);
         server->listen(config.webHostname, config.webPort);
         spdlog::info("Shut down the web server");
@@ -3,21 +3,33 @@
 
 #include <memory>
 #include <thread>
+#include <filesystem>
 
 #include "config.h"
+#include "gallery.h"
+#include "remotecontrol.h"
+#include "threadpool.h"
 #include "tsqueue.h"
+#include "util.h"
 
 namespace httplib {
     class Server;
 }
 
 /**
- * A photo uploaded by the user via the web interface.
+ * A photo uploaded by the user via the web interface. The web server streams
+ * it to a temporary file in the web directory, hashing it on the way, so it's
+ * never entirely in memory.
  */
 struct WebUpload final {
+    // Name of the file on the user's device.
     std::string filename;
     std::string contentType;
-    std::string content;
+    // The temporary file, with an absolute pathname. The receiver should
+    // rename it to its final name (in the same directory) and release it.
+    // Otherwise it's deleted, including when the queue drops the upload.
+    TempFile tempFile;
+    FileHashes hashes;
 };
 
 /**
@@ -40,7 +52,9 @@ public:
 };
 
 /**
- * Start the web server for uploading photos.
+ * Start the web server for uploading photos, browsing the gallery, and
+ * controlling the slideshow. Thumbnails are made on the thread pool.
  */
-std::unique_ptr<WebServer> startWebServer(Config const &config, ThreadSafeQueue<WebUpload> &queue);
+std::unique_ptr<WebServer> startWebServer(Config const &config, ThreadSafeQueue<WebUpload> &queue,
+        ThreadPool &threadPool, Gallery const &gallery, RemoteControl &remoteControl);
 
@@ -1,52 +1,86 @@
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <iostream>
 
 #include <cpr/cpr.h>
-#include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
 #include "webservices.h"
+#include "jsonsax.h"
+#include "metrics.h"
+#include "constants.h"
 
 using namespace std::literals::string_literals;
 
-std::vector<long> nextBuses(Config const &config) {
-    std::vector<long> times;
+namespace {
+    /**
+     * Picks the expected arrival times out of a 511.org StopMonitoring response.
+     */
+    class StopMonitoringParser final : public JsonSaxHandler {
+        std::vector<time_t> &mTimes;
+
+    protected:
+        void onString(std::string &value) override {
+            if (!value.empty() && isAt({"ServiceDelivery", "StopMonitoringDelivery",
+                        "MonitoredStopVisit", "", "MonitoredVehicleJourney",
+                        "MonitoredCall", "ExpectedArrivalTime"})) {
+
+                struct std::tm tm = {};
+                char *p = strptime(value.c_str(), "%Y-%m-%dT%H:%M:%SZ", &tm);
+                if (p == nullptr || *p != '\0') {
+                    spdlog::warn("Unable to parse 511.org timestamp {}", value);
+                } else {
+                    mTimes.emplace_back(timegm(&tm));
+                }
+            }
+        }
+
+    public:
+        explicit StopMonitoringParser(std::vector<time_t> &times)
+            : mTimes(times) {}
+    };
+}
+
+std::optional<std::vector<time_t>> nextBuses(Config const &config) {
+    std::vector<time_t> times;
 
     // See if we're configured at all.
     if (config.bus511orgToken.empty() || config.bus511orgAgency.empty() || config.bus511orgStopCode.empty()) {
         spdlog::error("511.org is not configured");
-        return times;
+        return std::nullopt;
     }
 
     // Fetch the information.
     // TODO use cpr::Parameters
-    auto url = "https://api.511.org/transit/StopMonitoring?api_key="s + config.bus511orgToken +
+    auto url = config.bus511orgBaseUrl + "/transit/StopMonitoring?api_key="s + config.bus511orgToken +
         "&agency=" + config.bus511orgAgency +
         "&stopCode=" + config.bus511orgStopCode +
         "&format=json";
 
-    cpr::Response r = cpr::Get(cpr::Url{url});
+    // Don't let a hung server tie up a network thread.
+    cpr::Response r = cpr::Get(cpr::Url{url},
+            cpr::Timeout{std::chrono::seconds(BUS_INFO_TIMEOUT_S)},
+            cpr::ConnectTimeout{std::chrono::seconds(BUS_INFO_CONNECT_TIMEOUT_S)});
     if (r.status_code != 200) {
-        spdlog::warn("Got status code {} fetching 511.org information", r.status_code);
-        return times;
+        if (r.error) {
+            spdlog::warn("Can't fetch 511.org information ({})", r.error.message);
+        } else {
+            spdlog::warn("Got status code {} fetching 511.org information", r.status_code);
+        }
+        metrics().busFetchFailures.add();
+        return std::nullopt;
     }
 
-    // Parse the information.
-    // TODO fix variable names.
-    auto x = nlohmann::json::parse(r.text);
-    for (auto const &y : x["ServiceDelivery"]["StopMonitoringDelivery"]["MonitoredStopVisit"]) {
-        std::string timestamp = y["MonitoredVehicleJourney"]["MonitoredCall"]["ExpectedArrivalTime"];
-        if (!timestamp.empty()) {
-            struct std::tm tm = {};
-            char *p = strptime(timestamp.c_str(), "%Y-%m-%dT%H:%M:%SZ", &tm);
-            if (p == nullptr || *p != '\0') {
-                spdlog::warn("Unable to parse 511.org timestamp {}", timestamp);
-            } else {
-                times.emplace_back(timegm(&tm));
-            }
-        }
+    // Parse the information. Missing fields just mean no times.
+    StopMonitoringParser parser(times);
+    if (!parser.parse(r.text)) {
+        spdlog::warn("Can't parse 511.org information ({})", parser.error());
+        metrics().busFetchFailures.add();
+        return std::nullopt;
     }
 
+    std::sort(times.begin(), times.end());
     return times;
 }
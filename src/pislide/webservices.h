@@ -2,6 +2,7 @@
 #pragma once
 
 #include <ctime>
+#include <optional>
 #include <vector>
 
 #include "config.h"
@@ -9,7 +10,8 @@
 /**
  * Return a sorted vector of epoch times that the bus is expected to
  * show up. If no bus information has been configured, or if anything
- * goes wrong fetching the information, an empty vector is returned.
+ * goes wrong fetching the information, returns no value. Gives up after
+ * BUS_INFO_TIMEOUT_S.
  */
-std::vector<time_t> nextBuses(Config const &config);
+std::optional<std::vector<time_t>> nextBuses(Config const &config);
 
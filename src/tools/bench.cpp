@@ -0,0 +1,1090 @@
+
+// Benchmarks for PiSlide's hot paths. Runs headless.
+//
+// Usage: pislide-bench [--filter SUBSTRING] [--json PATHNAME] [--library DIR]
+//
+// With --json, also writes the results to that file so that runs can be
+// compared to find regressions. With --library, also runs the startup
+// pipeline against a library made by pislide-genlibrary, to see how it
+// scales to 10k, 100k, or 1M photos.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <ctime>
+#include <set>
+
+#include <nlohmann/json.hpp>
+#include <raylib.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/basic_file_sink.h>
+
+#include "tsqueue.h"
+#include "executor.h"
+#include "ringbuffer.h"
+#include "future.h"
+#include "twilio.h"
+#include "constants.h"
+#include "mockserver.h"
+#include "imageloader.h"
+#include "util.h"
+#include "label.h"
+#include "scanner.h"
+#include "database.h"
+#include "slidecache.h"
+#include "schema.h"
+
+namespace {
+    /**
+     * Bytes copied by CountedBuffer copy constructors and assignments.
+     */
+    std::atomic<size_t> gBytesCopied = 0;
+
+    /**
+     * Stand-in for a large payload (like an uploaded image) that records
+     * how many bytes are copied when it's copied. Moves are free.
+     */
+    struct CountedBuffer final {
+        std::string data;
+
+        CountedBuffer() = default;
+        explicit CountedBuffer(size_t size) : data(size, 'x') {}
+        CountedBuffer(CountedBuffer const &other) : data(other.data) {
+            gBytesCopied += data.size();
+        }
+        CountedBuffer(CountedBuffer &&other) = default;
+        CountedBuffer &operator=(CountedBuffer const &other) {
+            data = other.data;
+            gBytesCopied += data.size();
+            return *this;
+        }
+        CountedBuffer &operator=(CountedBuffer &&other) = default;
+    };
+
+    /**
+     * Same shape as WebUpload, but with a counted content.
+     */
+    struct Upload final {
+        std::string filename;
+        std::string contentType;
+        CountedBuffer content;
+    };
+
+    // Size of a typical phone photo.
+    constexpr size_t UPLOAD_SIZE = 5*1024*1024;
+
+    /**
+     * A named benchmark. The function runs the benchmark "iterations" times
+     * and returns extra information to print. The optional setup and
+     * teardown functions make and remove fixtures, and aren't timed.
+     */
+    struct Benchmark final {
+        std::string name;
+        int iterations;
+        std::function<std::string(int iterations)> run;
+        std::function<void()> setup = {};
+        std::function<void()> teardown = {};
+    };
+
+    /**
+     * Where benchmarks put their fixtures.
+     */
+    std::filesystem::path benchDir() {
+        return std::filesystem::temp_directory_path() / "pislide-bench";
+    }
+
+    void removeBenchDir() {
+        std::filesystem::remove_all(benchDir());
+    }
+
+    /**
+     * Nanoseconds since the given time.
+     */
+    double nanosecondsSince(std::chrono::steady_clock::time_point beginTime) {
+        std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now() - beginTime;
+        return elapsed.count();
+    }
+
+    /**
+     * Web upload passing from the web server thread to the render thread.
+     */
+    std::string benchQueueUpload(int iterations) {
+        ThreadSafeQueue<Upload> queue;
+        gBytesCopied = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            queue.enqueue(Upload {
+                .filename = "photo.jpg",
+                .contentType = "image/jpeg",
+                .content = CountedBuffer(UPLOAD_SIZE),
+            });
+            auto upload = queue.try_dequeue();
+            if (!upload) {
+                return "dequeue failed";
+            }
+        }
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%.1f payloads copied per upload",
+                static_cast<double>(gBytesCopied)/iterations/UPLOAD_SIZE);
+        return buffer;
+    }
+
+    /**
+     * A burst of uploads arriving while the render loop is busy, then
+     * drained all at once. Reports the peak memory held by the queue.
+     */
+    std::string benchUploadBurst(int iterations, size_t capacity, OverflowPolicy policy) {
+        ThreadSafeQueue<Upload> queue;
+        queue.setCapacity(capacity, policy);
+        size_t peakSize = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            queue.enqueue(Upload {
+                .filename = "photo.jpg",
+                .contentType = "image/jpeg",
+                .content = CountedBuffer(UPLOAD_SIZE),
+            });
+            peakSize = std::max(peakSize, queue.stats().size);
+        }
+
+        QueueStats stats = queue.stats();
+        queue.clear();
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "peak %zu MB queued, %llu dropped, %llu rejected",
+                peakSize*UPLOAD_SIZE/1024/1024,
+                static_cast<unsigned long long>(stats.dropped),
+                static_cast<unsigned long long>(stats.rejected));
+        return buffer;
+    }
+
+    /**
+     * Request and response round trip through an Executor.
+     */
+    std::string benchExecutorRoundTrip(int iterations) {
+        struct Request {
+            CountedBuffer payload;
+        };
+        struct Response {
+            CountedBuffer payload;
+        };
+        ThreadPool threadPool(1);
+        Executor<Request,Response> executor("bench", threadPool, TaskClass::INTERACTIVE_DECODE,
+                [](Request const &request) {
+            return Response { .payload = CountedBuffer(UPLOAD_SIZE) };
+        });
+        gBytesCopied = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            executor.ask(Request { .payload = CountedBuffer(UPLOAD_SIZE) });
+            while (!executor.get()) {
+                std::this_thread::yield();
+            }
+        }
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%.1f payloads copied per round trip",
+                static_cast<double>(gBytesCopied)/iterations/UPLOAD_SIZE);
+        return buffer;
+    }
+
+    /**
+     * Poll an empty queue, like the render thread does every frame.
+     */
+    template <typename QUEUE>
+    std::string benchEmptyPoll(int iterations) {
+        QUEUE queue;
+        int found = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            if (queue.try_dequeue()) {
+                found += 1;
+            }
+        }
+
+        return found == 0 ? "" : "unexpected data";
+    }
+
+    /**
+     * Several producers enqueueing while one consumer dequeues. Each iteration
+     * is one item.
+     */
+    template <typename QUEUE>
+    std::string benchContention(int iterations, int producerCount) {
+        QUEUE queue;
+        int perProducer = iterations/producerCount;
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < producerCount; p++) {
+            producers.emplace_back([&queue, perProducer]() {
+                for (int i = 0; i < perProducer; i++) {
+                    queue.enqueue(int(i));
+                }
+            });
+        }
+
+        // Drain in batches like the render thread, giving up the CPU when
+        // there's nothing to do so that this also works on one core.
+        std::vector<int> batch;
+        size_t received = 0;
+        while (received < static_cast<size_t>(perProducer*producerCount)) {
+            batch.clear();
+            queue.drain(batch);
+            if (batch.empty()) {
+                std::this_thread::yield();
+            }
+            received += batch.size();
+        }
+
+        for (auto &producer : producers) {
+            producer.join();
+        }
+
+        return std::to_string(producerCount) + " producers";
+    }
+
+    /**
+     * Latency of an image decode submitted while the pool is busy with slow
+     * network calls. With "networkLimit" equal to the thread count, network
+     * calls can take every thread and the decode waits for one to finish.
+     */
+    std::string benchDecodeBehindNetwork(int iterations, int networkLimit) {
+        constexpr int THREAD_COUNT = 2;
+        static constexpr auto NETWORK_CALL_TIME = std::chrono::milliseconds(20);
+
+        ThreadPool threadPool(THREAD_COUNT);
+        threadPool.setConcurrencyLimit(TaskClass::NETWORK, networkLimit);
+
+        // Queue more network calls than the benchmark will take. The
+        // leftovers are discarded when the pool is destroyed.
+        for (int i = 0; i < iterations*THREAD_COUNT*2; i++) {
+            threadPool.submit(TaskClass::NETWORK, []() {
+                std::this_thread::sleep_for(NETWORK_CALL_TIME);
+            });
+        }
+        std::this_thread::sleep_for(NETWORK_CALL_TIME/2);
+
+        for (int i = 0; i < iterations; i++) {
+            std::atomic<bool> decoded = false;
+            threadPool.submit(TaskClass::INTERACTIVE_DECODE, [&decoded]() {
+                decoded = true;
+            });
+            while (!decoded) {
+                std::this_thread::yield();
+            }
+        }
+
+        return "network limit " + std::to_string(networkLimit) + " of "
+            + std::to_string(THREAD_COUNT) + " threads";
+    }
+
+    /**
+     * Three-stage chain (network, maintenance, render thread), with the
+     * render thread draining its tasks like the frame loop does.
+     */
+    std::string benchFutureChain(int iterations) {
+        ThreadPool threadPool(2);
+        int sum = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            bool done = false;
+            runAsync(threadPool, TaskClass::NETWORK, [i]() {
+                return i;
+            }).then(TaskClass::MAINTENANCE, [](int &&value) {
+                return value*2;
+            }).onMainThread([&sum, &done](int &&value) {
+                sum += value;
+                done = true;
+            });
+
+            while (!done) {
+                if (threadPool.runMainThreadTasks() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        long expected = static_cast<long>(iterations)*(iterations - 1);
+        return sum == expected ? "" : "wrong result";
+    }
+
+    /**
+     * Fan out four tasks and gather them on the render thread.
+     */
+    std::string benchFutureWhenAll(int iterations) {
+        ThreadPool threadPool(2);
+        size_t count = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            bool done = false;
+            std::vector<Future<int>> futures;
+            for (int j = 0; j < 4; j++) {
+                futures.push_back(runAsync(threadPool, TaskClass::PREFETCH, [j]() {
+                    return j;
+                }));
+            }
+            whenAll(threadPool, std::move(futures)).onMainThread(
+                    [&count, &done](std::vector<int> &&values) {
+
+                count += values.size();
+                done = true;
+            });
+
+            while (!done) {
+                if (threadPool.runMainThreadTasks() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        return count == static_cast<size_t>(iterations)*4 ? "" : "wrong result";
+    }
+
+    /**
+     * End-to-end time for a Twilio fetch of a batch of messages (like ten
+     * guests texting at once), with 20 ms of latency per request.
+     */
+    std::string benchTwilioDownload(int iterations, int messageCount, size_t parallelRequests) {
+        MockServer mock(MockServerOptions {
+            .latency = std::chrono::milliseconds(20),
+            .messagesPerPoll = messageCount,
+        });
+
+        Config config;
+        mock.configure(config);
+        config.rootDir = std::filesystem::temp_directory_path() / "pislide-bench-twilio";
+        config.twilioSubdir = "twilio";
+
+        TwilioSessionPool sessionPool(config, parallelRequests);
+        TwilioPollState pollState("");
+        size_t imageCount = 0;
+        for (int i = 0; i < iterations; i++) {
+            // The mock has a new batch of messages for each fetch.
+            imageCount += downloadTwilioImages(sessionPool, pollState, false, false, config).size();
+        }
+        std::filesystem::remove_all(config.rootDir);
+
+        if (imageCount != static_cast<size_t>(iterations)*messageCount) {
+            return "wrong number of images";
+        }
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%d images per fetch, %zu connections",
+                messageCount, mock.connectionCount());
+        return buffer;
+    }
+
+    /**
+     * A page of a Twilio message list with the given number of messages,
+     * with all the fields Twilio sends. Every other message is an inbound
+     * one with an image.
+     */
+    std::string makeTwilioMessagePage(int messageCount) {
+        std::string account = "/2010-04-01/Accounts/AC0";
+        nlohmann::json messages = nlohmann::json::array();
+        for (int i = 0; i < messageCount; i++) {
+            std::string sid = "SM" + std::to_string(1000000 + i) + "0123456789abcdef0123456789";
+            std::string uri = account + "/Messages/" + sid;
+            bool withImage = i % 2 == 0;
+            messages.push_back({
+                { "account_sid", "AC0" },
+                { "api_version", "2010-04-01" },
+                { "body", withImage ? "" : "Happy birthday! See you at the party tonight." },
+                { "date_created", "Sat, 01 Nov 2025 20:00:00 +0000" },
+                { "date_sent", "Sat, 01 Nov 2025 20:00:00 +0000" },
+                { "date_updated", "Sat, 01 Nov 2025 20:00:01 +0000" },
+                { "direction", withImage ? "inbound" : "outbound-api" },
+                { "error_code", nullptr },
+                { "error_message", nullptr },
+                { "from", "+14155550100" },
+                { "messaging_service_sid", nullptr },
+                { "num_media", withImage ? "1" : "0" },
+                { "num_segments", "1" },
+                { "price", "-0.00790" },
+                { "price_unit", "USD" },
+                { "sid", sid },
+                { "status", "received" },
+                { "subresource_uris", {
+                    { "media", uri + "/Media.json" },
+                    { "feedback", uri + "/Feedback.json" },
+                } },
+                { "to", "+14155550199" },
+                { "uri", uri + ".json" },
+            });
+        }
+
+        nlohmann::json page = {
+            { "messages", messages },
+            { "end", messageCount - 1 },
+            { "first_page_uri", account + "/Messages.json?PageSize=" + std::to_string(messageCount) },
+            { "next_page_uri", nullptr },
+            { "page", 0 },
+            { "page_size", messageCount },
+            { "previous_page_uri", nullptr },
+            { "start", 0 },
+            { "uri", account + "/Messages.json?PageSize=" + std::to_string(messageCount) },
+        };
+        return page.dump();
+    }
+
+    /**
+     * Pick the inbound messages with images out of a big message list by
+     * building a DOM, the way we used to.
+     */
+    std::string benchTwilioMessagesDom(int iterations) {
+        std::string text = makeTwilioMessagePage(5000);
+        size_t count = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            std::vector<std::shared_ptr<TwilioMessage>> messages;
+            auto j = nlohmann::json::parse(text);
+            for (auto const &jmsg : j["messages"]) {
+                int numMedia = std::stoi(jmsg["num_media"].get<std::string>());
+                if (numMedia > 0 && jmsg["direction"] == "inbound") {
+                    messages.emplace_back(std::make_shared<TwilioMessage>(TwilioMessage{
+                        .sid = jmsg["sid"],
+                        .uri = jmsg["uri"],
+                        .sourcePhoneNumber = jmsg["from"],
+                        .dateSent = jmsg["date_sent"],
+                        .dateSentTime = 0,
+                        .mediaListUrl = jmsg["subresource_uris"]["media"],
+                    }));
+                }
+            }
+            count += messages.size();
+        }
+
+        return count == static_cast<size_t>(iterations)*2500 ? "" : "wrong result";
+    }
+
+    /**
+     * Same with the streaming parser we use now.
+     */
+    std::string benchTwilioMessagesSax(int iterations) {
+        std::string text = makeTwilioMessagePage(5000);
+        TwilioPollState pollState("");
+        size_t count = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            TwilioMessageList list;
+            TwilioMessagePageParser parser(pollState, list, pollState.highWaterMark());
+            if (!parser.parse(text)) {
+                return parser.error();
+            }
+            count += list.messages.size();
+        }
+
+        return count == static_cast<size_t>(iterations)*2500 ? "" : "wrong result";
+    }
+
+    /**
+     * Cost of logging one line to a file, the way a photo scan does.
+     * Synchronous loggers write (and maybe flush) on the caller's thread;
+     * the asynchronous one only queues the message.
+     */
+    std::string benchLogging(int iterations, bool async, bool flushEach) {
+        std::filesystem::path pathname = std::filesystem::temp_directory_path() / "pislide-bench.log";
+        std::filesystem::remove(pathname);
+        auto sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(pathname.string());
+
+        std::shared_ptr<spdlog::details::thread_pool> threadPool;
+        std::shared_ptr<spdlog::logger> logger;
+        if (async) {
+            threadPool = std::make_shared<spdlog::details::thread_pool>(LOG_QUEUE_SIZE, 1);
+            logger = std::make_shared<spdlog::async_logger>("bench", sink, threadPool,
+                    spdlog::async_overflow_policy::overrun_oldest);
+        } else {
+            logger = std::make_shared<spdlog::logger>("bench", sink);
+        }
+        logger->flush_on(flushEach ? spdlog::level::trace : spdlog::level::warn);
+
+        auto beginTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            logger->info("Analyzing photo {} of {}: {}", i, iterations, "2025/11/01/IMG_1234.jpg");
+        }
+        std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now() - beginTime;
+
+        size_t dropped = threadPool ? threadPool->overrun_counter() : 0;
+        // Wait for the queue to drain before cleaning up.
+        logger.reset();
+        threadPool.reset();
+        sink.reset();
+        std::filesystem::remove(pathname);
+
+        // The total includes draining the queue, this is just what the caller pays.
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%.0f ns/message in caller, %zu dropped",
+                elapsed.count()/iterations, dropped);
+        return buffer;
+    }
+
+    // ------------------------------------------------------------------------
+    // Images.
+
+    // Size of a typical phone photo.
+    constexpr int PHOTO_WIDTH = 4032;
+    constexpr int PHOTO_HEIGHT = 3024;
+
+    std::filesystem::path jpegPathname() {
+        return benchDir() / "photo.jpg";
+    }
+
+    /**
+     * Write a phone-sized JPEG. Noise compresses worse than most photos,
+     * so this errs on the side of slow decodes.
+     */
+    void makeJpeg() {
+        std::filesystem::create_directories(benchDir());
+        Image image = GenImagePerlinNoise(PHOTO_WIDTH, PHOTO_HEIGHT, 0, 0, 4.0f);
+        bool success = ExportImage(image, jpegPathname().c_str());
+        UnloadImage(image);
+        if (!success) {
+            throw std::runtime_error("can't write " + jpegPathname().string());
+        }
+    }
+
+    /**
+     * Everything the image loader does on a worker thread: decode, resize
+     * to the texture limit, and draw the transparent border.
+     */
+    std::string benchLoadPhoto(int iterations) {
+        Photo photo {};
+        photo.absolutePathname = jpegPathname();
+
+        for (int i = 0; i < iterations; i++) {
+            LoadedImage loadedImage = ImageLoader::loadImage(photo);
+            if (!loadedImage.image) {
+                return "failed to load";
+            }
+        }
+
+        return std::to_string(PHOTO_WIDTH) + "x" + std::to_string(PHOTO_HEIGHT) + " JPEG";
+    }
+
+    /**
+     * Just the decode part of benchLoadPhoto().
+     */
+    std::string benchDecodeJpeg(int iterations) {
+        for (int i = 0; i < iterations; i++) {
+            Image image = LoadImage(jpegPathname().c_str());
+            bool valid = IsImageValid(image);
+            UnloadImage(image);
+            if (!valid) {
+                return "failed to load";
+            }
+        }
+
+        return "";
+    }
+
+    /**
+     * Just the resize part of benchLoadPhoto(), including a copy of the
+     * decoded image since the resize is in place.
+     */
+    std::string benchResizeImageToFit(int iterations) {
+        Image original = LoadImage(jpegPathname().c_str());
+        std::chrono::duration<double,std::nano> copyTime {};
+
+        for (int i = 0; i < iterations; i++) {
+            auto copyBeginTime = std::chrono::steady_clock::now();
+            Image image = ImageCopy(original);
+            copyTime += std::chrono::steady_clock::now() - copyBeginTime;
+            resizeImageToFit(&image, MAX_TEXTURE_SIZE);
+            UnloadImage(image);
+        }
+        UnloadImage(original);
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%.0f ns/op of it copying", copyTime.count()/iterations);
+        return buffer;
+    }
+
+    /**
+     * Just the border part of benchLoadPhoto(), on an image already resized.
+     */
+    std::string benchDrawTransparentBorder(int iterations) {
+        Image image = GenImageColor(MAX_TEXTURE_SIZE, MAX_TEXTURE_SIZE*PHOTO_HEIGHT/PHOTO_WIDTH, WHITE);
+
+        for (int i = 0; i < iterations; i++) {
+            drawTransparentBorder(&image, TRANSPARENT_BORDER);
+        }
+        UnloadImage(image);
+
+        return std::to_string(TRANSPARENT_BORDER) + " pixel border";
+    }
+
+    // ------------------------------------------------------------------------
+    // Ingestion.
+
+    /**
+     * Hashing a photo file's contents, as when deduplicating uploads.
+     */
+    std::string benchSha1Hex(int iterations) {
+        // Enough bytes that the per-call overhead doesn't matter.
+        constexpr size_t BYTE_COUNT = 1024*1024;
+        std::vector<uint8_t> data(BYTE_COUNT);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<uint8_t>(i*2654435761u >> 24);
+        }
+
+        auto beginTime = std::chrono::steady_clock::now();
+        size_t length = 0;
+        for (int i = 0; i < iterations; i++) {
+            length += sha1Hex(data.data(), data.size()).size();
+        }
+        double elapsed = nanosecondsSince(beginTime);
+
+        if (length != static_cast<size_t>(iterations)*40) {
+            return "wrong result";
+        }
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%.0f MB/s",
+                static_cast<double>(BYTE_COUNT)*iterations/(elapsed/1e9)/1e6);
+        return buffer;
+    }
+
+    /**
+     * Making labels for a mix of typical pathnames.
+     */
+    std::string benchPathnameToLabel(int iterations) {
+        std::vector<std::filesystem::path> pathnames = {
+            "Vacation/Ibiza/Funny_moment.jpg",
+            "2019/2019-07-04 Fourth of July/IMG_1234.JPG",
+            "Family/Grandma's 90th birthday/DSC01234.jpeg",
+            "Camera Uploads/2023-05-17 18.42.07.jpg",
+            "twilio/ME0123456789abcdef0123456789abcdef.jpg",
+            "Scans/1975/Summer_at_the_lake_-_Dad_and_me.jpg",
+        };
+        Config config;
+
+        size_t length = 0;
+        for (int i = 0; i < iterations; i++) {
+            length += pathnameToLabel(config, pathnames[i % pathnames.size()]).size();
+        }
+
+        return length > 0 ? "" : "wrong result";
+    }
+
+    // Shape of the synthetic photo tree.
+    constexpr int TREE_YEAR_COUNT = 20;
+    constexpr int TREE_EVENT_COUNT = 12;
+    constexpr int TREE_PHOTO_COUNT = 20;
+
+    std::filesystem::path treeDir() {
+        return benchDir() / "tree";
+    }
+
+    /**
+     * Make a tree of empty files shaped like a photo library: year
+     * directories of event directories of photos, with some files and
+     * directories that the scan must skip.
+     */
+    void makeTree() {
+        for (int year = 0; year < TREE_YEAR_COUNT; year++) {
+            for (int event = 0; event < TREE_EVENT_COUNT; event++) {
+                std::filesystem::path dir = treeDir() / std::to_string(2000 + year)
+                    / ("Event " + std::to_string(event));
+                std::filesystem::create_directories(dir);
+                for (int photo = 0; photo < TREE_PHOTO_COUNT; photo++) {
+                    std::ofstream(dir / ("IMG_" + std::to_string(1000 + photo) + ".JPG"));
+                }
+                std::ofstream(dir / "notes.txt");
+                std::filesystem::create_directories(dir / "@eaDir");
+                std::ofstream(dir / "@eaDir" / "IMG_1000.JPG");
+            }
+        }
+    }
+
+    /**
+     * The full scan that runs at startup and whenever we look for new photos.
+     */
+    std::string benchTraverseDirectoryTree(int iterations) {
+        Config config;
+        config.rootDir = treeDir();
+        config.unwantedDirs.insert("@eaDir");
+
+        size_t expected = TREE_YEAR_COUNT*TREE_EVENT_COUNT*TREE_PHOTO_COUNT;
+        for (int i = 0; i < iterations; i++) {
+            if (traverseDirectoryTree(config).size() != expected) {
+                return "wrong number of photos";
+            }
+        }
+
+        return std::to_string(expected) + " photos";
+    }
+
+    // ------------------------------------------------------------------------
+    // Database.
+
+    // Photos in the database for the query benchmarks.
+    constexpr int DATABASE_PHOTO_COUNT = 20000;
+
+    std::filesystem::path databasePathname() {
+        return benchDir() / "pislide.db";
+    }
+
+    std::string makeHashBack(int i) {
+        return sha1Hex(&i, sizeof(i));
+    }
+
+    /**
+     * Make a database with "photoCount" photos, each with one file.
+     */
+    void makeDatabase(int photoCount) {
+        std::filesystem::create_directories(benchDir());
+        sqlite3 *db = createDatabase(databasePathname());
+
+        execSql(db, "BEGIN");
+        for (int i = 0; i < photoCount; i++) {
+            std::string hashBack = makeHashBack(i);
+            char *sql = sqlite3_mprintf(
+                    "INSERT INTO photo VALUES (NULL, %Q, 0, 3, %d, '2025', 'Event %d'); "
+                    "INSERT INTO photo_file VALUES ('2025/Event %d/IMG_%d.jpg', %Q, %Q)",
+                    hashBack.c_str(), 1700000000 + i, i/20, i/20, i, hashBack.c_str(), hashBack.c_str());
+            execSql(db, sql);
+            sqlite3_free(sql);
+        }
+        execSql(db, "COMMIT");
+
+        sqlite3_close(db);
+    }
+
+    /**
+     * Adding new photos one at a time, the way ingestion does.
+     */
+    std::string benchDatabaseInsert(int iterations) {
+        Database database(databasePathname().string());
+
+        for (int i = 0; i < iterations; i++) {
+            Photo photo {
+                .id = 0,
+                .hashBack = makeHashBack(i),
+                .rotation = 0,
+                .rating = 3,
+                .date = 1700000000 + i,
+                .displayDate = "2025",
+                .label = "Event",
+            };
+            photo.id = database.insertPhoto(photo);
+            database.savePhotoFile(PhotoFile {
+                .pathname = "2025/Event/IMG_" + std::to_string(i) + ".jpg",
+                .hashAll = photo.hashBack,
+                .hashBack = photo.hashBack,
+            });
+        }
+
+        return "photo and file per op";
+    }
+
+    /**
+     * Loading the whole library at startup.
+     */
+    std::string benchDatabaseGetAll(int iterations) {
+        Database database(databasePathname().string());
+
+        for (int i = 0; i < iterations; i++) {
+            if (database.getAllPhotos().size() != DATABASE_PHOTO_COUNT ||
+                    database.getAllPhotoFiles().size() != DATABASE_PHOTO_COUNT) {
+
+                return "wrong number of photos";
+            }
+        }
+
+        return std::to_string(DATABASE_PHOTO_COUNT) + " photos and files";
+    }
+
+    /**
+     * Looking for a duplicate of an uploaded photo.
+     */
+    std::string benchDatabaseGetByHashBack(int iterations) {
+        Database database(databasePathname().string());
+
+        for (int i = 0; i < iterations; i++) {
+            if (!database.getPhotoByHashBack(makeHashBack(i % DATABASE_PHOTO_COUNT))) {
+                return "photo not found";
+            }
+        }
+
+        return "";
+    }
+
+    // ------------------------------------------------------------------------
+    // Slide cache.
+
+    /**
+     * Adding slides to a full cache, each evicting the least recently used
+     * one. The slides have no GPU texture so that this runs headless.
+     */
+    std::string benchSlideCacheEviction(int iterations) {
+        ThreadPool threadPool(1);
+        SlideCache slideCache(1920, 1080, std::shared_ptr<Image>(), threadPool);
+        Texture texture {
+            .id = 0,
+            .width = MAX_TEXTURE_SIZE,
+            .height = MAX_TEXTURE_SIZE*PHOTO_HEIGHT/PHOTO_WIDTH,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        };
+
+        int hitCount = 0;
+        for (int i = 0; i < iterations; i++) {
+            Photo photo {};
+            photo.id = i;
+            auto slide = std::make_shared<Slide>(photo, texture, Timing {}, Timing {}, false);
+            slide->touch();
+            slideCache.addSlide(slide);
+
+            // The slideshow asks about the slides around the current one.
+            for (int j = std::max(0, i - SLIDE_CACHE_SIZE + 1); j <= i; j++) {
+                Photo recent {};
+                recent.id = j;
+                if (slideCache.get(recent, false)) {
+                    hitCount++;
+                }
+            }
+        }
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "cache of %d, %.1f hits per op",
+                SLIDE_CACHE_SIZE, static_cast<double>(hitCount)/iterations);
+        return buffer;
+    }
+
+    // ------------------------------------------------------------------------
+    // Generated library.
+
+    // Set by --library.
+    std::filesystem::path gLibraryDir;
+
+    // Loaded from the library once, outside the timed part.
+    std::vector<Photo> gLibraryPhotos;
+    std::set<std::filesystem::path> gLibraryPathnames;
+
+    Config libraryConfig() {
+        Config config;
+        config.rootDir = gLibraryDir;
+        config.minRating = 3;
+        config.minDays = 0;
+        config.maxDays = 365*10;
+        return config;
+    }
+
+    std::string libraryDatabasePathname() {
+        return (gLibraryDir / "pislide.db").string();
+    }
+
+    void loadLibrary() {
+        if (gLibraryPhotos.empty()) {
+            gLibraryPhotos = Database(libraryDatabasePathname()).getAllPhotos();
+            gLibraryPathnames = traverseDirectoryTree(libraryConfig());
+        }
+    }
+
+    std::string benchLibraryScan(int iterations) {
+        Config config = libraryConfig();
+        size_t count = 0;
+        for (int i = 0; i < iterations; i++) {
+            count = traverseDirectoryTree(config).size();
+        }
+
+        return std::to_string(count) + " photos";
+    }
+
+    std::string benchLibraryLoadDatabase(int iterations) {
+        Database database(libraryDatabasePathname());
+        size_t count = 0;
+        for (int i = 0; i < iterations; i++) {
+            count = database.getAllPhotos().size() + database.getAllPhotoFiles().size();
+        }
+
+        return std::to_string(count) + " photos and files";
+    }
+
+    std::string benchLibraryFilter(int iterations) {
+        Config config = libraryConfig();
+        size_t count = 0;
+        for (int i = 0; i < iterations; i++) {
+            std::vector<Photo> photos = gLibraryPhotos;
+            filterPhotosByRating(photos, config);
+            filterPhotosByDate(photos, config);
+            count = photos.size();
+        }
+
+        return std::to_string(count) + " of " + std::to_string(gLibraryPhotos.size())
+            + " photos kept, including a copy";
+    }
+
+    std::string benchLibraryAssignPathnames(int iterations) {
+        Database database(libraryDatabasePathname());
+        Config config = libraryConfig();
+        size_t count = 0;
+        for (int i = 0; i < iterations; i++) {
+            count = assignPhotoPathnames(database, config, gLibraryPhotos, gLibraryPathnames).size();
+        }
+
+        return std::to_string(count) + " photos found on disk";
+    }
+
+    std::string benchLibraryLabels(int iterations) {
+        Config config = libraryConfig();
+        size_t length = 0;
+        auto beginTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            for (auto const &pathname : gLibraryPathnames) {
+                length += pathnameToLabel(config, pathname).size();
+            }
+        }
+        double elapsed = nanosecondsSince(beginTime);
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%.0f ns/label",
+                elapsed/iterations/std::max<size_t>(gLibraryPathnames.size(), 1));
+        return length > 0 ? buffer : "no labels";
+    }
+
+    std::string benchLibraryLoadPhoto(int iterations) {
+        std::vector<std::filesystem::path> pathnames(gLibraryPathnames.begin(), gLibraryPathnames.end());
+        if (pathnames.empty()) {
+            return "no photos";
+        }
+
+        // Spread across the library, like a shuffled slideshow.
+        for (int i = 0; i < iterations; i++) {
+            Photo photo {};
+            photo.absolutePathname = gLibraryDir / pathnames[i*7919 % pathnames.size()];
+            if (!ImageLoader::loadImage(photo).image) {
+                return "failed to load " + photo.absolutePathname.string();
+            }
+        }
+
+        return "";
+    }
+
+    std::vector<Benchmark> LIBRARY_BENCHMARKS = {
+        { "Library/traverseDirectoryTree", 3, benchLibraryScan },
+        { "Library/loadDatabase", 3, benchLibraryLoadDatabase },
+        { "Library/filterPhotos", 10, benchLibraryFilter, loadLibrary },
+        { "Library/assignPhotoPathnames", 3, benchLibraryAssignPathnames, loadLibrary },
+        { "Library/pathnameToLabel", 1, benchLibraryLabels, loadLibrary },
+        { "Library/loadPhoto", 100, benchLibraryLoadPhoto, loadLibrary },
+    };
+
+    std::vector<Benchmark> BENCHMARKS = {
+        { "ThreadSafeQueue/upload", 100, benchQueueUpload },
+        { "ThreadSafeQueue/uploadBurst", 200, [](int n) {
+            return benchUploadBurst(n, 0, OverflowPolicy::BLOCK); } },
+        { "ThreadSafeQueue/uploadBurstReject", 200, [](int n) {
+            return benchUploadBurst(n, 20, OverflowPolicy::REJECT); } },
+        { "ThreadSafeQueue/uploadBurstDropOldest", 200, [](int n) {
+            return benchUploadBurst(n, 20, OverflowPolicy::DROP_OLDEST); } },
+        { "Executor/roundTrip", 100, benchExecutorRoundTrip },
+        { "ThreadSafeQueue/emptyPoll", 1000000, benchEmptyPoll<ThreadSafeQueue<int>> },
+        { "SpscRingBuffer/emptyPoll", 1000000, benchEmptyPoll<SpscQueue<int>> },
+        { "MpscRingBuffer/emptyPoll", 1000000, benchEmptyPoll<MpscQueue<int>> },
+        { "ThreadSafeQueue/contention1", 100000, [](int n) { return benchContention<ThreadSafeQueue<int>>(n, 1); } },
+        { "SpscRingBuffer/contention1", 100000, [](int n) { return benchContention<SpscQueue<int>>(n, 1); } },
+        { "ThreadSafeQueue/contention4", 100000, [](int n) { return benchContention<ThreadSafeQueue<int>>(n, 4); } },
+        { "MpscRingBuffer/contention4", 100000, [](int n) { return benchContention<MpscQueue<int>>(n, 4); } },
+        { "ThreadPool/decodeBehindNetwork", 20, [](int n) { return benchDecodeBehindNetwork(n, 2); } },
+        { "ThreadPool/decodeBehindLimitedNetwork", 20, [](int n) { return benchDecodeBehindNetwork(n, 1); } },
+        { "Future/chain", 10000, benchFutureChain },
+        { "Future/whenAll", 10000, benchFutureWhenAll },
+        { "Twilio/download10Sequential", 5, [](int n) { return benchTwilioDownload(n, 10, 1); } },
+        { "Twilio/download10Parallel", 5, [](int n) {
+            return benchTwilioDownload(n, 10, TWILIO_MAX_PARALLEL_REQUESTS); } },
+        { "Json/twilioMessages5000Dom", 20, benchTwilioMessagesDom },
+        { "Json/twilioMessages5000Sax", 20, benchTwilioMessagesSax },
+        { "Logging/syncFlushEach", 20000, [](int n) { return benchLogging(n, false, true); } },
+        { "Logging/sync", 20000, [](int n) { return benchLogging(n, false, false); } },
+        { "Logging/async", 20000, [](int n) { return benchLogging(n, true, false); } },
+        { "Image/loadPhoto", 5, benchLoadPhoto, makeJpeg, removeBenchDir },
+        { "Image/decodeJpeg", 5, benchDecodeJpeg, makeJpeg, removeBenchDir },
+        { "Image/resizeImageToFit", 5, benchResizeImageToFit, makeJpeg, removeBenchDir },
+        { "Image/drawTransparentBorder", 20, benchDrawTransparentBorder },
+        { "Sha1/hex1MB", 100, benchSha1Hex },
+        { "Label/pathnameToLabel", 10000, benchPathnameToLabel },
+        { "Scanner/traverseDirectoryTree", 10, benchTraverseDirectoryTree, makeTree, removeBenchDir },
+        { "Database/insert", 200, benchDatabaseInsert, []() { makeDatabase(0); }, removeBenchDir },
+        { "Database/getAll", 10, benchDatabaseGetAll,
+            []() { makeDatabase(DATABASE_PHOTO_COUNT); }, removeBenchDir },
+        { "Database/getByHashBack", 10000, benchDatabaseGetByHashBack,
+            []() { makeDatabase(DATABASE_PHOTO_COUNT); }, removeBenchDir },
+        { "SlideCache/eviction", 10000, benchSlideCacheEviction },
+    };
+}
+
+int main(int argc, char *argv[]) {
+    std::string filter;
+    std::string jsonPathname;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPathname = argv[++i];
+        } else if (arg == "--library" && i + 1 < argc) {
+            gLibraryDir = argv[++i];
+        } else {
+            std::cerr << "Usage: pislide-bench [--filter SUBSTRING] [--json PATHNAME] [--library DIR]\n";
+            return 1;
+        }
+    }
+    if (!gLibraryDir.empty()) {
+        BENCHMARKS.insert(BENCHMARKS.end(), LIBRARY_BENCHMARKS.begin(), LIBRARY_BENCHMARKS.end());
+    }
+
+    // Raylib logs every image it loads.
+    SetTraceLogLevel(LOG_WARNING);
+
+    nlohmann::json results = nlohmann::json::array();
+    for (auto const &benchmark : BENCHMARKS) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        if (benchmark.setup) {
+            benchmark.setup();
+        }
+        auto beginTime = std::chrono::steady_clock::now();
+        std::string info = benchmark.run(benchmark.iterations);
+        double elapsed = nanosecondsSince(beginTime);
+        if (benchmark.teardown) {
+            benchmark.teardown();
+        }
+
+        double nsPerOp = elapsed/benchmark.iterations;
+        printf("%-32s %12.0f ns/op   %s\n", benchmark.name.c_str(), nsPerOp, info.c_str());
+        results.push_back({
+            { "name", benchmark.name },
+            { "iterations", benchmark.iterations },
+            { "ns_per_op", nsPerOp },
+            { "info", info },
+        });
+    }
+
+    if (!jsonPathname.empty()) {
+        nlohmann::json output = {
+            { "time", std::time(nullptr) },
+            { "hardware_concurrency", std::thread::hardware_concurrency() },
+            { "benchmarks", results },
+        };
+        std::ofstream f(jsonPathname);
+        f << output.dump(2) << '\n';
+        if (!f) {
+            std::cerr << "Can't write " << jsonPathname << '\n';
+            return 1;
+        }
+    }
+
+    return 0;
+}
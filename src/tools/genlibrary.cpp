@@ -0,0 +1,497 @@
+
+// Generates a synthetic photo library for scale testing: a tree of small
+// JPEGs named like real ones (dated event directories, camera filenames,
+// Twilio SIDs) with assorted EXIF orientations, and a matching pislide.db,
+// so that the slideshow and pislide-bench can be run against 10k, 100k, or
+// 1M photos without a real library.
+//
+// Usage: pislide-genlibrary [--root DIR] [--photos N] [--depth N]
+//     [--per-dir N] [--width PIXELS] [--height PIXELS] [--distinct N]
+//     [--seed N] [--no-database] [--config PATHNAME]
+//
+// Labels are made from the pathnames with the label rules (bad prefixes and
+// parts) of the given config file, if any. The database is written to
+// DIR/pislide.db. Run pislide from DIR with "root_dir" set to DIR, or pass
+// DIR to pislide-bench --library.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <raylib.h>
+#include <sqlite3.h>
+#include <spdlog/spdlog.h>
+
+#include "config.h"
+#include "model.h"
+#include "label.h"
+#include "util.h"
+#include "schema.h"
+
+namespace {
+    // Year directories, starting in 2000.
+    constexpr int YEAR_COUNT = 25;
+
+    // Subdirectories per directory below the event directories.
+    constexpr int ROLL_COUNT = 4;
+
+    // Days of each year that events are spread over. Leaves out the leap
+    // day so that every year has them all.
+    constexpr int DAYS_PER_YEAR = 365;
+
+    // Seconds after midnight that an event's first photo is taken, and
+    // the time its photos are spread over, so they stay in its day.
+    constexpr time_t EVENT_START_S = 9*60*60;
+    constexpr time_t EVENT_LENGTH_S = 15*60*60 - 1;
+
+    // Fraction of photos that came in by text message.
+    constexpr double TWILIO_FRACTION = 0.05;
+
+    // Directory below the root for photos that came in by text message.
+    constexpr char const *TWILIO_SUBDIR = "twilio";
+
+    std::array<char const *,16> EVENT_NAMES = {
+        "Beach_day", "Birthday party", "Hiking", "Thanksgiving",
+        "Camping_trip", "Graduation", "Wedding", "Christmas",
+        "Ski trip", "Zoo", "First day of school", "Road_trip",
+        "Halloween", "Picnic", "Family reunion", "Fourth of July",
+    };
+
+    // EXIF orientations we generate, and how much PiSlide rotates each.
+    struct Orientation {
+        uint16_t exif;
+        int rotation;
+    };
+    std::array<Orientation,4> ORIENTATIONS = {{
+        { 1, 0 },
+        { 3, 180 },
+        { 6, -90 },
+        { 8, 90 },
+    }};
+
+    struct Options final {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "pislide-library";
+        int photos = 10000;
+        int depth = 2;
+        int perDir = 100;
+        int width = 640;
+        int height = 480;
+        int distinct = 16;
+        uint32_t seed = 1;
+        bool database = true;
+        std::filesystem::path configPathname;
+    };
+
+    /**
+     * The bytes of a JPEG and its orientation. Photos are written as one
+     * of these plus a unique trailer, which decoders ignore but which
+     * makes every file's hashes different.
+     */
+    struct JpegTemplate final {
+        std::string bytes;
+        Orientation orientation;
+    };
+
+    /**
+     * A photo's place in the library and what the database says about it.
+     */
+    struct SyntheticPhoto final {
+        std::filesystem::path pathname;
+        time_t date;
+    };
+
+    /**
+     * Make an EXIF segment (APP1) with just an orientation tag.
+     */
+    std::string makeExifSegment(uint16_t orientation) {
+        std::string exif;
+        auto put16 = [&exif](uint16_t value) {
+            exif += static_cast<char>(value & 0xFF);
+            exif += static_cast<char>(value >> 8);
+        };
+        auto put32 = [&put16](uint32_t value) {
+            put16(value & 0xFFFF);
+            put16(value >> 16);
+        };
+
+        exif.append("Exif\0\0", 6);
+        // Little-endian TIFF header, with the first IFD right after it.
+        exif += "II";
+        put16(42);
+        put32(8);
+        // One entry: Orientation, a SHORT, in the value field.
+        put16(1);
+        put16(0x0112);
+        put16(3);
+        put32(1);
+        put32(orientation);
+        // No next IFD.
+        put32(0);
+
+        // The segment length is big-endian and includes itself.
+        size_t length = exif.size() + 2;
+        return std::string { '\xFF', '\xE1',
+            static_cast<char>(length >> 8), static_cast<char>(length & 0xFF) } + exif;
+    }
+
+    /**
+     * Encode a checkerboard JPEG in a color that depends on "index", with
+     * an EXIF orientation. raylib only encodes JPEGs to files, so this goes
+     * through a temporary file in "dir".
+     */
+    JpegTemplate makeJpegTemplate(Options const &options, int index,
+            std::filesystem::path const &dir) {
+
+        unsigned char r = static_cast<unsigned char>(64 + index*53 % 192);
+        unsigned char g = static_cast<unsigned char>(64 + index*97 % 192);
+        unsigned char b = static_cast<unsigned char>(64 + index*151 % 192);
+        Image image = GenImageChecked(options.width, options.height, 8 + index % 8, 6 + index % 6,
+                Color { r, g, b, 255 }, Color { static_cast<unsigned char>(255 - r), g, b, 255 });
+
+        // The extension tells raylib to write a JPEG.
+        std::filesystem::path tempPathname = dir / ".template.jpg";
+        bool success = ExportImage(image, tempPathname.c_str());
+        UnloadImage(image);
+        if (!success) {
+            throw std::runtime_error("can't write " + tempPathname.string());
+        }
+        std::vector<std::byte> bytes = readFileBytes(tempPathname);
+        std::filesystem::remove(tempPathname);
+
+        // Make sure we got a JPEG before putting EXIF after its start-of-image marker.
+        std::string jpeg(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+        if (!jpeg.starts_with("\xFF\xD8")) {
+            throw std::runtime_error("can't encode JPEG");
+        }
+
+        Orientation orientation = ORIENTATIONS[index % ORIENTATIONS.size()];
+        jpeg.insert(2, makeExifSegment(orientation.exif));
+
+        return JpegTemplate {
+            .bytes = std::move(jpeg),
+            .orientation = orientation,
+        };
+    }
+
+    /**
+     * Midnight UTC of the day "dayIndex" days into the year.
+     */
+    time_t dayInYear(int year, int dayIndex) {
+        std::tm tm {};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = 0;
+        tm.tm_mday = 1 + dayIndex;
+        return timegm(&tm);
+    }
+
+    std::string formatDate(time_t date, char const *format) {
+        std::tm tm = *std::gmtime(&date);
+        char buffer[64];
+        std::strftime(buffer, sizeof(buffer), format, &tm);
+        return buffer;
+    }
+
+    /**
+     * Where the "index"th photo goes and when it was taken. Photos fill
+     * directories "perDir" at a time: a year directory, then a dated event
+     * directory, then roll directories for the remaining depth. Each
+     * directory's photos are named in the style of one camera.
+     */
+    SyntheticPhoto placePhoto(Options const &options, int index, bool twilio) {
+        if (twilio) {
+            time_t date = dayInYear(2024, 0) + static_cast<time_t>(index)*600;
+            return SyntheticPhoto {
+                .pathname = std::filesystem::path(TWILIO_SUBDIR)
+                    / ("ME" + sha1Hex(&index, sizeof(index)).substr(0, 32) + ".jpg"),
+                .date = date,
+            };
+        }
+
+        int leaf = index/options.perDir;
+        int year = 2000 + leaf % YEAR_COUNT;
+        int rest = leaf/YEAR_COUNT;
+
+        // Roll directories take the low digits of "rest", events the rest.
+        std::vector<int> rolls;
+        int rollCount = 1;
+        for (int level = 2; level < options.depth; level++) {
+            rolls.insert(rolls.begin(), rest % ROLL_COUNT);
+            rest /= ROLL_COUNT;
+            rollCount *= ROLL_COUNT;
+        }
+        int event = rest;
+
+        // Events are a day apart, wrapping around within the year so that
+        // the dates match the year directory. Events that land on a day
+        // that's already taken get a number to keep their directory apart.
+        int eventDay = event % DAYS_PER_YEAR;
+        int eventCycle = event/DAYS_PER_YEAR;
+        time_t eventDate = dayInYear(year, eventDay);
+
+        // Photos in an event are a minute apart from the morning, closer if
+        // that's needed to fit them all in the day.
+        int rollIndex = 0;
+        for (int roll : rolls) {
+            rollIndex = rollIndex*ROLL_COUNT + roll;
+        }
+        int photoInEvent = rollIndex*options.perDir + index % options.perDir;
+        int eventPhotoCount = options.perDir*rollCount;
+        time_t interval = std::clamp<time_t>(EVENT_LENGTH_S/eventPhotoCount, 1, 60);
+        time_t date = eventDate + EVENT_START_S + photoInEvent*interval;
+
+        std::filesystem::path pathname = std::to_string(year);
+        if (options.depth >= 2) {
+            std::string eventName = formatDate(eventDate, "%Y-%m-%d ")
+                + EVENT_NAMES[event % EVENT_NAMES.size()];
+            if (eventCycle > 0) {
+                eventName += " " + std::to_string(eventCycle + 1);
+            }
+            pathname /= eventName;
+        }
+        for (int roll : rolls) {
+            pathname /= "Roll " + std::to_string(roll + 1);
+        }
+
+        char filename[64];
+        switch (leaf % 4) {
+            case 0:
+                snprintf(filename, sizeof(filename), "IMG_%04d.JPG", index);
+                break;
+            case 1:
+                snprintf(filename, sizeof(filename), "P%07d.JPG", 1000000 + index);
+                break;
+            case 2:
+                snprintf(filename, sizeof(filename), "DSC%05d.JPG", index);
+                break;
+            default:
+                snprintf(filename, sizeof(filename), "%s.jpg",
+                        formatDate(date, "%Y-%m-%d %H.%M.%S").c_str());
+                break;
+        }
+
+        return SyntheticPhoto {
+            .pathname = pathname / filename,
+            .date = date,
+        };
+    }
+
+    /**
+     * Most photos are unrated, a few are favorites or rejects.
+     */
+    int randomRating(std::mt19937 &random) {
+        std::discrete_distribution<int> distribution({ 0, 5, 10, 60, 20, 5 });
+        return distribution(random);
+    }
+
+    /**
+     * Inserts photos into the database in one transaction.
+     */
+    class DatabaseWriter final {
+        sqlite3 *mDb;
+        sqlite3_stmt *mInsertPhoto = nullptr;
+        sqlite3_stmt *mInsertPhotoFile = nullptr;
+
+        void prepare(char const *sql, sqlite3_stmt **stmt) {
+            if (sqlite3_prepare_v2(mDb, sql, -1, stmt, nullptr) != SQLITE_OK) {
+                throw std::runtime_error(sqlite3_errmsg(mDb));
+            }
+        }
+
+        void step(sqlite3_stmt *stmt) {
+            int rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_DONE) {
+                throw std::runtime_error(sqlite3_errmsg(mDb));
+            }
+        }
+
+    public:
+        explicit DatabaseWriter(std::filesystem::path const &pathname)
+            : mDb(createDatabase(pathname)) {
+
+            prepare("INSERT INTO photo (id, hash_back, rotation, rating, date, display_date, label) "
+                    "VALUES (NULL, ?, ?, ?, ?, ?, ?)", &mInsertPhoto);
+            prepare("INSERT INTO photo_file (pathname, hash_all, hash_back) VALUES (?, ?, ?)",
+                    &mInsertPhotoFile);
+            execSql(mDb, "BEGIN");
+        }
+
+        ~DatabaseWriter() {
+            sqlite3_finalize(mInsertPhoto);
+            sqlite3_finalize(mInsertPhotoFile);
+            sqlite3_close(mDb);
+        }
+
+        // Can't copy.
+        DatabaseWriter(const DatabaseWriter &) = delete;
+        DatabaseWriter &operator=(const DatabaseWriter &) = delete;
+
+        void add(Photo const &photo, FileHashes const &hashes) {
+            sqlite3_bind_text(mInsertPhoto, 1, photo.hashBack.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(mInsertPhoto, 2, photo.rotation);
+            sqlite3_bind_int(mInsertPhoto, 3, photo.rating);
+            sqlite3_bind_int64(mInsertPhoto, 4, photo.date);
+            sqlite3_bind_text(mInsertPhoto, 5, photo.displayDate.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(mInsertPhoto, 6, photo.label.c_str(), -1, SQLITE_TRANSIENT);
+            step(mInsertPhoto);
+
+            sqlite3_bind_text(mInsertPhotoFile, 1, photo.pathname.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(mInsertPhotoFile, 2, hashes.hashAll.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(mInsertPhotoFile, 3, hashes.hashBack.c_str(), -1, SQLITE_TRANSIENT);
+            step(mInsertPhotoFile);
+        }
+
+        void commit() {
+            execSql(mDb, "COMMIT");
+        }
+    };
+
+    void generate(Options const &options) {
+        if (std::filesystem::exists(options.root) && !std::filesystem::is_empty(options.root)) {
+            throw std::invalid_argument(options.root.string() + " already exists and isn't empty");
+        }
+        std::filesystem::create_directories(options.root);
+
+        std::vector<JpegTemplate> templates;
+        for (int i = 0; i < options.distinct; i++) {
+            templates.push_back(makeJpegTemplate(options, i, options.root));
+        }
+
+        std::optional<DatabaseWriter> databaseWriter;
+        if (options.database) {
+            databaseWriter.emplace(options.root / "pislide.db");
+        }
+
+        Config config;
+        if (!options.configPathname.empty() && !config.readConfigFile(options.configPathname)) {
+            throw std::invalid_argument("can't read " + options.configPathname.string());
+        }
+        config.rootDir = options.root;
+        config.twilioSubdir = TWILIO_SUBDIR;
+
+        std::mt19937 random(options.seed);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::filesystem::path previousDir;
+        uint64_t byteCount = 0;
+        auto beginTime = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < options.photos; i++) {
+            bool twilio = unit(random) < TWILIO_FRACTION;
+            SyntheticPhoto syntheticPhoto = placePhoto(options, i, twilio);
+            JpegTemplate const &jpeg = templates[random() % templates.size()];
+
+            std::filesystem::path absolutePathname = options.root / syntheticPhoto.pathname;
+            if (absolutePathname.parent_path() != previousDir) {
+                previousDir = absolutePathname.parent_path();
+                std::filesystem::create_directories(previousDir);
+            }
+
+            std::string trailer = "PiSlide synthetic photo " + std::to_string(i) + "\n";
+            std::ofstream file(absolutePathname, std::ios::binary);
+            file.write(jpeg.bytes.data(), jpeg.bytes.size());
+            file.write(trailer.data(), trailer.size());
+            if (!file) {
+                throw std::runtime_error("can't write " + absolutePathname.string());
+            }
+            byteCount += jpeg.bytes.size() + trailer.size();
+
+            if (databaseWriter) {
+                FileHasher hasher;
+                hasher.update(jpeg.bytes.data(), jpeg.bytes.size());
+                hasher.update(trailer.data(), trailer.size());
+                FileHashes hashes = hasher.finish();
+
+                Photo photo {
+                    .id = 0,
+                    .hashBack = hashes.hashBack,
+                    .rotation = jpeg.orientation.rotation,
+                    .rating = randomRating(random),
+                    .date = syntheticPhoto.date,
+                    .displayDate = formatDate(syntheticPhoto.date, "%B %-d, %Y"),
+                    .label = pathnameToLabel(config, syntheticPhoto.pathname),
+                    .pathname = syntheticPhoto.pathname,
+                };
+                databaseWriter->add(photo, hashes);
+            }
+
+            if ((i + 1) % 10000 == 0) {
+                std::cout << "    " << (i + 1) << " photos\n";
+            }
+        }
+
+        if (databaseWriter) {
+            databaseWriter->commit();
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - beginTime;
+        printf("Wrote %d photos (%.1f MB) to %s in %.1f s\n", options.photos,
+                byteCount/1e6, options.root.c_str(), elapsed.count());
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--root" && hasValue) {
+                options.root = argv[++i];
+            } else if (arg == "--photos" && hasValue) {
+                options.photos = std::stoi(argv[++i]);
+            } else if (arg == "--depth" && hasValue) {
+                options.depth = std::stoi(argv[++i]);
+            } else if (arg == "--per-dir" && hasValue) {
+                options.perDir = std::stoi(argv[++i]);
+            } else if (arg == "--width" && hasValue) {
+                options.width = std::stoi(argv[++i]);
+            } else if (arg == "--height" && hasValue) {
+                options.height = std::stoi(argv[++i]);
+            } else if (arg == "--distinct" && hasValue) {
+                options.distinct = std::stoi(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "--no-database") {
+                options.database = false;
+            } else if (arg == "--config" && hasValue) {
+                options.configPathname = argv[++i];
+            } else {
+                throw std::invalid_argument("unknown flag " + arg);
+            }
+        }
+        if (options.photos < 0 || options.depth < 1 || options.perDir < 1 ||
+                options.width < 1 || options.height < 1 || options.distinct < 1) {
+
+            throw std::invalid_argument("counts and sizes must be positive");
+        }
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << '\n';
+        std::cerr << "Usage: pislide-genlibrary [--root DIR] [--photos N] [--depth N] [--per-dir N]\n"
+            "    [--width PIXELS] [--height PIXELS] [--distinct N] [--seed N] [--no-database]\n"
+            "    [--config PATHNAME]\n";
+        return 1;
+    }
+
+    // Raylib logs every image it makes.
+    SetTraceLogLevel(LOG_WARNING);
+
+    try {
+        generate(options);
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
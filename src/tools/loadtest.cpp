@@ -0,0 +1,186 @@
+
+// Load test of PiSlide's network fetches. Drives TwilioFetcher and BusInfo
+// against a local MockServer, the way the render loop does, and reports
+// their throughput and latency.
+//
+// Usage: pislide-loadtest [--fetches N] [--latency MS] [--error-every N]
+//     [--messages N] [--image-size BYTES] [--buses N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "threadpool.h"
+#include "twiliofetcher.h"
+#include "businfo.h"
+#include "mockserver.h"
+
+namespace {
+    // Give up on a fetch that takes longer than this.
+    constexpr auto FETCH_TIMEOUT = std::chrono::seconds(30);
+
+    /**
+     * Latencies of a series of fetches.
+     */
+    struct Results final {
+        std::vector<double> latencies;
+        size_t itemCount = 0;
+        size_t failureCount = 0;
+        double elapsed = 0;
+
+        // Latency at this fraction of the sorted list, in seconds.
+        double percentile(double p) const {
+            if (latencies.empty()) {
+                return 0;
+            }
+            std::vector<double> sorted = latencies;
+            std::sort(sorted.begin(), sorted.end());
+            size_t index = std::min(static_cast<size_t>(p*sorted.size()), sorted.size() - 1);
+            return sorted[index];
+        }
+
+        void print(char const *name, char const *itemName) const {
+            printf("%-8s %5zu fetches %5zu failed %7zu %-7s %8.1f %s/s   "
+                    "p50 %7.1f ms  p90 %7.1f ms  p99 %7.1f ms  max %7.1f ms\n",
+                    name, latencies.size(), failureCount, itemCount, itemName,
+                    elapsed > 0 ? itemCount/elapsed : 0, itemName,
+                    percentile(0.50)*1000, percentile(0.90)*1000,
+                    percentile(0.99)*1000, percentile(1.00)*1000);
+        }
+    };
+
+    /**
+     * Call done() and run main thread tasks, like the render loop, until
+     * it returns true or we time out. Returns whether it finished.
+     */
+    template <typename F>
+    bool runUntil(ThreadPool &threadPool, F &&done) {
+        auto deadline = std::chrono::steady_clock::now() + FETCH_TIMEOUT;
+        while (!done()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            if (threadPool.runMainThreadTasks() == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        return true;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point beginTime) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - beginTime;
+        return elapsed.count();
+    }
+
+    /**
+     * Fetch from Twilio back to back. Each fetch gets a new batch of messages.
+     */
+    Results loadTwilio(ThreadPool &threadPool, Config const &config, int fetches) {
+        Results results;
+        TwilioFetcher fetcher(config, threadPool);
+
+        auto beginTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < fetches; i++) {
+            auto fetchBeginTime = std::chrono::steady_clock::now();
+            fetcher.initiateFetch();
+            bool finished = runUntil(threadPool, [&fetcher]() { return !fetcher.isFetching(); });
+            results.latencies.push_back(secondsSince(fetchBeginTime));
+
+            size_t imageCount = fetcher.get().size();
+            results.itemCount += imageCount;
+            if (!finished || imageCount == 0) {
+                results.failureCount++;
+            }
+            if (!finished) {
+                // Can't start another one while this one is outstanding.
+                break;
+            }
+        }
+        results.elapsed = secondsSince(beginTime);
+
+        return results;
+    }
+
+    /**
+     * Fetch bus arrivals back to back.
+     */
+    Results loadBus(ThreadPool &threadPool, Config const &config, int fetches) {
+        Results results;
+        BusInfo busInfo(threadPool);
+
+        auto beginTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < fetches; i++) {
+            auto fetchBeginTime = std::chrono::steady_clock::now();
+            busInfo.refresh(config);
+            bool finished = runUntil(threadPool, [&busInfo]() { return busInfo.receive(); });
+            results.latencies.push_back(secondsSince(fetchBeginTime));
+
+            if (finished && busInfo.failureCount() == 0) {
+                results.itemCount += busInfo.times().times.size();
+            } else {
+                results.failureCount++;
+            }
+            if (!finished) {
+                // Can't start another one while this one is outstanding.
+                break;
+            }
+        }
+        results.elapsed = secondsSince(beginTime);
+
+        return results;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    MockServerOptions options;
+    options.latency = std::chrono::milliseconds(20);
+    int fetches = 50;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--fetches" && i + 1 < argc) {
+                fetches = std::stoi(argv[++i]);
+            } else if (!options.parseFlag(argc, argv, i)) {
+                throw std::invalid_argument("unknown flag " + arg);
+            }
+        }
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << '\n';
+        std::cerr << "Usage: pislide-loadtest [--fetches N] " << MockServerOptions::FLAGS_USAGE << '\n';
+        return 1;
+    }
+
+    // The fetchers log every fetch.
+    spdlog::set_level(spdlog::level::warn);
+
+    MockServer server(options);
+
+    Config config;
+    server.configure(config);
+    config.rootDir = std::filesystem::temp_directory_path() / "pislide-loadtest";
+    config.twilioSubdir = "twilio";
+    config.twilioStateFile = "";
+
+    ThreadPool threadPool(static_cast<int>(std::thread::hardware_concurrency()));
+
+    printf("%d fetches, %d messages per poll, %lld ms latency, error every %d requests\n",
+            fetches, options.messagesPerPoll,
+            static_cast<long long>(options.latency.count()), options.errorEvery);
+    loadTwilio(threadPool, config, fetches).print("Twilio", "images");
+    loadBus(threadPool, config, fetches).print("511.org", "buses");
+    printf("%llu requests over %zu connections\n",
+            static_cast<unsigned long long>(server.requestCount()), server.connectionCount());
+
+    std::filesystem::remove_all(config.rootDir);
+
+    return 0;
+}
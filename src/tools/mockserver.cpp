@@ -0,0 +1,266 @@
+
+#include <algorithm>
+#include <ctime>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#include "mockserver.h"
+
+namespace {
+    // Account SID the server answers to.
+    std::string const ACCOUNT_SID = "AC0";
+    std::string const ACCOUNT_PATH = "/2010-04-01/Accounts/" + ACCOUNT_SID;
+
+    // Date of the first batch of messages (2025-11-01 00:00:00 UTC). Each
+    // batch is a minute after the previous one.
+    constexpr std::time_t FIRST_BATCH_TIME = 1761955200;
+    constexpr std::time_t BATCH_INTERVAL_S = 60;
+
+    // Twilio's default page size.
+    constexpr int DEFAULT_PAGE_SIZE = 50;
+
+    // Format a time the way Twilio does, such as "Sat, 01 Nov 2025 20:00:00 +0000".
+    std::string formatTwilioDate(std::time_t t) {
+        struct std::tm tm = {};
+        gmtime_r(&t, &tm);
+        char buf[64];
+        std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S +0000", &tm);
+        return buf;
+    }
+
+    // Format a time the way 511.org does, such as "2025-11-01T20:00:00Z".
+    std::string formatIsoDate(std::time_t t) {
+        struct std::tm tm = {};
+        gmtime_r(&t, &tm);
+        char buf[64];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        return buf;
+    }
+
+    // Integer query parameter, or the default if missing or bad.
+    int getIntParam(httplib::Request const &req, std::string const &key, int defaultValue) {
+        if (!req.has_param(key)) {
+            return defaultValue;
+        }
+        try {
+            return std::stoi(req.get_param_value(key));
+        } catch (std::exception const &) {
+            return defaultValue;
+        }
+    }
+}
+
+bool MockServerOptions::parseFlag(int argc, char *argv[], int &i) {
+    std::string flag = argv[i];
+    if (flag != "--latency" && flag != "--error-every" && flag != "--messages" &&
+            flag != "--image-size" && flag != "--buses") {
+
+        return false;
+    }
+    if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + flag);
+    }
+    int value = std::stoi(argv[++i]);
+
+    if (flag == "--latency") {
+        latency = std::chrono::milliseconds(value);
+    } else if (flag == "--error-every") {
+        errorEvery = value;
+    } else if (flag == "--messages") {
+        messagesPerPoll = value;
+    } else if (flag == "--image-size") {
+        imageSize = value;
+    } else {
+        busArrivals = value;
+    }
+    return true;
+}
+
+MockServer::MockServer(MockServerOptions const &options, std::string const &host, int port)
+    : mOptions(options), mImage(options.imageSize, 'x') {
+
+    mServer.Get(ACCOUNT_PATH + "/Messages.json", [this](
+                httplib::Request const &req, httplib::Response &res) {
+        handleMessages(req, res);
+    });
+    mServer.Get(ACCOUNT_PATH + "/Messages/:message/Media.json", [this](
+                httplib::Request const &req, httplib::Response &res) {
+        handleMediaList(req, res);
+    });
+    mServer.Get(ACCOUNT_PATH + "/Messages/:message/Media/:media", [this](
+                httplib::Request const &req, httplib::Response &res) {
+        handleMedia(req, res);
+    });
+    // Deletes always work and do nothing.
+    mServer.Delete(ACCOUNT_PATH + "/Messages/.*", [this](
+                httplib::Request const &req, httplib::Response &res) {
+        if (beginRequest(req, res)) {
+            res.status = httplib::NoContent_204;
+        }
+    });
+    mServer.Get("/transit/StopMonitoring", [this](
+                httplib::Request const &req, httplib::Response &res) {
+        handleStopMonitoring(req, res);
+    });
+
+    // Like a real server, keep connections open for many requests.
+    mServer.set_keep_alive_max_count(1000);
+    if (port == 0) {
+        mPort = mServer.bind_to_any_port(host);
+    } else {
+        mPort = mServer.bind_to_port(host, port) ? port : -1;
+    }
+    if (mPort < 0) {
+        throw std::runtime_error("can't bind mock server to " + host);
+    }
+    mThread = std::thread([this]() {
+        mServer.listen_after_bind();
+    });
+    mServer.wait_until_ready();
+}
+
+MockServer::~MockServer() {
+    mServer.stop();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+std::string MockServer::url() const {
+    return "http://127.0.0.1:" + std::to_string(mPort);
+}
+
+void MockServer::configure(Config &config) const {
+    config.twilioSid = ACCOUNT_SID;
+    config.twilioToken = "token";
+    config.twilioBaseUrl = url();
+    config.bus511orgToken = "token";
+    config.bus511orgAgency = "SF";
+    config.bus511orgStopCode = "12345";
+    config.bus511orgBaseUrl = url();
+}
+
+size_t MockServer::connectionCount() {
+    std::lock_guard lock(mMutex);
+    return mClientPorts.size();
+}
+
+void MockServer::wait() {
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+bool MockServer::beginRequest(httplib::Request const &req, httplib::Response &res) {
+    uint64_t requestNumber = ++mRequestCount;
+    {
+        std::lock_guard lock(mMutex);
+        mClientPorts.insert(req.remote_port);
+    }
+    std::this_thread::sleep_for(mOptions.latency);
+
+    if (mOptions.errorEvery > 0 && requestNumber % mOptions.errorEvery == 0) {
+        res.status = httplib::InternalServerError_500;
+        res.set_content("{\"message\":\"Injected error\"}", "application/json");
+        return false;
+    }
+
+    return true;
+}
+
+void MockServer::handleMessages(httplib::Request const &req, httplib::Response &res) {
+    if (!beginRequest(req, res)) {
+        return;
+    }
+
+    // The first page starts a new batch, later pages say which batch they're in.
+    int pageSize = std::max(getIntParam(req, "PageSize", DEFAULT_PAGE_SIZE), 1);
+    int page = getIntParam(req, "Page", 0);
+    int batch = req.has_param("Batch") ? getIntParam(req, "Batch", 0) : mBatchCount++;
+    std::string dateSent = formatTwilioDate(FIRST_BATCH_TIME + batch*BATCH_INTERVAL_S);
+
+    nlohmann::json messages = nlohmann::json::array();
+    int begin = page*pageSize;
+    int end = std::min(begin + pageSize, mOptions.messagesPerPoll);
+    for (int i = begin; i < end; i++) {
+        std::string sid = "MM" + std::to_string(batch) + "-" + std::to_string(i);
+        std::string uri = ACCOUNT_PATH + "/Messages/" + sid;
+        messages.push_back({
+            { "sid", sid },
+            { "uri", uri + ".json" },
+            { "num_media", "1" },
+            { "direction", "inbound" },
+            { "from", "+14155550100" },
+            { "date_sent", dateSent },
+            { "subresource_uris", { { "media", uri + "/Media.json" } } },
+        });
+    }
+
+    nlohmann::json nextPageUri = nullptr;
+    if (end < mOptions.messagesPerPoll) {
+        nextPageUri = ACCOUNT_PATH + "/Messages.json?PageSize=" + std::to_string(pageSize) +
+            "&Page=" + std::to_string(page + 1) + "&Batch=" + std::to_string(batch);
+    }
+
+    nlohmann::json body = {
+        { "messages", messages },
+        { "next_page_uri", nextPageUri },
+    };
+    res.set_content(body.dump(), "application/json");
+}
+
+void MockServer::handleMediaList(httplib::Request const &req, httplib::Response &res) {
+    if (!beginRequest(req, res)) {
+        return;
+    }
+
+    std::string message = req.path_params.at("message");
+    std::string sid = "ME" + message.substr(2);
+    nlohmann::json body = {
+        { "media_list", {
+            {
+                { "sid", sid },
+                { "content_type", "image/jpeg" },
+                { "uri", ACCOUNT_PATH + "/Messages/" + message + "/Media/" + sid + ".json" },
+            },
+        } },
+    };
+    res.set_content(body.dump(), "application/json");
+}
+
+void MockServer::handleMedia(httplib::Request const &req, httplib::Response &res) {
+    if (!beginRequest(req, res)) {
+        return;
+    }
+
+    res.set_content(mImage, "image/jpeg");
+}
+
+void MockServer::handleStopMonitoring(httplib::Request const &req, httplib::Response &res) {
+    if (!beginRequest(req, res)) {
+        return;
+    }
+
+    // A bus every five minutes, starting soon.
+    std::time_t now = std::time(nullptr);
+    nlohmann::json visits = nlohmann::json::array();
+    for (int i = 0; i < mOptions.busArrivals; i++) {
+        visits.push_back({
+            { "MonitoredVehicleJourney", {
+                { "MonitoredCall", {
+                    { "ExpectedArrivalTime", formatIsoDate(now + 60 + i*5*60) },
+                } },
+            } },
+        });
+    }
+
+    nlohmann::json body = {
+        { "ServiceDelivery", {
+            { "StopMonitoringDelivery", {
+                { "MonitoredStopVisit", visits },
+            } },
+        } },
+    };
+    res.set_content(body.dump(), "application/json");
+}
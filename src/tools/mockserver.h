@@ -0,0 +1,114 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <httplib.h>
+
+#include "config.h"
+
+/**
+ * Knobs for MockServer.
+ */
+struct MockServerOptions final {
+    // Minimum time each request takes, like a round trip to the real service.
+    std::chrono::milliseconds latency{0};
+    // Fail every Nth request with a 500, or zero to never fail.
+    int errorEvery = 0;
+    // New inbound messages in each Twilio message listing, each with one JPEG.
+    int messagesPerPoll = 10;
+    // Size of each Twilio image, in bytes.
+    size_t imageSize = 200*1024;
+    // Number of predicted arrivals in each 511.org response.
+    int busArrivals = 3;
+
+    /**
+     * If argv[i] is one of the flags in FLAGS_USAGE, parse its value into
+     * these options, leave i on the value, and return true. Throws if the
+     * value is missing or bad.
+     */
+    bool parseFlag(int argc, char *argv[], int &i);
+
+    static constexpr char const *FLAGS_USAGE =
+        "[--latency MS] [--error-every N] [--messages N] [--image-size BYTES] [--buses N]";
+};
+
+/**
+ * Local stand-in for the parts of the Twilio and 511.org APIs that we use,
+ * serving canned responses so that fetches can be tested and timed offline
+ * and repeatably. Every Twilio message listing returns a new batch of
+ * messages, newer than the previous batch, like a steady stream of guests
+ * texting photos. Serves on a background thread until destroyed.
+ */
+class MockServer final {
+    MockServerOptions mOptions;
+    httplib::Server mServer;
+    std::thread mThread;
+    int mPort;
+
+    // The image served for every Twilio media.
+    std::string mImage;
+    // Number of Twilio message listings started.
+    std::atomic<int> mBatchCount = 0;
+    // Number of requests received.
+    std::atomic<uint64_t> mRequestCount = 0;
+
+    // Client ports seen, to count connections.
+    std::mutex mMutex;
+    std::set<int> mClientPorts;
+
+    // Record the request and wait out the latency. Returns false, having
+    // filled in an error response, if this request should fail.
+    bool beginRequest(httplib::Request const &req, httplib::Response &res);
+
+    void handleMessages(httplib::Request const &req, httplib::Response &res);
+    void handleMediaList(httplib::Request const &req, httplib::Response &res);
+    void handleMedia(httplib::Request const &req, httplib::Response &res);
+    void handleStopMonitoring(httplib::Request const &req, httplib::Response &res);
+
+public:
+    /**
+     * Start serving on the host and port. A port of zero picks any free one.
+     * Throws if it can't bind.
+     */
+    explicit MockServer(MockServerOptions const &options,
+            std::string const &host = "127.0.0.1", int port = 0);
+    ~MockServer();
+
+    // Can't copy.
+    MockServer(const MockServer &) = delete;
+    MockServer &operator=(const MockServer &) = delete;
+
+    /**
+     * Scheme, host, and port of the server, such as "http://127.0.0.1:1234".
+     */
+    std::string url() const;
+
+    /**
+     * Point the config's Twilio and 511.org settings at this server.
+     */
+    void configure(Config &config) const;
+
+    /**
+     * Number of requests received so far.
+     */
+    uint64_t requestCount() const {
+        return mRequestCount;
+    }
+
+    /**
+     * Number of distinct client connections seen so far.
+     */
+    size_t connectionCount();
+
+    /**
+     * Block until the server stops.
+     */
+    void wait();
+};
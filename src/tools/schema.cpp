@@ -0,0 +1,58 @@
+
+#include <stdexcept>
+#include <string>
+
+#include "schema.h"
+
+void execSql(sqlite3 *db, char const *sql) {
+    char *error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+        std::string message = error == nullptr ? "unknown error" : error;
+        sqlite3_free(error);
+        throw std::runtime_error(message);
+    }
+}
+
+sqlite3 *createDatabase(std::filesystem::path const &pathname) {
+    std::filesystem::remove(pathname);
+
+    sqlite3 *db = nullptr;
+    if (sqlite3_open(pathname.c_str(), &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        throw std::runtime_error("can't open database " + pathname.string());
+    }
+
+    // Same as the upgrades in src/python/db.py.
+    try {
+        execSql(db, R"(
+            CREATE TABLE person (id INTEGER PRIMARY KEY, email_address TEXT);
+            CREATE UNIQUE INDEX person_email_address_index ON person(email_address);
+            CREATE TABLE photo (
+                id INTEGER PRIMARY KEY,
+                hash_back text NOT NULL,
+                rotation integer NOT NULL DEFAULT 0,
+                rating integer NOT NULL DEFAULT 3,
+                date integer NOT NULL,
+                display_date text NOT NULL,
+                label text NOT NULL);
+            CREATE UNIQUE INDEX photo_hash_back ON photo(hash_back);
+            CREATE TABLE "email" (
+                id INTEGER PRIMARY KEY,
+                person_id INTEGER,
+                sent_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+                photo_id INTEGER);
+            CREATE TABLE "photo_file" (
+                pathname TEXT PRIMARY KEY,
+                hash_all TEXT,
+                hash_back TEXT);
+            CREATE INDEX photo_file_hash_back ON photo_file(hash_back);
+            CREATE TABLE schema_version (version integer);
+            INSERT INTO schema_version VALUES (0);
+        )");
+    } catch (...) {
+        sqlite3_close(db);
+        throw;
+    }
+
+    return db;
+}
@@ -0,0 +1,20 @@
+
+#pragma once
+
+#include <filesystem>
+
+#include <sqlite3.h>
+
+// Creates PiSlide databases for the tools. The app itself expects the
+// database to exist already (see src/python/db.py).
+
+/**
+ * Run one or more SQL statements. Throws runtime_error on failure.
+ */
+void execSql(sqlite3 *db, char const *sql);
+
+/**
+ * Create a new, empty database with the app's schema, replacing any
+ * existing file. The caller must close the returned connection.
+ */
+sqlite3 *createDatabase(std::filesystem::path const &pathname);
@@ -0,0 +1,39 @@
+
+// Serves stand-ins for the Twilio and 511.org APIs, so that PiSlide can be
+// run and tested offline. Point "twilio.base_url" and "511org.base_url" at
+// the printed URL, with Twilio SID "AC0".
+//
+// Usage: pislide-mock-server [--port PORT] [--latency MS] [--error-every N]
+//     [--messages N] [--image-size BYTES] [--buses N]
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "mockserver.h"
+
+int main(int argc, char *argv[]) {
+    MockServerOptions options;
+    int port = 8090;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--port" && i + 1 < argc) {
+                port = std::stoi(argv[++i]);
+            } else if (!options.parseFlag(argc, argv, i)) {
+                throw std::invalid_argument("unknown flag " + arg);
+            }
+        }
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << '\n';
+        std::cerr << "Usage: pislide-mock-server [--port PORT] " << MockServerOptions::FLAGS_USAGE << '\n';
+        return 1;
+    }
+
+    MockServer server(options, "0.0.0.0", port);
+    std::cout << "Serving mock Twilio and 511.org APIs at " << server.url() << '\n';
+    server.wait();
+
+    return 0;
+}